@@ -0,0 +1,187 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "thread.h"
+#include "noncopyable.h"
+
+namespace frb{
+
+/**
+ * @brief 访问日志
+ * @details 固定格式: 时间, 对端地址, 方法, 路径, 状态码, 收/发字节数, 耗时(微秒), 协程ID。
+ *          每个线程往自己的列式批次里追加记录(只做memcpy, 不格式化字符串),
+ *          批次写满或到了刷新间隔, 由后台线程统一格式化成TSV或带长度前缀的二进制写入文件
+ */
+class AccessLog : Noncopyable {
+public:
+    typedef std::shared_ptr<AccessLog> ptr;
+
+    /**
+     * @brief 输出格式
+     */
+    enum Format {
+        /// 每条一行, 字段用\t分隔
+        TSV = 1,
+        /// 每条以uint32长度开头的二进制记录
+        BINARY = 2
+    };
+
+    /**
+     * @brief 构造函数, 打开文件并启动后台刷新线程
+     * @param[in] file 文件名, 以追加方式打开
+     * @param[in] format 输出格式
+     * @param[in] batch_size 每个批次的记录条数
+     * @param[in] flush_interval 刷新间隔(毫秒), 0表示只在批次写满和析构时写出
+     */
+    AccessLog(const std::string& file, Format format = TSV
+              ,uint32_t batch_size = 4096, uint32_t flush_interval = 1000);
+
+    /**
+     * @brief 析构函数, 停止后台线程并写出剩余记录
+     */
+    ~AccessLog();
+
+    /**
+     * @brief 记录一次访问
+     * @param[in] addr 对端地址, 只支持AF_INET/AF_INET6, 其它记为空地址
+     * @param[in] method 方法, 最多保留7个字符; 非HTTP连接传"-"
+     * @param[in] path 路径, 最多保留s_max_path个字符
+     * @param[in] path_len 路径长度
+     * @param[in] status 状态码
+     * @param[in] bytes_in 收到的字节数
+     * @param[in] bytes_out 发送的字节数
+     * @param[in] latency_us 耗时(微秒)
+     * @param[in] fiber_id 处理请求的协程ID
+     */
+    void log(const sockaddr* addr, const char* method
+             ,const char* path, size_t path_len, uint16_t status
+             ,uint64_t bytes_in, uint64_t bytes_out
+             ,uint64_t latency_us, uint32_t fiber_id);
+
+    /**
+     * @brief 立即写出所有线程当前批次里的记录
+     */
+    void flush();
+
+    const std::string& getFile() const { return m_file;}
+    Format getFormat() const { return m_format;}
+
+    /**
+     * @brief 返回按access_log.*配置创建的访问日志
+     * @return access_log.file为空时返回nullptr
+     */
+    static AccessLog::ptr GetDefault();
+
+    /**
+     * @brief 格式名(tsv/binary)转成Format, 无法识别时返回TSV
+     */
+    static Format FormatFromString(const std::string& v);
+
+    /// 路径最多保留的字符数
+    static const size_t s_max_path = 1024;
+
+private:
+    /**
+     * @brief 一个列式批次, 构造时按容量一次分配好
+     */
+    struct Batch {
+        typedef std::shared_ptr<Batch> ptr;
+
+        Batch(uint32_t capacity);
+
+        /**
+         * @brief 批次是否还放得下一条路径长度为path_len的记录
+         */
+        bool hasRoom(size_t path_len) const {
+            return size < capacity && paths.size() - path_used >= path_len;
+        }
+
+        uint32_t capacity;
+        uint32_t size = 0;
+        std::vector<uint64_t> times;
+        std::vector<uint8_t> families;
+        std::vector<uint8_t> ips;           // 每条16字节
+        std::vector<uint16_t> ports;
+        std::vector<char> methods;          // 每条8字节
+        std::vector<uint32_t> path_offs;
+        std::vector<uint16_t> path_lens;
+        std::vector<char> paths;
+        size_t path_used = 0;
+        std::vector<uint16_t> statuses;
+        std::vector<uint64_t> bytes_ins;
+        std::vector<uint64_t> bytes_outs;
+        std::vector<uint64_t> latencies;
+        std::vector<uint32_t> fiber_ids;
+    };
+
+    /**
+     * @brief 每个线程一个, 只有所属线程和刷新线程会碰它
+     */
+    struct Slot {
+        typedef std::shared_ptr<Slot> ptr;
+        Spinlock mutex;
+        Batch::ptr active;
+    };
+
+    /**
+     * @brief 当前线程的Slot, 第一次调用时注册
+     */
+    Slot* getSlot();
+
+    /**
+     * @brief 取一个空批次, 没有空闲的就新分配
+     */
+    Batch::ptr allocBatch();
+
+    /**
+     * @brief 把写满的批次交给刷新线程
+     */
+    void submit(Batch::ptr batch);
+
+    /**
+     * @brief 唤醒刷新线程
+     */
+    void wakeup();
+
+    /**
+     * @brief 格式化并写出一个批次, 然后放回空闲列表
+     */
+    void write(Batch::ptr batch);
+
+    /**
+     * @brief 后台线程执行函数
+     */
+    void run();
+
+private:
+    std::string m_file;
+    Format m_format;
+    uint32_t m_batchSize;
+    uint32_t m_flushInterval;
+    int m_fd = -1;
+    /// 有满批次或要停止时通知刷新线程
+    int m_event = -1;
+    /// 用于区分不同实例的线程局部Slot
+    uint64_t m_id;
+    std::atomic<bool> m_stop{false};
+
+    /// 保护m_slots, m_full, m_free
+    Mutex m_mutex;
+    std::vector<Slot::ptr> m_slots;
+    std::vector<Batch::ptr> m_full;
+    std::vector<Batch::ptr> m_free;
+
+    /// 只在刷新线程(和析构)里写文件, 串行化用
+    Mutex m_writeMutex;
+    /// 格式化缓冲区
+    std::string m_buf;
+
+    Thread::ptr m_thread;
+};
+
+}
@@ -1,5 +1,14 @@
 #pragma once 
 
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <vector>
+#include <atomic>
+#include "noncopyable.h"
+
 namespace frb{
 
 /**
@@ -29,12 +38,104 @@ public:
          */
         ~Node();
 
+        /**
+         * @brief 创建s字节的节点, 节点头和内存块在同一次分配里
+         * @details 优先从当前线程的节点池里取, 池里没有同样大小的节点才分配
+         */
+        static Node* Create(size_t s);
+
+        /**
+         * @brief 减少Create创建的节点的引用计数, 减到0时
+         *        当前线程的节点池没满就缓存起来, 否则释放
+         */
+        static void Release(Node* node);
+
         /// 内存块地址指针
         char* ptr;
-        /// 下一个内存块地址
+        /// 在节点池里时指向下一个空闲节点
         Node* next;
         /// 内存块大小
         size_t size;
+        /// 引用计数, ByteArray和Slice各持有一份
+        std::atomic<uint32_t> ref;
+        /// 内存来自mmap时持有映射, 最后一个引用它的节点释放后才munmap
+        std::shared_ptr<void> mapping;
+    };
+
+    /**
+     * @brief ByteArray中一段数据的只读视图, 由若干节点片段组成, 与ByteArray共享节点
+     * @details 创建和拼接都不拷贝数据; 之后ByteArray再改写被共享的节点时会先复制一份(写时复制),
+     *          所以Slice的内容不会变。可以在线程间传递
+     */
+    class Slice : Noncopyable {
+    public:
+        typedef std::shared_ptr<Slice> ptr;
+
+        /**
+         * @brief 析构函数, 释放对节点的引用
+         */
+        ~Slice();
+
+        /**
+         * @brief 返回数据长度
+         */
+        size_t getSize() const { return m_size;}
+
+        /**
+         * @brief 从position开始读取size长度的数据
+         * @exception 如果 (getSize() - position) < size 则抛出 std::out_of_range
+         */
+        void read(void* buf, size_t size, size_t position = 0) const;
+
+        /**
+         * @brief 把全部数据拷贝成std::string
+         */
+        std::string toString() const;
+
+        /**
+         * @brief 获取[position, position + len)的数据, 保存成iovec数组, 可以直接writev
+         * @return 返回实际数据的长度
+         */
+        uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len = ~0ull, uint64_t position = 0) const;
+
+        /**
+         * @brief 取[position, position + len)的子视图, 不拷贝数据
+         * @exception 如果 position + len > getSize() 则抛出 std::out_of_range
+         */
+        Slice::ptr slice(size_t position, size_t len) const;
+
+        /**
+         * @brief 把other的数据接到末尾, 只增加节点引用, 不拷贝数据
+         */
+        void append(const Slice& other);
+    private:
+        /**
+         * @brief 节点片段
+         */
+        struct Span {
+            Node* node;
+            /// 片段在节点内的偏移
+            size_t off;
+            /// 片段长度
+            size_t len;
+            /// 片段在Slice里的起始位置
+            size_t start;
+        };
+
+        /**
+         * @brief 追加一个片段, 增加节点引用
+         */
+        void addSpan(Node* node, size_t off, size_t len);
+
+        /**
+         * @brief 返回包含position的片段下标, position < getSize()
+         */
+        size_t findSpan(size_t position) const;
+    private:
+        std::vector<Span> m_spans;
+        size_t m_size = 0;
+
+        friend class ByteArray;
     };
 
     /**
@@ -322,7 +423,79 @@ public:
     std::string readStringVint();
 
     /**
-     * @brief 清空ByteArray
+     * @brief 批量写入固定长度的数组(大端/小端), 与逐个调用writeFxxx的结果相同
+     * @details 按节点剩余空间整段拷贝, 需要转换字节序时用SIMD做字节交换
+     * @param[in] values 数组首地址
+     * @param[in] n 元素个数
+     * @post m_position += n * sizeof(元素)
+     *       如果m_position > m_size 则 m_size = m_position
+     */
+    void writeFint16Array (const int16_t* values, size_t n);
+    void writeFuint16Array(const uint16_t* values, size_t n);
+    void writeFint32Array (const int32_t* values, size_t n);
+    void writeFuint32Array(const uint32_t* values, size_t n);
+    void writeFint64Array (const int64_t* values, size_t n);
+    void writeFuint64Array(const uint64_t* values, size_t n);
+    void writeFloatArray  (const float* values, size_t n);
+    void writeDoubleArray (const double* values, size_t n);
+
+    /**
+     * @brief 批量写入Varint数组, 与逐个调用writeInt32/writeUint32/writeInt64/writeUint64的结果相同
+     * @param[in] values 数组首地址
+     * @param[in] n 元素个数
+     * @post m_position += 实际占用内存
+     *       如果m_position > m_size 则 m_size = m_position
+     */
+    void writeInt32Array (const int32_t* values, size_t n);
+    void writeUint32Array(const uint32_t* values, size_t n);
+    void writeInt64Array (const int64_t* values, size_t n);
+    void writeUint64Array(const uint64_t* values, size_t n);
+
+    /**
+     * @brief 批量读取固定长度的数组(大端/小端), 与逐个调用readFxxx的结果相同
+     * @param[out] values 数组首地址, 至少能放n个元素
+     * @param[in] n 元素个数
+     * @pre getReadSize() >= n * sizeof(元素)
+     * @post m_position += n * sizeof(元素)
+     * @exception 如果getReadSize() < n * sizeof(元素) 抛出 std::out_of_range, 此时不读取任何数据
+     */
+    void readFint16Array (int16_t* values, size_t n);
+    void readFuint16Array(uint16_t* values, size_t n);
+    void readFint32Array (int32_t* values, size_t n);
+    void readFuint32Array(uint32_t* values, size_t n);
+    void readFint64Array (int64_t* values, size_t n);
+    void readFuint64Array(uint64_t* values, size_t n);
+    void readFloatArray  (float* values, size_t n);
+    void readDoubleArray (double* values, size_t n);
+
+    /**
+     * @brief 批量读取Varint数组, 与逐个调用readInt32/readUint32/readInt64/readUint64的结果相同
+     * @param[out] values 数组首地址, 至少能放n个元素
+     * @param[in] n 元素个数
+     * @post m_position += 实际占用内存
+     * @exception 如果数据不够 抛出 std::out_of_range, 之前已解出的元素保留在values里
+     */
+    void readInt32Array (int32_t* values, size_t n);
+    void readUint32Array(uint32_t* values, size_t n);
+    void readInt64Array (int64_t* values, size_t n);
+    void readUint64Array(uint64_t* values, size_t n);
+
+    /**
+     * @brief 取[position, position + len)的只读视图, 和ByteArray共享节点, 不拷贝数据
+     * @exception 如果 position + len > getSize() 则抛出 std::out_of_range
+     */
+    Slice::ptr slice(size_t position, size_t len) const;
+
+    /**
+     * @brief 写入Slice的全部数据
+     * @details 当前位置对齐到节点边界, 且片段正好是一个同样大小的完整节点时直接共享该节点,
+     *          其余部分拷贝写入
+     * @post m_position += slice.getSize(), 如果m_position > m_size 则 m_size = m_position
+     */
+    void writeSlice(const Slice& slice);
+
+    /**
+     * @brief 清空ByteArray, 保留前getKeepNodes()个节点, 其余的还给节点池
      * @post m_position = 0, m_size = 0
      */
     void clear();
@@ -362,26 +535,52 @@ public:
      * @brief 设置ByteArray当前位置
      * @post 如果m_position > m_size 则 m_size = m_position
      * @exception 如果m_position > m_capacity 则抛出 std::out_of_range
+     *            只读模式下 m_position > m_size 也抛出 std::out_of_range
      */
     void setPosition(size_t v);
 
     /**
-     * @brief 把ByteArray的数据写入到文件中
+     * @brief 把ByteArray的数据[m_position, m_size)写入到文件中
+     * @details 数据来自mmapFile时用copy_file_range在内核里拷贝, 否则对getReadBuffers的结果writev
      * @param[in] name 文件名
      */
     bool writeToFile(const std::string& name) const;
 
     /**
-     * @brief 从文件中读取数据
+     * @brief 从文件中读取数据, 直接readv到getWriteBuffers返回的节点内存里
      * @param[in] name 文件名
      */
     bool readFromFile(const std::string& name);
 
+    /**
+     * @brief 以只读方式mmap文件, 文件页直接作为节点, 不拷贝数据
+     * @details 原有数据会被清空, 之后m_position = 0, m_size = 文件大小。
+     *          只读模式下的写操作抛出 std::logic_error, clear()后恢复成普通ByteArray。
+     *          节点可以通过slice()共享出去, 映射在最后一个引用释放后解除
+     * @param[in] name 文件名
+     */
+    bool mmapFile(const std::string& name);
+
+    /**
+     * @brief 是否是mmapFile得到的只读ByteArray
+     */
+    bool isReadOnly() const { return (bool)m_mapped;}
+
     /**
      * @brief 返回内存块的大小
      */
     size_t getBaseSize() const { return m_baseSize;}
 
+    /**
+     * @brief 返回clear()后保留的节点数
+     */
+    size_t getKeepNodes() const { return m_keepNodes;}
+
+    /**
+     * @brief 设置clear()后保留的节点数(至少保留1个), 默认取配置bytearray.keep_nodes
+     */
+    void setKeepNodes(size_t v) { m_keepNodes = v ? v : 1;}
+
     /**
      * @brief 返回可读取数据大小
      */
@@ -433,17 +632,129 @@ public:
      */
     uint64_t getWriteBuffers(std::vector<iovec>& buffers, uint64_t len);
 
+    /**
+     * @brief 同getReadBuffers, 结果放在ByteArray内部复用的iovec数组里, 避免每次分配
+     * @return 内部iovec数组, 下次调用get*Iovecs前有效
+     */
+    const std::vector<iovec>& getReadIovecs(uint64_t len = ~0ull);
+
+    /**
+     * @brief 同getWriteBuffers, 结果放在ByteArray内部复用的iovec数组里
+     * @return 内部iovec数组, 下次调用get*Iovecs前有效
+     */
+    std::vector<iovec>& getWriteIovecs(uint64_t len);
+
+    /**
+     * @brief 返回[m_position, m_capacity)全部可写空间
+     * @details 可写空间不足min_size(0表示一个节点)时按整节点扩容, 新节点来自节点池
+     * @return 内部iovec数组, 下次调用get*Iovecs前有效
+     */
+    std::vector<iovec>& getFreeIovecs(size_t min_size = 0);
+
+    /**
+     * @brief 读取fd上当前可读的数据, 不需要事先指定长度
+     * @details 用getFreeIovecs(至少一个空闲节点)做一次readv, 读到的数据追加在m_position之后
+     * @return readv的返回值
+     *      @retval >0 读到的字节数, m_position += 返回值
+     *      @retval =0 对端关闭
+     *      @retval <0 出错, 见errno
+     */
+    ssize_t readSome(int fd);
+
+    /**
+     * @brief 在[from, m_size)里查找字符c
+     * @details 逐节点用SSE2/AVX2一次比较16/32字节, 不拼接节点
+     * @return 绝对位置(可直接用于read(buf, size, position)), 找不到返回-1
+     */
+    int64_t findByte(char c, size_t from = 0) const;
+
+    /**
+     * @brief 在[from, m_size)里查找pattern
+     * @details 节点内用首尾字节的SIMD比较筛选候选位置再逐个确认,
+     *          跨节点的匹配只拼接边界两侧各pattern.size() - 1字节检查
+     * @return 绝对位置(可直接用于read(buf, size, position)), 找不到返回-1
+     */
+    int64_t find(const std::string& pattern, size_t from = 0) const;
+
+    /**
+     * @brief 从m_position + offset开始查找字符c
+     * @return 相对m_position的偏移, 找不到返回-1
+     */
+    int64_t indexOf(char c, size_t offset = 0) const;
+
+    /**
+     * @brief 从m_position + offset开始查找分隔符delim, 分隔符可以跨节点
+     * @return 相对m_position的偏移, 找不到返回-1
+     */
+    int64_t indexOf(const std::string& delim, size_t offset = 0) const;
+
+    /**
+     * @brief 读出到分隔符为止的数据, 分隔符被跳过
+     * @param[out] out 分隔符之前的数据(不含分隔符)
+     * @param[in] delim 分隔符, 默认"\n"
+     * @return 找到分隔符返回true, 否则返回false且不移动位置
+     * @post 找到时 m_position += out.size() + delim.size()
+     */
+    bool readUntil(std::string& out, const std::string& delim = "\n");
+
     /**
      * @brief 返回数据的长度
      */
     size_t getSize() const { return m_size;}
 private:
-    
+    /**
+     * @brief 写入无符号varint, 当前节点剩余空间够时直接编码进节点
+     */
+    void writeVarint(uint64_t value);
+
+    /**
+     * @brief 读取无符号varint, 最多读max_bytes字节
+     * @details 当前节点里有完整的varint时直接解码, 跨节点时才逐字节读
+     * @exception 如果数据不够 抛出 std::out_of_range
+     */
+    uint64_t readVarint(size_t max_bytes);
+
+    /**
+     * @brief 写入size字节的定长元素数组, 字节序不同时按width字节交换
+     */
+    void writeFixedArray(const void* buf, size_t size, size_t width);
+
+    /**
+     * @brief 读取size字节的定长元素数组, 字节序不同时按width字节交换
+     */
+    void readFixedArray(void* buf, size_t size, size_t width);
+
+    /**
+     * @brief 批量写入varint, encode把元素转成无符号整数(zigzag等)
+     */
+    template<class T, class F>
+    void writeVarintArray(const T* values, size_t n, F encode);
+
+    /**
+     * @brief 批量读取varint, 最多读max_bytes字节, decode把无符号整数转回元素
+     */
+    template<class T, class F>
+    void readVarintArray(T* values, size_t n, size_t max_bytes, F decode);
+
     /**
      * @brief 扩容ByteArray,使其可以容纳size个数据(如果原本可以可以容纳,则不扩容)
      */
     void addCapacity(size_t size);
 
+    /**
+     * @brief 返回position所在的节点, position == m_capacity 时返回nullptr
+     */
+    Node* nodeAt(size_t position) const {
+        size_t idx = position / m_baseSize;
+        return idx < m_nodes.size() ? m_nodes[idx] : nullptr;
+    }
+
+    /**
+     * @brief 写入[m_position, m_position + size)之前, 把其中被Slice共享的节点换成副本
+     * @exception 只读模式下抛出 std::logic_error
+     */
+    void unshare(size_t size);
+
     /**
      * @brief 获取当前的可写入容量
      */
@@ -459,9 +770,17 @@ private:
     size_t m_size;
     /// 字节序,默认大端
     int8_t m_endian;
-    /// 第一个内存块指针
-    Node* m_root;
+    /// clear()后保留的节点数
+    size_t m_keepNodes;
     /// 当前操作的内存块指针
     Node* m_cur;
+    /// 按顺序保存所有节点(节点大小都是m_baseSize), 用于按位置直接定位节点
+    std::vector<Node*> m_nodes;
+    /// 是否有节点可能被Slice共享, 为true时写入前要检查写时复制
+    mutable bool m_shared = false;
+    /// mmapFile映射的文件, 非空时为只读模式
+    std::shared_ptr<void> m_mapped;
+    /// get*Iovecs复用的iovec数组
+    std::vector<iovec> m_iovs;
 }; 
 }
\ No newline at end of file
@@ -13,6 +13,8 @@
 #include <unordered_set>
 #include <functional>
 #include <algorithm>
+#include <type_traits>
+#include <typeinfo>
 
 
 #include "log.h"
@@ -21,6 +23,8 @@
 
 namespace frb{
 
+    class Scheduler;
+
     class ConfigVarBase{
         public:
             typedef std::shared_ptr<ConfigVarBase> ptr;
@@ -35,6 +39,33 @@ namespace frb{
             virtual std::string toString()  = 0;
             virtual bool fromString(const std::string& val) = 0;
 
+            /**
+             * @brief 直接从YAML节点设置值
+             * @return 值是否发生了变化
+             */
+            virtual bool fromNode(const YAML::Node& node) = 0;
+
+            /**
+             * @brief 事务式加载第一步: 把节点转换成待提交的值, 当前值不变
+             * @return 待提交的值是否与当前值不同
+             * @exception 转换失败时抛出异常
+             */
+            virtual bool stage(const YAML::Node& node) = 0;
+
+            /**
+             * @brief 发布待提交的值, 不执行监听函数
+             * @return 需要执行的监听通知; 已经有一次没执行的通知时返回nullptr, 合并到那一次
+             */
+            virtual std::function<void()> commit() = 0;
+
+            /**
+             * @brief 丢弃待提交的值
+             */
+            virtual void rollback() = 0;
+
+            const std::string& getName() const { return m_name;}
+            const std::string& getDescription() const { return m_description;}
+
             virtual std::string getTypeName() const = 0;
 
 
@@ -273,6 +304,129 @@ namespace frb{
 
 
 
+    /**
+     * @brief 类型转换模板类(YAML::Node 转换成 T)
+     * @details 省去"节点->字符串->YAML::Load"的往返。标量直接用Scalar()转换,
+     *          其它节点退回到字符串+LexicalCast; 自定义类型可以特化YamlCast
+     */
+    template<class T>
+    class YamlCast {
+    public:
+        T operator()(const YAML::Node& node) {
+            if(node.IsScalar()) {
+                return LexicalCast<std::string, T>()(node.Scalar());
+            }
+            std::stringstream ss;
+            ss << node;
+            return LexicalCast<std::string, T>()(ss.str());
+        }
+    };
+
+    /**
+     * @brief 类型转换模板类片特化(YAML::Node 转换成 std::vector<T>)
+     */
+    template<class T>
+    class YamlCast<std::vector<T> > {
+    public:
+        std::vector<T> operator()(const YAML::Node& node) {
+            std::vector<T> vec;
+            if(node.IsSequence()) {
+                vec.reserve(node.size());
+                for(auto it = node.begin(); it != node.end(); ++it) {
+                    vec.push_back(YamlCast<T>()(*it));
+                }
+            }
+            return vec;
+        }
+    };
+
+    /**
+     * @brief 类型转换模板类片特化(YAML::Node 转换成 std::list<T>)
+     */
+    template<class T>
+    class YamlCast<std::list<T> > {
+    public:
+        std::list<T> operator()(const YAML::Node& node) {
+            std::list<T> vec;
+            if(node.IsSequence()) {
+                for(auto it = node.begin(); it != node.end(); ++it) {
+                    vec.push_back(YamlCast<T>()(*it));
+                }
+            }
+            return vec;
+        }
+    };
+
+    /**
+     * @brief 类型转换模板类片特化(YAML::Node 转换成 std::set<T>)
+     */
+    template<class T>
+    class YamlCast<std::set<T> > {
+    public:
+        std::set<T> operator()(const YAML::Node& node) {
+            std::set<T> vec;
+            if(node.IsSequence()) {
+                for(auto it = node.begin(); it != node.end(); ++it) {
+                    vec.insert(YamlCast<T>()(*it));
+                }
+            }
+            return vec;
+        }
+    };
+
+    /**
+     * @brief 类型转换模板类片特化(YAML::Node 转换成 std::unordered_set<T>)
+     */
+    template<class T>
+    class YamlCast<std::unordered_set<T> > {
+    public:
+        std::unordered_set<T> operator()(const YAML::Node& node) {
+            std::unordered_set<T> vec;
+            if(node.IsSequence()) {
+                for(auto it = node.begin(); it != node.end(); ++it) {
+                    vec.insert(YamlCast<T>()(*it));
+                }
+            }
+            return vec;
+        }
+    };
+
+    /**
+     * @brief 类型转换模板类片特化(YAML::Node 转换成 std::map<std::string, T>)
+     */
+    template<class T>
+    class YamlCast<std::map<std::string, T> > {
+    public:
+        std::map<std::string, T> operator()(const YAML::Node& node) {
+            std::map<std::string, T> vec;
+            if(node.IsMap()) {
+                for(auto it = node.begin(); it != node.end(); ++it) {
+                    vec.insert(std::make_pair(it->first.Scalar()
+                                ,YamlCast<T>()(it->second)));
+                }
+            }
+            return vec;
+        }
+    };
+
+    /**
+     * @brief 类型转换模板类片特化(YAML::Node 转换成 std::unordered_map<std::string, T>)
+     */
+    template<class T>
+    class YamlCast<std::unordered_map<std::string, T> > {
+    public:
+        std::unordered_map<std::string, T> operator()(const YAML::Node& node) {
+            std::unordered_map<std::string, T> vec;
+            if(node.IsMap()) {
+                for(auto it = node.begin(); it != node.end(); ++it) {
+                    vec.insert(std::make_pair(it->first.Scalar()
+                                ,YamlCast<T>()(it->second)));
+                }
+            }
+            return vec;
+        }
+    };
+
     template<class T, class FromStr = LexicalCast<std::string, T>, class ToStr = LexicalCast<T, std::string>>
     class ConfigVar : public ConfigVarBase{
         public:
@@ -290,9 +444,7 @@ namespace frb{
 
             std::string toString()  override {
                 try {
-                    //其它线程可以读但是不能写
-                    RWMutexType::ReadLock lock(m_mutex);
-                    return ToStr()(m_val);
+                    return ToStr()(*m_val.get());
                 }  catch (std::exception& e) {
                     LOG_ERROR(GET_LOG_ROOT,  "ConfigVar::toString exception");
                     // LOG_ERROR(GET_LOG_ROOT(),  "ConfigVar::toString exception " + e.what().
@@ -315,25 +467,74 @@ namespace frb{
                 return false;
             }
 
-            void setValue(const T& v) {
+            bool fromNode(const YAML::Node& node) override {
+                try {
+                    return setValue(NodeTo(node, std::is_same<FromStr, LexicalCast<std::string, T> >()));
+                } catch (std::exception& e) {
+                    LOG_ERROR_STREAM(GET_LOG_ROOT) << "ConfigVar::fromNode exception " << e.what()
+                        << " convert node to " << TypeToName<T>() << " name=" << m_name;
+                }
+                return false;
+            }
+
+            bool stage(const YAML::Node& node) override {
+                m_pending.reset(new T(NodeTo(node, std::is_same<FromStr, LexicalCast<std::string, T> >())));
+                return !(*m_val.get() == *m_pending);
+            }
+
+            std::function<void()> commit() override {
+                if(!m_pending) {
+                    return nullptr;
+                }
+                typename RCUValue<T>::ConstPtr old_value = m_val.set(*m_pending);
+                m_pending.reset();
+
+                Mutex::Lock lock(m_notifyMutex);
+                if(m_notifyOld) {
+                    //上一次的通知还没执行, 它执行时会拿到最新值
+                    return nullptr;
+                }
+                m_notifyOld = old_value;
+                return std::bind(&ConfigVar::notifyPending, this);
+            }
+
+            void rollback() override {
+                m_pending.reset();
+            }
+
+            /**
+             * @brief 设置值, 值有变化时先通知监听函数
+             * @return 值是否发生了变化
+             */
+            bool setValue(const T& v) {
+                typename RCUValue<T>::ConstPtr old_value = m_val.get();
+                if(*old_value == v){
+                    return false;
+                }
                 {
                     RWMutexType::ReadLock lock(m_mutex);
-                    if(m_val == v){
-                        return;
-                    }
-
                     for(auto &i : m_cbs){
-                        i.second(m_val, v);
+                        i.second(*old_value, v);
                     }
                 }
-                RWMutexType::WriteLock lock(m_mutex);
-                m_val = v;
+                m_val.set(v);
+                return true;
             }
 
-            const T getValue() {
-                //其它线程可能在写
-                RWMutexType::ReadLock lock(m_mutex);
-                return m_val;
+            /**
+             * @brief 返回当前值的拷贝, 读不加锁
+             */
+            const T getValue() const {
+                return *m_val.get();
+            }
+
+            /**
+             * @brief 返回当前值的只读快照, 不拷贝值, 不加锁
+             * @details 快照在返回的指针释放前一直有效, 看不到之后的修改;
+             *          值被替换后, 旧快照随最后一个持有者释放。大的容器类配置用它避免拷贝
+             */
+            std::shared_ptr<const T> getSnapshot() const {
+                return m_val.get();
             }
 
             std::string getTypeName() const override {return TypeToName<T>();}
@@ -365,9 +566,52 @@ namespace frb{
                 m_cbs.clear();
             }           
         private:
+            /**
+             * @brief 执行合并后的通知: 旧值是第一次提交前的值, 新值是当前值
+             */
+            void notifyPending() {
+                typename RCUValue<T>::ConstPtr old_value;
+                {
+                    Mutex::Lock lock(m_notifyMutex);
+                    old_value.swap(m_notifyOld);
+                }
+                typename RCUValue<T>::ConstPtr new_value = m_val.get();
+                if(!old_value || *old_value == *new_value) {
+                    return;
+                }
+                RWMutexType::ReadLock lock(m_mutex);
+                for(auto &i : m_cbs){
+                    i.second(*old_value, *new_value);
+                }
+            }
+
+            //使用默认的FromStr时直接从节点转换
+            static T NodeTo(const YAML::Node& node, std::true_type) {
+                return YamlCast<T>()(node);
+            }
+
+            //自定义了FromStr, 仍然走字符串
+            static T NodeTo(const YAML::Node& node, std::false_type) {
+                if(node.IsScalar()) {
+                    return FromStr()(node.Scalar());
+                }
+                std::stringstream ss;
+                ss << node;
+                return FromStr()(ss.str());
+            }
+
+        private:
+            //保护m_cbs
             RWMutexType m_mutex;
-            T m_val;
+            //值的快照, 读不加读锁; 旧值在没有读者持有后回收
+            RCUValue<T> m_val;
             std::map<uint64_t, on_change_cb> m_cbs;
+            //事务式加载中待提交的值, 只在Config的加载锁内访问
+            std::unique_ptr<T> m_pending;
+            //保护m_notifyOld
+            Mutex m_notifyMutex;
+            //还没执行的通知对应的旧值, 持有到通知执行完
+            typename RCUValue<T>::ConstPtr m_notifyOld;
 
     };
 
@@ -376,56 +620,108 @@ namespace frb{
             typedef std::unordered_map<std::string, ConfigVarBase::ptr> ConfigVarMap;
             typedef RWMutex RWMutexType;
 
+            /**
+             * @brief 查找配置项, 不存在时用default_value创建
+             * @details 已存在的配置项在无锁索引里查到, 只有第一次注册时才加写锁。
+             *          通常在静态初始化时调用一次, 把返回的句柄保存下来直接读
+             */
             template<class T>
             static typename ConfigVar<T>::ptr Lookup(const std::string& name,
                                                      const T& default_value,
                                                      const std::string& des = ""){
-                
-                //避免同时写全局的config
-                RWMutexType::WriteLock lock(GetMutex());                                    
-                auto it = GetDatas().find(name);
-                if(it != GetDatas().end()){
-                    auto tmp = std::dynamic_pointer_cast<ConfigVar<T> >(it->second);
-
-                    if(tmp){
-                        //参数名为name的配置参数存在,直接返回
-                        LOG_INFO(GET_LOG_ROOT, "Lookup name=" + name + "exists");
-                        return tmp;
-                    } else {
-                        //参数名为name的配置参数存在,但是类型不匹配
-                        LOG_ERROR(GET_LOG_ROOT, "Lookup name=" + name + " exists but type not " + TypeToName<T>()  + " real_type=" + it->second->getTypeName()
-                        + " " + it->second->toString());
-                        return nullptr;
-                    }
+                ConfigVarBase::ptr base = LookUpBase(name);
+                if(base) {
+                    return CastVar<T>(base, true);
                 }
 
                 //参数名包含非法字符[^0-9a-z_.] 抛出异常 std::invalid_argument
-                if(name.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._012345678") 
+                if(name.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._0123456789") 
                     != std::string::npos) {
                         LOG_ERROR(GET_LOG_ROOT, "Lookup name invalid" + name);
                         throw std::invalid_argument(name);
                 }
 
+                //避免同时写全局的config
+                RWMutexType::WriteLock lock(GetMutex());                                    
+                auto it = GetDatas().find(name);
+                if(it != GetDatas().end()){
+                    return CastVar<T>(it->second, true);
+                }
+
                 //参数不存在,创建参数并用default_value赋值,同时放入全局的配置参数图中
                 typename ConfigVar<T>::ptr v(new ConfigVar<T>(name, default_value, des));
                 GetDatas()[name] = v;
+                PublishIndexNoLock(false);
                 return v;
             }
 
 
             template<class T>
             static typename ConfigVar<T>::ptr Lookup(const std::string& name){
-                
-                RWMutexType::ReadLock lock(GetMutex());
-                auto it = GetDatas().find(name);
-                if(it != GetDatas().end()){
-                    return std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
-                }
-                return nullptr;
+                ConfigVarBase::ptr base = LookUpBase(name);
+                return base ? CastVar<T>(base, false) : nullptr;
             }
 
+            /**
+             * @brief 按名称查找配置项, 命中索引时无锁
+             */
             static ConfigVarBase::ptr LookUpBase(const std::string& name);
-            static void LoadFromYaml(YAML::Node& root);
+
+            /**
+             * @brief 用环境变量覆盖配置
+             * @details 配置名转大写、'.'换成'_'再加上prefix就是对应的环境变量名,
+             *          如tcp_server.read_timeout对应FRB_TCP_SERVER_READ_TIMEOUT;
+             *          多个配置项对应同一个环境变量名时告警并忽略。值按YAML解析
+             * @return 是否提交成功
+             */
+            static bool LoadFromEnv(const std::string& prefix = "FRB_");
+
+            /**
+             * @brief 用命令行参数--key=value覆盖配置, 其它参数忽略
+             * @return 是否提交成功
+             */
+            static bool LoadFromArgs(int argc, char** argv);
+
+            /**
+             * @brief 按YAML树重新加载配置
+             * @details 先把所有改动转换成待提交的值, 任何一项转换失败则整体放弃;
+             *          全部成功后一次性提交, 提交期间GetVersion()为奇数。
+             *          监听函数在提交之后执行, 同一配置项合并成一次通知;
+             *          设置了监听调度器时放到调度器上执行, 不阻塞加载线程
+             * @return 是否提交成功
+             */
+            static bool LoadFromYaml(YAML::Node& root);
+
+            /**
+             * @brief 把若干YAML文件编译成二进制快照
+             * @details 快照用ByteArray序列化, 保存各文件解析后的节点树
+             *          以及这些文件内容的hash, 布局与地址无关, 可以直接映射
+             * @param[in] yaml_files YAML文件, 加载时按这个顺序生效
+             * @param[in] snapshot_file 快照文件
+             */
+            static bool CompileSnapshot(const std::vector<std::string>& yaml_files
+                                        ,const std::string& snapshot_file);
+
+            /**
+             * @brief 启动时加载配置: 快照中的hash与当前YAML文件一致时直接加载快照,
+             *        不解析YAML; 快照不存在、损坏或过期时退回到逐个解析YAML文件
+             * @details 快照用mmapFile映射后直接解码; 所有文件作为一个事务应用, 任一项失败都不生效
+             * @return 是否全部加载成功
+             */
+            static bool LoadFromSnapshot(const std::string& snapshot_file
+                                         ,const std::vector<std::string>& yaml_files);
+
+            /**
+             * @brief 设置执行配置监听函数的调度器, nullptr表示在加载线程上同步执行
+             */
+            static void SetListenerScheduler(Scheduler* scheduler);
+            static Scheduler* GetListenerScheduler();
+
+            /**
+             * @brief 配置版本号, 每次提交或配置表发布到索引时加2; 为奇数说明正在提交
+             * @details 需要同时读多项配置并保证一致时, 读前读后比较版本号
+             */
+            static uint64_t GetVersion();
         
         private:
             static ConfigVarMap& GetDatas(){
@@ -437,5 +733,55 @@ namespace frb{
                 static RWMutexType s_mutex;
                 return s_mutex;
             }         
+
+            /**
+             * @brief 配置表的只读快照, 查找时无锁
+             * @details 注册时不是每次都发布(那样静态初始化是O(n^2)),
+             *          而是配置表比快照大一倍时才发布; 查找没有命中快照但命中配置表时立即发布
+             */
+            static RCUValue<ConfigVarMap>& GetIndex() {
+                static RCUValue<ConfigVarMap> s_index;
+                return s_index;
+            }
+
+            /**
+             * @brief 把配置表发布到索引, 调用方持有写锁
+             * @param[in] force false时只在配置表比快照大一倍时发布
+             */
+            static void PublishIndexNoLock(bool force);
+
+            /**
+             * @brief 检查类型并转换, 用typeid比较, 不做dynamic_cast
+             */
+            template<class T>
+            static typename ConfigVar<T>::ptr CastVar(const ConfigVarBase::ptr& base, bool log_error) {
+                if(typeid(*base) == typeid(ConfigVar<T>)) {
+                    return std::static_pointer_cast<ConfigVar<T> >(base);
+                }
+                if(log_error) {
+                    //参数名为name的配置参数存在,但是类型不匹配
+                    LOG_ERROR(GET_LOG_ROOT, "Lookup name=" + base->getName() + " exists but type not " + TypeToName<T>()  + " real_type=" + base->getTypeName()
+                    + " " + base->toString());
+                }
+                return nullptr;
+            }
+
+            typedef std::vector<std::pair<ConfigVarBase::ptr, YAML::Node> > NodeList;
+
+            /**
+             * @brief 事务式地应用一组(配置项, 节点), LoadFromYaml和覆盖层共用
+             */
+            static bool Apply(const NodeList& matched, const char* source, size_t nodes, uint64_t start);
+
+            //串行化加载
+            static Mutex& GetLoadMutex() {
+                static Mutex s_mutex;
+                return s_mutex;
+            }
+
+            static std::atomic<uint64_t>& GetVersionRef() {
+                static std::atomic<uint64_t> s_version{0};
+                return s_version;
+            }
     };
 }
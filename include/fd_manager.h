@@ -19,6 +19,13 @@ public:
      * @brief 通过文件句柄构造FdCtx
      */
     FdCtx(int fd);
+
+    /**
+     * @brief 构造已知是socket的FdCtx, 不再fstat
+     * @param[in] fd 文件句柄
+     * @param[in] nonblock fd是否已经是非阻塞(如accept4/socket带SOCK_NONBLOCK), 是则不再fcntl
+     */
+    FdCtx(int fd, bool nonblock);
     /**
      * @brief 析构函数
      */
@@ -115,6 +122,14 @@ public:
      */
     FdCtx::ptr get(int fd, bool auto_create = false);
 
+    /**
+     * @brief 登记一个新创建的socket, 覆盖该fd上旧的FdCtx
+     * @details 用于hook的socket/accept/accept4, 调用方已知fd类型, 省掉fstat和fcntl
+     * @param[in] fd 文件句柄
+     * @param[in] nonblock fd是否已经是非阻塞
+     */
+    FdCtx::ptr addSocket(int fd, bool nonblock);
+
     /**
      * @brief 删除文件句柄类
      * @param[in] fd 文件句柄
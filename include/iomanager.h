@@ -2,6 +2,8 @@
 #pragma once
 #include "scheduler.h"
 #include "timer.h"
+#include <pthread.h>
+#include <unordered_map>
 
 namespace frb{
 
@@ -32,6 +34,8 @@ private:
             Fiber::ptr fiber;
             /// 事件的回调函数
             std::function<void()> cb;   
+            /// 唤醒后执行的线程, 继承自挂起协程绑定的线程
+            int thread = -1;
         };
 
         EventContext& getContext(Event event);
@@ -102,12 +106,25 @@ public:
 
 protected:
     void tickle() override;
+
+    /**
+     * @brief 唤醒指定线程
+     * @details 共享的tickle管道只能唤醒任意一个空闲线程, 绑定线程的任务用信号直接打断目标线程的epoll_pwait。
+     *          信号平时是屏蔽的, 只在epoll_pwait期间放开, 先到的信号挂起到下次等待时生效, 不会丢
+     */
+    void tickle(int thread) override;
     bool stopping() override;
     void idle() override;
     void onTimerInsertedAtFront() override;
 
     void contextResize(size_t size);
 
+    /**
+     * @brief 取消本IOManager上周期输出限流汇总的定时器, 交给下一个启动的IOManager
+     * @details 周期定时器会让stopping()一直返回false, 开始停止时要先取消
+     */
+    void releaseLogFlush();
+
     /**
      * @brief 判断是否可以停止
      * @param[out] timeout 最近要出发的定时器事件间隔
@@ -127,6 +144,10 @@ private:
     /// pipe
     int m_tickleFds[2];
 
+    /// tickle(thread)用的线程句柄, 线程进入idle时登记, 退出idle时注销
+    RWMutexType m_wakeMutex;
+    std::unordered_map<int, pthread_t> m_wakeThreads;
+
     /// 当前等待执行的事件数量
     std::atomic<size_t> m_pendingEventCount = {0};
 
@@ -135,6 +156,11 @@ private:
      * 
     */
     std::vector<FdContext*> m_fdContexts;
+
+    /// 周期调用LogLimiter::FlushAll的定时器, 只有第一个启动的IOManager持有
+    Timer::ptr m_logFlushTimer;
+    /// 是否持有m_logFlushTimer, stopping()里先无锁地检查
+    std::atomic<bool> m_logFlush = {false};
 };
 
 
@@ -8,6 +8,7 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <functional>
 
 #include "singleton.h"
@@ -21,13 +22,33 @@
 #define GET_Manager frb::LoggerMgr::GetInstance()
 
 #define MAKE_LOG_EVENT(logger, level, massage) \
-    std::make_shared<frb::LogEvent>(logger, level, __FILE__, __LINE__, 0, frb::GetThreadId(), frb::GetFiberId(), time(0), frb::Thread::GetName())
+    frb::LogEvent::Create(logger, level, __FILE__, __LINE__)
+
+//判断该调用点的这条日志是否通过限流/采样,每个调用点各有一个静态的LogLimiter
+//rate/burst/sample为0时使用logger上配置的限流参数
+#define LOG_SITE_ALLOW(logger, level, rate, burst, sample) \
+    [&]() -> bool { \
+        static frb::LogLimiter s_log_limiter(logger, level, __FILE__, __LINE__, rate, burst, sample); \
+        return s_log_limiter.allow(logger, level); \
+    }()
 
 #define LOG_LEVEL(logger, level, massage) \
-    logger->log(level, MAKE_LOG_EVENT(logger, level, massage));
-    
-#define LOG_LEVEL_STREAM(logger, level) \ 
-    if(logger->getLevel() >= level) \
+    LOG_LEVEL_STREAM(logger, level) << massage;
+
+//logger没有配置限流/采样时只多一次整数比较
+#define LOG_LEVEL_STREAM(logger, level) \
+    if(logger->getLevel() >= level \
+            && (!logger->hasLimit() || LOG_SITE_ALLOW(logger, level, 0, 0, 0))) \
+        frb::LogEventWrap(MAKE_LOG_EVENT(logger, level, "线程名称")).getSS()
+
+//该调用点每秒最多输出rate条日志,允许突发burst条(令牌桶)
+#define LOG_LEVEL_STREAM_LIMIT(logger, level, rate, burst) \
+    if(logger->getLevel() >= level && LOG_SITE_ALLOW(logger, level, rate, burst, 0)) \
+        frb::LogEventWrap(MAKE_LOG_EVENT(logger, level, "线程名称")).getSS()
+
+//该调用点每n条日志只输出1条
+#define LOG_LEVEL_STREAM_SAMPLE(logger, level, n) \
+    if(logger->getLevel() >= level && LOG_SITE_ALLOW(logger, level, 0, 0, n)) \
         frb::LogEventWrap(MAKE_LOG_EVENT(logger, level, "线程名称")).getSS()
     
 
@@ -44,6 +65,20 @@
 #define LOG_ERROR_STREAM(logger) LOG_LEVEL_STREAM(logger, frb::LogLevel::ERROR)
 #define LOG_FATAL_STREAM(logger) LOG_LEVEL_STREAM(logger, frb::LogLevel::FATAL)
 
+//限流的流式日志, 每秒最多rate条
+#define LOG_DEBUG_STREAM_LIMIT(logger, rate) LOG_LEVEL_STREAM_LIMIT(logger, frb::LogLevel::DEBUG, rate, rate)
+#define LOG_INFO_STREAM_LIMIT(logger, rate) LOG_LEVEL_STREAM_LIMIT(logger, frb::LogLevel::INFO, rate, rate)
+#define LOG_WARN_STREAM_LIMIT(logger, rate) LOG_LEVEL_STREAM_LIMIT(logger, frb::LogLevel::WARN, rate, rate)
+#define LOG_ERROR_STREAM_LIMIT(logger, rate) LOG_LEVEL_STREAM_LIMIT(logger, frb::LogLevel::ERROR, rate, rate)
+#define LOG_FATAL_STREAM_LIMIT(logger, rate) LOG_LEVEL_STREAM_LIMIT(logger, frb::LogLevel::FATAL, rate, rate)
+
+//采样的流式日志, 每n条输出1条
+#define LOG_DEBUG_STREAM_SAMPLE(logger, n) LOG_LEVEL_STREAM_SAMPLE(logger, frb::LogLevel::DEBUG, n)
+#define LOG_INFO_STREAM_SAMPLE(logger, n) LOG_LEVEL_STREAM_SAMPLE(logger, frb::LogLevel::INFO, n)
+#define LOG_WARN_STREAM_SAMPLE(logger, n) LOG_LEVEL_STREAM_SAMPLE(logger, frb::LogLevel::WARN, n)
+#define LOG_ERROR_STREAM_SAMPLE(logger, n) LOG_LEVEL_STREAM_SAMPLE(logger, frb::LogLevel::ERROR, n)
+#define LOG_FATAL_STREAM_SAMPLE(logger, n) LOG_LEVEL_STREAM_SAMPLE(logger, frb::LogLevel::FATAL, n)
+
 
 
 
@@ -78,6 +113,16 @@ namespace frb{
             ,uint32_t thread_id, uint32_t fiber_id, uint64_t time
             ,const std::string& thread_name);    
 
+            /**
+             * @brief 为当前线程创建日志事件
+             * @details 线程ID、协程ID、线程名称都取自线程局部变量, 时间用粗粒度时钟;
+             *          事件对象从线程局部的池里复用(池中对象只有池自己引用时才能复用),
+             *          线程名称拷贝进事件(复用的事件保留字符串的容量, 不再分配内存),
+             *          事件可能比线程活得久, 或线程之后又改了名字
+             */
+            static LogEvent::ptr Create(std::shared_ptr<Logger> logger, LogLevel::Level level
+                        ,const char* file, int32_t line);
+
             /**
             * @brief 返回文件名
             */
@@ -133,6 +178,14 @@ namespace frb{
              */
             std::stringstream& getSS() { return m_ss;}
 
+        private:
+            LogEvent() = default;
+
+            /**
+             * @brief 复用池中的事件, 重新填写各字段并清空内容
+             */
+            void reset(std::shared_ptr<Logger> logger, LogLevel::Level level
+                        ,const char* file, int32_t line);
 
         private:
             const char* m_file = nullptr;           // 文件名
@@ -140,12 +193,12 @@ namespace frb{
             uint32_t m_threadId = 0;                // 线程号
             uint32_t m_fiberId = 0;                 // 协程号                                                           
             uint32_t m_elapse = 0;                  // 程序启动到现在的时间
-            time_t m_time;                          // 时间
+            time_t m_time = 0;                      // 时间
             std::string m_threadName;               // 线程名称
             std::stringstream m_ss;                 // 内容
             std::shared_ptr<Logger> m_logger;
                                
-            LogLevel::Level m_level;                // 日志等级
+            LogLevel::Level m_level = LogLevel::UNKNOW;     // 日志等级
 
     };
 
@@ -320,15 +373,32 @@ namespace frb{
             void addAppender(LogAppender::ptr appender);
             void delAppender(LogAppender::ptr appender);
 
-            void clearAppenders() {
-                MutexType::Lock lock(m_mutex);
-                m_appenders.clear();
-            }
+            void clearAppenders();
 
             LogLevel::Level getLevel() const {return m_level;};
             void setLevel(LogLevel::Level level) {m_level = level;};
 
-            std::string getName() {return m_name;};
+            const std::string& getName() const {return m_name;};
+
+            /**
+             * @brief 设置限流参数
+             * @param[in] rate 每个调用点每秒最多输出的条数, 0表示不限流
+             * @param[in] burst 允许的突发条数, 0表示等于rate
+             */
+            void setRateLimit(uint32_t rate, uint32_t burst = 0) {m_rateLimit = rate; m_rateBurst = burst;};
+            uint32_t getRateLimit() const {return m_rateLimit;};
+            uint32_t getRateBurst() const {return m_rateBurst;};
+
+            /**
+             * @brief 设置采样, 每个调用点每sample条输出1条, 0/1表示不采样
+             */
+            void setSample(uint32_t sample) {m_sample = sample;};
+            uint32_t getSample() const {return m_sample;};
+
+            /**
+             * @brief 是否配置了限流或采样
+             */
+            bool hasLimit() const {return m_rateLimit || m_sample > 1;};
 
             std::string toYamlString();
 
@@ -341,16 +411,102 @@ namespace frb{
             
             LogLevel::Level m_level;
 
+            //每个调用点每秒最多输出的条数
+            uint32_t m_rateLimit = 0;
+            //令牌桶容量
+            uint32_t m_rateBurst = 0;
+            //每m_sample条输出1条
+            uint32_t m_sample = 0;
+
             /// Spinlock
             MutexType m_mutex;
             //日志格式器,appender没有formatter，默认使用logger规定的formatter
             LogFormatter::ptr m_formatter;
-            std::list<LogAppender::ptr>  m_appenders;
+            //appender快照,写日志时无锁读取,增删appender时发布新快照
+            RCUValue<std::vector<LogAppender::ptr> > m_appenders;
             
             //主日志器
             Logger::ptr m_root;
     };
 
+    /**
+     * @brief 日志调用点的限流/采样状态
+     * @details 每个LOG_*宏展开的地方各有一个静态实例, 互不影响。
+     *          先按1/N采样, 再过令牌桶; 被丢弃的条数累加起来,
+     *          等该调用点下一次放行时(最多每秒一次)先输出一条汇总。
+     *          之后一直没有放行的, 由IOManager每秒一次的FlushAll()或进程退出时的析构输出汇总
+     */
+    class LogLimiter : Noncopyable {
+        public:
+            /**
+             * @brief 构造函数, 登记到全局列表供FlushAll()使用
+             * @param[in] logger 汇总输出到的日志器
+             * @param[in] level 汇总的日志级别
+             * @param[in] file 调用点文件名
+             * @param[in] line 调用点行号
+             * @param[in] rate 每秒允许的条数, 0表示使用logger的配置
+             * @param[in] burst 令牌桶容量, 0表示等于rate
+             * @param[in] sample 每sample条输出1条, 0表示使用logger的配置
+             */
+            LogLimiter(const Logger::ptr& logger, LogLevel::Level level
+                       ,const char* file, int32_t line
+                       ,uint32_t rate = 0, uint32_t burst = 0, uint32_t sample = 0);
+
+            /**
+             * @brief 析构函数, 输出还没汇总的丢弃条数
+             */
+            ~LogLimiter();
+
+            /**
+             * @brief 这条日志是否输出
+             * @param[in] logger 日志器
+             * @param[in] level 日志级别
+             */
+            bool allow(const Logger::ptr& logger, LogLevel::Level level);
+
+            /**
+             * @brief 输出还没汇总的丢弃条数
+             */
+            void flush();
+
+            /**
+             * @brief 所有调用点输出还没汇总的丢弃条数
+             * @details 突发之后一直没有日志的调用点不会自己汇总, 第一个启动的IOManager
+             *          每秒调用一次; 没有IOManager的程序可以自己周期调用
+             */
+            static void FlushAll();
+
+        private:
+            /**
+             * @brief 补充令牌并尝试取走一个
+             */
+            bool takeToken(uint32_t rate, uint32_t burst, uint64_t now);
+
+            /**
+             * @brief 输出一条汇总
+             */
+            void report(const Logger::ptr& logger, LogLevel::Level level, uint64_t n);
+
+        private:
+            Logger::ptr m_logger;
+            LogLevel::Level m_level;
+            const char* m_file;
+            int32_t m_line;
+            uint32_t m_rate;
+            uint32_t m_burst;
+            uint32_t m_sample;
+            //经过该调用点的条数
+            std::atomic<uint64_t> m_count{0};
+            //剩余令牌数(以千分之一个令牌为单位)
+            std::atomic<int64_t> m_tokens{0};
+            //上次补充令牌的时间(毫秒)
+            std::atomic<uint64_t> m_lastRefill{0};
+            //上次汇总之后被丢弃的条数
+            std::atomic<uint64_t> m_suppressed{0};
+            //上次输出汇总的时间(毫秒)
+            std::atomic<uint64_t> m_lastReport{0};
+    };
+
     class StdoutLogAppender : public LogAppender{
         public:
             typedef std::shared_ptr<StdoutLogAppender> ptr;
@@ -383,9 +539,104 @@ namespace frb{
 
     };
 
+    /**
+     * @brief 基于mmap的日志文件输出
+     * @details 文件按块(默认32MB)用fallocate预分配并映射, 写日志时用原子游标
+     *          预留一段空间后直接拷贝进映射区, 多线程之间不用互斥。
+     *          一块写满后msync(MS_ASYNC)再解除映射。映射是MAP_SHARED,
+     *          进程崩溃时已拷贝进映射区的日志仍在页缓存里, 不会丢在用户态缓冲中。
+     *          启动时跳过文件末尾预分配出来的0字节, 接着上次的位置追加;
+     *          析构时把文件截断到实际写入的长度。
+     *          进程内打开同一文件(按设备号和inode区分)的appender共享同一个写入游标和映射,
+     *          重新加载日志配置时新旧appender交替写入也不会互相覆盖
+     */
+    class MmapFileLogAppender : public LogAppender{
+        public:
+            typedef std::shared_ptr<MmapFileLogAppender> ptr;
+            typedef Mutex ChunkMutexType;
+
+            /**
+             * @brief 构造函数
+             * @param[in] name 文件名
+             * @param[in] chunk_size 每次预分配并映射的大小, 向上取整到页大小;
+             *            文件已被其它appender打开时沿用它的块大小
+             */
+            MmapFileLogAppender(const std::string& name, uint64_t chunk_size = 32 * 1024 * 1024);
+
+            std::string toYamlString() override;
+            void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+        private:
+            /**
+             * @brief 一块映射区
+             */
+            struct Chunk {
+                //块序号, 文件偏移为index * 块大小
+                uint64_t index = 0;
+                //映射地址, 解除映射后为nullptr
+                char* addr = nullptr;
+                //已经写完的字节数, 等于块大小时解除映射
+                std::atomic<uint64_t> committed{0};
+            };
+
+            /**
+             * @brief 一个打开的日志文件, 同一文件上的appender共享
+             */
+            class MappedFile {
+                public:
+                    typedef std::shared_ptr<MappedFile> ptr;
+
+                    /**
+                     * @brief 取得文件对应的MappedFile, 进程内已经打开时返回同一个
+                     * @return 打开失败时返回nullptr
+                     */
+                    static ptr Open(const std::string& name, uint64_t chunk_size);
+
+                    MappedFile(const std::string& name, int fd, uint64_t chunk_size);
+
+                    ~MappedFile();
+
+                    /**
+                     * @brief 预留一段空间并写入
+                     */
+                    void write(const char* p, size_t len);
+
+                private:
+                    /**
+                     * @brief 返回序号为idx的块, 不存在时预分配并映射
+                     */
+                    Chunk* getChunk(uint64_t idx);
+
+                    /**
+                     * @brief 文件末尾去掉预分配的0字节后的长度
+                     * @param[in] floor 只检查这个位置之后的内容, 返回值不小于floor
+                     */
+                    uint64_t findEnd(uint64_t floor);
+
+                private:
+                    std::string m_filename;
+                    int m_fd = -1;
+                    uint64_t m_chunkSize;
+                    //打开文件时的写入位置
+                    uint64_t m_start = 0;
+                    //下一条日志的写入位置
+                    std::atomic<uint64_t> m_cursor{0};
+                    //最近映射的块, 写日志时先无锁地看它
+                    std::atomic<Chunk*> m_cur{nullptr};
+                    //映射/查找块时加锁
+                    ChunkMutexType m_chunkMutex;
+                    //所有块, 解除映射的块也保留到析构, 防止m_cur悬空
+                    std::map<uint64_t, Chunk*> m_chunks;
+            };
+
+        private:
+            std::string m_filename;
+            MappedFile::ptr m_file;
+    };
+
     class LogManager{
         public:
-            typedef Spinlock MutexType;
+            typedef std::unordered_map<std::string, Logger::ptr> LoggerMap;
             LogManager();
 
             Logger::ptr getLogger(const std::string& name);
@@ -397,17 +648,16 @@ namespace frb{
             //将所有的日志器配置转成YAML String
             std::string toYamlString();
 
-            //由loggerManager统一管理logger输出日志的时机
-            //并发时，多个logger只能一个一个写
+            //按名称找到logger输出日志
+            //输出的串行化由各appender自己负责，这里不再加全局锁
             void log(LogEvent::ptr event, const std::string& name){
-                Logger::ptr output_logger = GET_LOG_NAME(name);
-                MutexType::Lock lock(m_mutex);
+                Logger::ptr output_logger = getLogger(name);
                 output_logger->log(event->getLevel(), event);
              }
         private:
 
-            MutexType m_mutex;
-            std::map<std::string, Logger::ptr> m_loggers;
+            //logger注册表快照,查找无锁,只有新建logger时才发布新快照
+            RCUValue<LoggerMap> m_loggers;
             Logger::ptr m_root;
 
         
@@ -23,6 +23,24 @@ class Scheduler{
         //返回当前的调度协程
         static Fiber* GetMainFiber();
 
+        /**
+         * @brief 返回当前正在执行的任务绑定的线程id, 没有绑定返回-1
+         * @details 绑定线程的协程在IO事件唤醒/YieldToReady后仍回到该线程执行
+         */
+        static int GetTaskThread();
+
+        /**
+         * @brief 返回所有线程id(use_caller时包括caller线程), start之后有效
+         */
+        const std::vector<int>& getThreadIds() const { return m_threadIds;}
+
+        /**
+         * @brief 返回一直在运行调度循环的线程id, start之后有效
+         * @details use_caller时caller线程只在stop()里才进入调度循环, 不算在内;
+         *          只有caller一个线程时返回caller线程
+         */
+        const std::vector<int>& getWorkerThreadIds() const { return m_workerIds;}
+
         /**
          * @brief 启动协程调度器
          */
@@ -58,26 +76,58 @@ class Scheduler{
                 need_tickle = scheduleNoLock(exec, thread);
             }
 
-            if(need_tickle){
-                tickle();
-            }
+            notify(need_tickle, thread);
         }
 
+        /**
+         * @brief 批量加入任务, 整批只加一次锁
+         * @param[in] thread 所有任务绑定的线程, -1为任意线程
+         */
         template<typename InputIterator>
-        void schedule(InputIterator begin, InputIterator end){
+        void schedule(InputIterator begin, InputIterator end, int thread = -1){
             bool need_tickle = false;
 
             {
                 MutexType::Lock lock(m_mutex);
                 while(begin != end){
-                    need_tickle = scheduleNoLock(*begin, -1) || need_tickle;
+                    need_tickle = scheduleNoLock(*begin, thread) || need_tickle;
                     ++begin;
                 }
+            }
+
+            notify(need_tickle, thread);
+        }
 
-                if(need_tickle){
-                    tickle();
+        /**
+         * @brief 批量加入任务, 按轮转把任务依次绑定到各个工作线程(getWorkerThreadIds)
+         * @details 整批只加一次锁, 每个分到任务的线程只唤醒一次; 调度器未start(没有线程id)时不绑定线程
+         */
+        template<typename InputIterator>
+        void scheduleRoundRobin(InputIterator begin, InputIterator end){
+            bool need_tickle = false;
+            size_t first = 0;
+            size_t count = 0;
+            {
+                MutexType::Lock lock(m_mutex);
+                first = m_nextThread;
+                while(begin != end){
+                    int thread = -1;
+                    if(!m_workerIds.empty()) {
+                        thread = m_workerIds[m_nextThread++ % m_workerIds.size()];
+                    }
+                    need_tickle = scheduleNoLock(*begin, thread) || need_tickle;
+                    ++begin;
+                    ++count;
                 }
             }
+
+            if(m_workerIds.empty()) {
+                notify(need_tickle, -1);
+                return;
+            }
+            for(size_t i = 0; i < count && i < m_workerIds.size(); ++i) {
+                notify(need_tickle, m_workerIds[(first + i) % m_workerIds.size()]);
+            }
         }
     protected:
 
@@ -86,6 +136,18 @@ class Scheduler{
         */
         virtual void tickle();
 
+        /**
+         * @brief 通知指定线程有绑定给它的任务, 默认同tickle()
+         */
+        virtual void tickle(int thread);
+
+        /**
+         * @brief 任务入队后的通知
+         * @details 绑定到其他线程的任务直接唤醒该线程, 不论队列之前是否为空, 否则它可能一直睡到idle超时;
+         *          未绑定的任务在队列由空变非空时tickle一次
+         */
+        void notify(bool need_tickle, int thread);
+
         /**
          * @brief 协程调度函数
          */
@@ -195,6 +257,10 @@ class Scheduler{
         int m_rootThread = 0;
         /// 线程id数组
         std::vector<int> m_threadIds;
+        /// 运行调度循环的线程id, 轮转分配只在这些线程之间进行
+        std::vector<int> m_workerIds;
+        /// scheduleRoundRobin下一个分配的线程下标
+        size_t m_nextThread = 0;
         /// 线程数量
         size_t m_threadCount = 0;
         /// 工作线程数量
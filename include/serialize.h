@@ -0,0 +1,425 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include "bytearray.h"
+#include "endian.h"
+
+namespace frb{
+
+/**
+ * @brief 结构体的一个成员, 由FRB_SERIALIZE生成
+ */
+template<class S, class T, T S::*Ptr>
+struct SerializeField {
+    typedef T type;
+    static const T& get(const S& s) { return s.*Ptr;}
+    static T& get(S& s) { return s.*Ptr;}
+};
+
+/**
+ * @brief 成员列表, 由FRB_SERIALIZE生成
+ */
+template<class... Fs>
+struct SerializeFieldList {
+};
+
+/**
+ * @brief 类型T的编解码
+ * @details fixed为true的类型长度固定(size字节), 额外提供pack/unpack直接读写一段连续内存,
+ *          这样结构体里连续的定长成员可以拼成一块, 只做一次边界检查和一次拷贝。
+ *          定长类型的字节序跟随ByteArray(与writeFint32等一致), 变长部分用Varint表示长度
+ */
+template<class T, class Enable = void>
+struct Serializer;
+
+/**
+ * @brief 整数/浮点/枚举
+ */
+template<class T>
+struct Serializer<T, typename std::enable_if<std::is_arithmetic<T>::value
+                                             || std::is_enum<T>::value>::type> {
+    static constexpr bool fixed = true;
+    static constexpr size_t size = sizeof(T);
+
+    static void pack(char* p, const T& v, bool swap) {
+        memcpy(p, &v, sizeof(T));
+        if(swap) {
+            std::reverse(p, p + sizeof(T));
+        }
+    }
+
+    static void unpack(const char* p, T& v, bool swap) {
+        if(swap) {
+            char tmp[sizeof(T)];
+            std::reverse_copy(p, p + sizeof(T), tmp);
+            memcpy(&v, tmp, sizeof(T));
+        } else {
+            memcpy(&v, p, sizeof(T));
+        }
+    }
+
+    static void write(ByteArray& ba, const T& v, bool swap) {
+        char buf[sizeof(T)];
+        pack(buf, v, swap);
+        ba.write(buf, sizeof(T));
+    }
+
+    static void read(ByteArray& ba, T& v, bool swap) {
+        char buf[sizeof(T)];
+        ba.read(buf, sizeof(T));
+        unpack(buf, v, swap);
+    }
+};
+
+/**
+ * @brief bool按1字节写, 非0即true
+ */
+template<>
+struct Serializer<bool> {
+    static constexpr bool fixed = true;
+    static constexpr size_t size = 1;
+
+    static void pack(char* p, const bool& v, bool) { *p = v ? 1 : 0;}
+    static void unpack(const char* p, bool& v, bool) { v = *p != 0;}
+    static void write(ByteArray& ba, const bool& v, bool) { ba.writeFuint8(v ? 1 : 0);}
+    static void read(ByteArray& ba, bool& v, bool) { v = ba.readFuint8() != 0;}
+};
+
+/**
+ * @brief std::string: Varint长度 + 内容, 和writeStringVint一致
+ */
+template<>
+struct Serializer<std::string> {
+    static constexpr bool fixed = false;
+    static constexpr size_t size = 0;
+
+    static void write(ByteArray& ba, const std::string& v, bool) {
+        ba.writeUint64(v.size());
+        ba.write(v.c_str(), v.size());
+    }
+
+    static void read(ByteArray& ba, std::string& v, bool) {
+        uint64_t len = ba.readUint64();
+        //先检查长度, 避免按坏数据里的长度分配内存
+        if(len > ba.getReadSize()) {
+            throw std::out_of_range("not enough len");
+        }
+        v.resize(len);
+        if(len) {
+            ba.read(&v[0], len);
+        }
+    }
+};
+
+/**
+ * @brief std::vector: Varint个数 + 元素, 定长元素按块打包
+ */
+template<class T>
+struct Serializer<std::vector<T> > {
+    static constexpr bool fixed = false;
+    static constexpr size_t size = 0;
+    typedef Serializer<T> Elem;
+
+    static void write(ByteArray& ba, const std::vector<T>& v, bool swap) {
+        ba.writeUint64(v.size());
+        writeElems(ba, v, swap, std::integral_constant<bool, Elem::fixed>());
+    }
+
+    static void read(ByteArray& ba, std::vector<T>& v, bool swap) {
+        uint64_t n = ba.readUint64();
+        readElems(ba, v, n, swap, std::integral_constant<bool, Elem::fixed>());
+    }
+private:
+    /// 定长元素每次打包的个数
+    static constexpr size_t s_batch = Elem::size ? (4096 + Elem::size - 1) / Elem::size : 1;
+
+    static void writeElems(ByteArray& ba, const std::vector<T>& v, bool swap, std::true_type) {
+        char buf[s_batch * Elem::size];
+        for(size_t i = 0; i < v.size(); i += s_batch) {
+            size_t n = std::min((size_t)s_batch, v.size() - i);
+            for(size_t k = 0; k < n; ++k) {
+                Elem::pack(buf + k * Elem::size, v[i + k], swap);
+            }
+            ba.write(buf, n * Elem::size);
+        }
+    }
+
+    static void writeElems(ByteArray& ba, const std::vector<T>& v, bool swap, std::false_type) {
+        for(auto& i : v) {
+            Elem::write(ba, i, swap);
+        }
+    }
+
+    static void readElems(ByteArray& ba, std::vector<T>& v, uint64_t n, bool swap, std::true_type) {
+        if(n > ba.getReadSize() / (Elem::size ? Elem::size : 1)) {
+            throw std::out_of_range("not enough len");
+        }
+        v.resize(n);
+        char buf[s_batch * Elem::size];
+        for(size_t i = 0; i < n; i += s_batch) {
+            size_t count = std::min((size_t)s_batch, (size_t)n - i);
+            ba.read(buf, count * Elem::size);
+            for(size_t k = 0; k < count; ++k) {
+                Elem::unpack(buf + k * Elem::size, v[i + k], swap);
+            }
+        }
+    }
+
+    static void readElems(ByteArray& ba, std::vector<T>& v, uint64_t n, bool swap, std::false_type) {
+        v.clear();
+        v.reserve(std::min(n, (uint64_t)ba.getReadSize()));
+        for(uint64_t i = 0; i < n; ++i) {
+            v.emplace_back();
+            Elem::read(ba, v.back(), swap);
+        }
+    }
+};
+
+/**
+ * @brief std::map: Varint个数 + (key, value)
+ */
+template<class K, class V, class C, class A>
+struct Serializer<std::map<K, V, C, A> > {
+    static constexpr bool fixed = false;
+    static constexpr size_t size = 0;
+
+    static void write(ByteArray& ba, const std::map<K, V, C, A>& v, bool swap) {
+        ba.writeUint64(v.size());
+        for(auto& i : v) {
+            Serializer<K>::write(ba, i.first, swap);
+            Serializer<V>::write(ba, i.second, swap);
+        }
+    }
+
+    static void read(ByteArray& ba, std::map<K, V, C, A>& v, bool swap) {
+        uint64_t n = ba.readUint64();
+        v.clear();
+        for(uint64_t i = 0; i < n; ++i) {
+            K key;
+            V val;
+            Serializer<K>::read(ba, key, swap);
+            Serializer<V>::read(ba, val, swap);
+            v.emplace_hint(v.end(), std::move(key), std::move(val));
+        }
+    }
+};
+
+/**
+ * @brief 成员列表开头连续的定长成员
+ * @details count/size是编译期算出的个数和总字节数, Remaining是剩下的成员列表
+ */
+template<class List>
+struct SerializeFixedRun;
+
+template<bool fixed, class F, class... Rest>
+struct SerializeFixedRunImpl;
+
+template<>
+struct SerializeFixedRun<SerializeFieldList<> > {
+    static constexpr size_t count = 0;
+    static constexpr size_t size = 0;
+    typedef SerializeFieldList<> Remaining;
+
+    template<class S>
+    static void pack(char*, const S&, bool) {}
+    template<class S>
+    static void unpack(const char*, S&, bool) {}
+};
+
+template<class F, class... Rest>
+struct SerializeFixedRun<SerializeFieldList<F, Rest...> >
+    : SerializeFixedRunImpl<Serializer<typename F::type>::fixed, F, Rest...> {
+};
+
+template<class F, class... Rest>
+struct SerializeFixedRunImpl<true, F, Rest...> {
+    typedef Serializer<typename F::type> Head;
+    typedef SerializeFixedRun<SerializeFieldList<Rest...> > Tail;
+
+    static constexpr size_t count = 1 + Tail::count;
+    static constexpr size_t size = Head::size + Tail::size;
+    typedef typename Tail::Remaining Remaining;
+
+    template<class S>
+    static void pack(char* p, const S& s, bool swap) {
+        Head::pack(p, F::get(s), swap);
+        Tail::pack(p + Head::size, s, swap);
+    }
+
+    template<class S>
+    static void unpack(const char* p, S& s, bool swap) {
+        Head::unpack(p, F::get(s), swap);
+        Tail::unpack(p + Head::size, s, swap);
+    }
+};
+
+template<class F, class... Rest>
+struct SerializeFixedRunImpl<false, F, Rest...> {
+    static constexpr size_t count = 0;
+    static constexpr size_t size = 0;
+    typedef SerializeFieldList<F, Rest...> Remaining;
+
+    template<class S>
+    static void pack(char*, const S&, bool) {}
+    template<class S>
+    static void unpack(const char*, S&, bool) {}
+};
+
+/**
+ * @brief 按成员列表编解码: 连续的定长成员一次write/read, 变长成员单独处理
+ */
+template<class List, size_t RunCount = SerializeFixedRun<List>::count>
+struct SerializeFields;
+
+template<>
+struct SerializeFields<SerializeFieldList<>, 0> {
+    template<class S>
+    static void write(ByteArray&, const S&, bool) {}
+    template<class S>
+    static void read(ByteArray&, S&, bool) {}
+};
+
+template<class F, class... Rest>
+struct SerializeFields<SerializeFieldList<F, Rest...>, 0> {
+    typedef SerializeFields<SerializeFieldList<Rest...> > Next;
+
+    template<class S>
+    static void write(ByteArray& ba, const S& s, bool swap) {
+        Serializer<typename F::type>::write(ba, F::get(s), swap);
+        Next::write(ba, s, swap);
+    }
+
+    template<class S>
+    static void read(ByteArray& ba, S& s, bool swap) {
+        Serializer<typename F::type>::read(ba, F::get(s), swap);
+        Next::read(ba, s, swap);
+    }
+};
+
+template<class List, size_t RunCount>
+struct SerializeFields {
+    typedef SerializeFixedRun<List> Run;
+    typedef SerializeFields<typename Run::Remaining> Next;
+
+    template<class S>
+    static void write(ByteArray& ba, const S& s, bool swap) {
+        char buf[Run::size];
+        Run::pack(buf, s, swap);
+        ba.write(buf, Run::size);
+        Next::write(ba, s, swap);
+    }
+
+    template<class S>
+    static void read(ByteArray& ba, S& s, bool swap) {
+        char buf[Run::size];
+        ba.read(buf, Run::size);
+        Run::unpack(buf, s, swap);
+        Next::read(ba, s, swap);
+    }
+};
+
+/**
+ * @brief 用FRB_SERIALIZE声明过的结构体, 通过ADL找到FrbSerializeFields
+ */
+template<class T>
+struct Serializer<T, typename std::enable_if<std::is_class<
+        decltype(FrbSerializeFields((const T*)nullptr))>::value>::type> {
+    typedef decltype(FrbSerializeFields((const T*)nullptr)) List;
+    typedef SerializeFixedRun<List> Run;
+
+    /// 所有成员都定长时整个结构体也是定长的, 可以并进外层结构体的定长块
+    static constexpr bool fixed = std::is_same<typename Run::Remaining, SerializeFieldList<> >::value;
+    static constexpr size_t size = Run::size;
+
+    static void pack(char* p, const T& v, bool swap) { Run::pack(p, v, swap);}
+    static void unpack(const char* p, T& v, bool swap) { Run::unpack(p, v, swap);}
+    static void write(ByteArray& ba, const T& v, bool swap) { SerializeFields<List>::write(ba, v, swap);}
+    static void read(ByteArray& ba, T& v, bool swap) { SerializeFields<List>::read(ba, v, swap);}
+};
+
+/**
+ * @brief ByteArray的字节序是否和本机不同
+ */
+inline bool SerializeNeedSwap(const ByteArray& ba) {
+    return ba.isLittleEndian() != (FRB_BYTE_ORDER == FRB_LITTLE_ENDIAN);
+}
+
+/**
+ * @brief 把v序列化写入ba
+ * @post ba.getPosition() += 序列化后的长度
+ */
+template<class T>
+void Serialize(ByteArray& ba, const T& v) {
+    Serializer<T>::write(ba, v, SerializeNeedSwap(ba));
+}
+
+/**
+ * @brief 从ba反序列化出v
+ * @exception 数据不够时抛出 std::out_of_range
+ */
+template<class T>
+void Deserialize(ByteArray& ba, T& v) {
+    Serializer<T>::read(ba, v, SerializeNeedSwap(ba));
+}
+
+}
+
+#define FRB_SERIALIZE_FIELD(S, f) ::frb::SerializeField<S, decltype(S::f), &S::f>
+
+#define FRB_SERIALIZE_NARG(...) FRB_SERIALIZE_NARG_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define FRB_SERIALIZE_NARG_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+
+#define FRB_SERIALIZE_CAT(a, b) FRB_SERIALIZE_CAT_(a, b)
+#define FRB_SERIALIZE_CAT_(a, b) a##b
+
+#define FRB_SERIALIZE_MAP_1(S, f) FRB_SERIALIZE_FIELD(S, f)
+#define FRB_SERIALIZE_MAP_2(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_1(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_3(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_2(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_4(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_3(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_5(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_4(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_6(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_5(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_7(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_6(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_8(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_7(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_9(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_8(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_10(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_9(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_11(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_10(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_12(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_11(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_13(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_12(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_14(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_13(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_15(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_14(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_16(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_15(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_17(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_16(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_18(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_17(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_19(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_18(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_20(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_19(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_21(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_20(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_22(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_21(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_23(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_22(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_24(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_23(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_25(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_24(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_26(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_25(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_27(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_26(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_28(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_27(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_29(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_28(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_30(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_29(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_31(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_30(S, __VA_ARGS__)
+#define FRB_SERIALIZE_MAP_32(S, f, ...) FRB_SERIALIZE_FIELD(S, f), FRB_SERIALIZE_MAP_31(S, __VA_ARGS__)
+
+/**
+ * @brief 声明结构体参与序列化的成员(按顺序, 最多32个, 需要是public成员)
+ * @details 写在结构体所在的命名空间里, 之后可以用frb::Serialize/frb::Deserialize,
+ *          也可以作为其它FRB_SERIALIZE结构体的成员或容器元素
+ * @code
+ *  struct Point { int32_t x; int32_t y;};
+ *  FRB_SERIALIZE(Point, x, y)
+ * @endcode
+ */
+#define FRB_SERIALIZE(S, ...) \
+    inline ::frb::SerializeFieldList<FRB_SERIALIZE_CAT(FRB_SERIALIZE_MAP_, FRB_SERIALIZE_NARG(__VA_ARGS__))(S, __VA_ARGS__)> \
+    FrbSerializeFields(const S*) { return {};}
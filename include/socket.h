@@ -46,13 +46,13 @@ public:
      * @brief 创建TCP Socket(满足地址类型)
      * @param[in] address 地址
      */
-    static Socket::ptr CreateTCP(sylar::Address::ptr address);
+    static Socket::ptr CreateTCP(Address::ptr address);
 
     /**
      * @brief 创建UDP Socket(满足地址类型)
      * @param[in] address 地址
      */
-    static Socket::ptr CreateUDP(sylar::Address::ptr address);
+    static Socket::ptr CreateUDP(Address::ptr address);
 
     /**
      * @brief 创建IPv4的TCP Socket
@@ -151,6 +151,16 @@ public:
      */
     virtual Socket::ptr accept();
 
+    /**
+     * @brief 批量接收连接
+     * @details 第一个连接按accept()等待(协程挂起到可读), 之后不再等待, 连续accept直到
+     *          队列取空(EAGAIN)或取满max个, 一次可读事件处理掉积压的一批连接
+     * @param[out] clients 新连接追加到这里
+     * @param[in] max 本次最多接收的连接数
+     * @return 本次接收的连接数, 0表示出错
+     */
+    size_t accept(std::vector<Socket::ptr>& clients, size_t max);
+
     /**
      * @brief 绑定地址
      * @param[in] addr 地址
@@ -167,6 +177,23 @@ public:
 
     virtual bool reconnect(uint64_t timeout_ms = -1);
 
+    /**
+     * @brief 开启SO_REUSEPORT, 多个socket可以bind同一地址, 由内核把新连接分给各个socket
+     * @pre 必须在bind之前调用, socket未创建时先创建
+     * @return 是否设置成功
+     */
+    bool setReusePort();
+
+    /**
+     * @brief 给本socket所在的SO_REUSEPORT组挂上按CPU分流的CBPF程序
+     * @details 新连接交给组内第(收包CPU % groups)个socket(按listen的先后排序),
+     *          工作线程绑核且与组内socket一一对应时, 连接从收包到处理都在同一个CPU上
+     * @param[in] groups 组内socket数量
+     * @pre 组内socket都已listen
+     * @return 是否挂载成功
+     */
+    bool attachReusePortCpuBpf(uint32_t groups);
+
     /**
      * @brief 监听socket
      * @param[in] backlog 未完成连接队列的最大长度
@@ -366,6 +393,12 @@ protected:
      * @brief 初始化sock
      */
     virtual bool init(int sock);
+
+    /**
+     * @brief accept一个连接
+     * @param[in] wait 没有连接时是否挂起等待, false时用未hook的accept4, 没有连接直接返回nullptr(errno=EAGAIN)
+     */
+    Socket::ptr acceptOne(bool wait);
 protected:
     /// socket句柄
     int m_sock;
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../stream.h"
+#include "../noncopyable.h"
+
+namespace frb{
+
+/**
+ * @brief 带缓冲的流, 装饰另一个Stream
+ * @details 读: 每次从下层流预读一整块到缓冲, 小字段(头部/长度等)直接从缓冲取, 不再每个字段一次系统调用;
+ *          大于缓冲的读在缓冲为空时直接交给下层流。
+ *          写: 小块写先合并到缓冲, 超过阈值/显式flush/需要从下层流读数据时用一次write(ByteArray)(socket上即writev)发出。
+ *          需要从下层流读之前先flush, 请求-响应模式下协程挂起等待对端之前请求一定已经发出。
+ *          不是线程安全的, 同一时间只能由一个协程使用
+ */
+class BufferedStream : public Stream, Noncopyable {
+public:
+    typedef std::shared_ptr<BufferedStream> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] stream 下层流
+     * @param[in] read_size 预读缓冲大小, 也是一次从下层流读的字节数
+     * @param[in] write_size 写缓冲超过该值时发出
+     */
+    BufferedStream(Stream::ptr stream, size_t read_size = 16 * 1024, size_t write_size = 16 * 1024);
+
+    /**
+     * @brief 析构函数, 发出写缓冲里剩余的数据(不关闭下层流)
+     */
+    ~BufferedStream();
+
+    /**
+     * @brief 读取数据, 缓冲里有数据时不访问下层流
+     * @return
+     *      @retval >0 返回实际读到的数据长度
+     *      @retval =0 下层流关闭
+     *      @retval <0 下层流错误
+     */
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 写入数据, 合并到写缓冲
+     * @return 成功返回写入长度, 失败返回<0
+     */
+    virtual int write(const void* buffer, size_t length) override;
+
+    /**
+     * @brief 写入ba[position, position + length), 整节点直接共享不拷贝
+     */
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 发出写缓冲, 然后关闭下层流
+     */
+    virtual void close() override;
+
+    /**
+     * @brief 查看接下来的length字节但不消费, 缓冲不够时从下层流继续读
+     * @return
+     *      @retval >0 拷贝的数据长度, 下层流关闭时可能小于length
+     *      @retval =0 下层流关闭且缓冲为空
+     *      @retval <0 下层流错误
+     */
+    int peek(void* buffer, size_t length);
+
+    /**
+     * @brief 用一次write(ByteArray)发出写缓冲里的全部数据
+     * @return 成功返回0, 失败返回<0
+     */
+    int flush();
+
+    /**
+     * @brief 预读缓冲里还没读的字节数
+     */
+    size_t getReadBuffered() const { return m_rbuf->getReadSize();}
+
+    /**
+     * @brief 写缓冲里还没发出的字节数
+     */
+    size_t getWriteBuffered() const { return m_wbuf->getSize();}
+
+    /**
+     * @brief 从下层流读之前是否先flush, 默认true
+     */
+    bool isFlushBeforeRead() const { return m_flushBeforeRead;}
+    void setFlushBeforeRead(bool v) { m_flushBeforeRead = v;}
+
+    Stream::ptr getStream() const { return m_stream;}
+private:
+    /**
+     * @brief 从下层流读一次追加到预读缓冲
+     * @return 下层流read的返回值
+     */
+    int fill();
+private:
+    Stream::ptr m_stream;
+    size_t m_readSize;
+    size_t m_writeSize;
+    bool m_flushBeforeRead = true;
+    /// 预读缓冲, [position, size)为未读数据
+    ByteArray::ptr m_rbuf;
+    /// 写缓冲, [0, size)为未发出数据
+    ByteArray::ptr m_wbuf;
+};
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifdef FRB_HAVE_LZ4
+
+#include <string>
+#include "../stream.h"
+#include "../noncopyable.h"
+
+namespace frb{
+
+/**
+ * @brief LZ4压缩/解压流, 装饰另一个Stream
+ * @details LZ4块接口要求连续内存, 数据先攒成block_size大小的块再压缩。
+ *          每块格式: [原始长度 uint32][压缩后长度 uint32][数据], 网络字节序;
+ *          原始长度最高位为1表示该块不可压缩, 数据原样存放
+ */
+class Lz4Stream : public Stream, Noncopyable {
+public:
+    typedef std::shared_ptr<Lz4Stream> ptr;
+
+    /// 单块最大长度, 解压时超过视为数据损坏
+    static const uint32_t MAX_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    /**
+     * @brief 创建压缩流
+     * @param[in] stream 下层流
+     * @param[in] acceleration LZ4_compress_fast的加速参数, 1为默认, 越大越快压缩率越低
+     * @param[in] block_size 块大小
+     */
+    static Lz4Stream::ptr CreateCompress(Stream::ptr stream, int acceleration = 1
+                                         ,size_t block_size = 64 * 1024);
+
+    /**
+     * @brief 创建解压流
+     */
+    static Lz4Stream::ptr CreateDecompress(Stream::ptr stream);
+
+    Lz4Stream(Stream::ptr stream, bool encode, int acceleration, size_t block_size);
+
+    /**
+     * @brief 析构函数, 压缩流未close时把剩余数据写出(不关闭下层流)
+     */
+    ~Lz4Stream();
+
+    /**
+     * @brief 解压数据
+     * @return >0 解压出的字节数, =0 下层流结束, <0 出错或数据损坏
+     */
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 压缩数据, 攒满一块时写到下层流
+     * @return 成功返回length, 失败返回<0
+     */
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 压缩流写出剩余数据, 然后关闭下层流
+     */
+    virtual void close() override;
+
+    /**
+     * @brief 压缩流: 把当前未满的块压缩后写到下层流
+     * @return 成功返回0
+     */
+    int flush();
+
+    bool isEncode() const { return m_encode;}
+    Stream::ptr getStream() const { return m_stream;}
+    uint64_t getTotalIn() const { return m_totalIn;}
+    uint64_t getTotalOut() const { return m_totalOut;}
+private:
+    /**
+     * @brief 从下层流读一块并解压到m_block
+     * @return >0 成功, =0 下层流结束, <0 出错
+     */
+    int readBlock();
+private:
+    Stream::ptr m_stream;
+    bool m_encode;
+    bool m_closed = false;
+    int m_acceleration;
+    size_t m_blockSize;
+    /// 压缩: 攒数据的块; 解压: 解压出的块
+    std::string m_block;
+    /// 解压: m_block里已读到的位置
+    size_t m_offset = 0;
+    /// 压缩输出/解压输入
+    std::string m_buffer;
+    uint64_t m_totalIn = 0;
+    uint64_t m_totalOut = 0;
+};
+
+}
+
+#endif
@@ -3,7 +3,7 @@
 
 #include "../stream.h"
 #include "../socket.h"
-#include "../mutex.h"
+#include "../thread.h"
 #include "../iomanager.h"
 
 namespace frb{
@@ -50,6 +50,17 @@ public:
      */
     virtual int read(ByteArray::ptr ba, size_t length) override;
 
+    /**
+     * @brief 读取当前可读的数据, 不需要事先指定长度
+     * @details ba至少准备一个空闲节点, 用全部空闲空间做一次recv, 数据追加在ba当前位置之后
+     * @param[out] ba 接收数据的ByteArray
+     * @return
+     *      @retval >0 返回实际接收到的数据长度
+     *      @retval =0 socket被远端关闭
+     *      @retval <0 socket错误
+     */
+    int readSome(ByteArray::ptr ba);
+
     /**
      * @brief 写入数据
      * @param[in] buffer 待发送数据的内存
@@ -72,6 +83,31 @@ public:
      */
     virtual int write(ByteArray::ptr ba, size_t length) override;
 
+    /**
+     * @brief 用sendfile把文件[offset, offset + length)发到socket, 数据不经过用户态
+     * @details 发送缓冲满时hook的sendfile让出协程, 等socket可写后继续
+     * @param[in] fd 文件描述符
+     * @param[in] offset 文件偏移
+     * @param[in] length 发送长度
+     * @return
+     *      @retval >=0 实际发送的长度, 文件提前结束时小于length
+     *      @retval <0 socket或文件错误
+     */
+    int64_t sendFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief 把本socket上收到的数据转发到out, 直到读完length字节或对端关闭
+     * @details out也是SocketStream时经过pipe用splice在内核里搬运, 数据不进用户态;
+     *          否则退化成读到ByteArray再写出
+     * @param[in] out 目标流
+     * @param[in] length 最多转发的字节数, 默认直到对端关闭
+     * @return
+     *      @retval >=0 实际写到out的长度; 转发过程中出错时也返回已经写出的长度,
+     *                  已从本socket读出但没写出去的数据会丢弃并记录日志
+     *      @retval <0 一个字节都没有转发就出错
+     */
+    int64_t pump(Stream::ptr out, uint64_t length = ~0ull);
+
     /**
      * @brief 关闭socket
      */
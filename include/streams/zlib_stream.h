@@ -0,0 +1,125 @@
+#pragma once
+
+#include <zlib.h>
+#include "../stream.h"
+#include "../noncopyable.h"
+
+namespace frb{
+
+/**
+ * @brief zlib压缩/解压流, 装饰另一个Stream
+ * @details 压缩模式: write进来的数据压缩后写到下层流; 解压模式: 从下层流读压缩数据, read出解压后的数据。
+ *          压缩输出直接写进ByteArray的节点, 攒够一批后用write(ByteArray)交给下层流(socket上就是writev);
+ *          解压输入同样按节点读进ByteArray, inflate直接从节点内存读。
+ *          写ByteArray/读到ByteArray时逐个iovec处理, 不拼接节点
+ */
+class ZlibStream : public Stream, Noncopyable {
+public:
+    typedef std::shared_ptr<ZlibStream> ptr;
+
+    /**
+     * @brief 数据格式
+     */
+    enum Type {
+        /// zlib头 + deflate + adler32
+        ZLIB,
+        /// 裸deflate
+        DEFLATE,
+        /// gzip头 + deflate + crc32
+        GZIP
+    };
+
+    /**
+     * @brief 创建压缩流
+     * @param[in] stream 下层流, 压缩后的数据写到这里
+     * @param[in] type 数据格式
+     * @param[in] level 压缩级别0~9, Z_DEFAULT_COMPRESSION(-1)为默认
+     * @param[in] buffer_size 输出攒够多少字节写一次下层流
+     */
+    static ZlibStream::ptr CreateCompress(Stream::ptr stream, Type type = ZLIB
+                                          ,int level = Z_DEFAULT_COMPRESSION
+                                          ,size_t buffer_size = 64 * 1024);
+
+    /**
+     * @brief 创建解压流
+     * @param[in] stream 下层流, 从这里读压缩数据
+     * @param[in] type 数据格式
+     * @param[in] buffer_size 每次从下层流读的字节数
+     */
+    static ZlibStream::ptr CreateDecompress(Stream::ptr stream, Type type = ZLIB
+                                            ,size_t buffer_size = 64 * 1024);
+
+    /**
+     * @brief 构造函数, 初始化失败时isValid()返回false
+     */
+    ZlibStream(Stream::ptr stream, bool encode, Type type, int level, size_t buffer_size);
+
+    /**
+     * @brief 析构函数, 压缩流未close时补写结尾(不关闭下层流)
+     */
+    ~ZlibStream();
+
+    /**
+     * @brief 解压数据, 至少读到1字节才返回
+     * @return
+     *      @retval >0 解压出的字节数
+     *      @retval =0 压缩数据已结束(或下层流关闭)
+     *      @retval <0 下层流错误或数据损坏
+     */
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 压缩数据, 输出攒够buffer_size时写到下层流
+     * @return 成功返回length, 失败返回<0
+     */
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    /**
+     * @brief 压缩流: 写结尾并把剩余输出写到下层流, 然后关闭下层流
+     */
+    virtual void close() override;
+
+    /**
+     * @brief 压缩流: Z_SYNC_FLUSH并把已有输出写到下层流, 对端可以立即解出已写的数据
+     * @return 成功返回0
+     */
+    int flush();
+
+    bool isValid() const { return m_valid;}
+    bool isEncode() const { return m_encode;}
+    Stream::ptr getStream() const { return m_stream;}
+
+    /**
+     * @brief 累计的输入/输出字节数(压缩流: 原始/压缩后; 解压流: 压缩/解压后)
+     */
+    uint64_t getTotalIn() const { return m_zs.total_in;}
+    uint64_t getTotalOut() const { return m_zs.total_out;}
+private:
+    /**
+     * @brief 把一段数据喂给deflate
+     */
+    int encode(const void* buffer, size_t length);
+
+    /**
+     * @brief 用flush(Z_SYNC_FLUSH/Z_FINISH)取出deflate里剩余的输出
+     */
+    int encodeFlush(int flush);
+
+    /**
+     * @brief 输出缓存攒够(或force)时写到下层流
+     */
+    int drain(bool force);
+private:
+    Stream::ptr m_stream;
+    z_stream m_zs;
+    bool m_encode;
+    bool m_valid = false;
+    bool m_finished = false;
+    size_t m_bufferSize;
+    /// 压缩: 待写到下层流的输出; 解压: 从下层流读到的输入
+    ByteArray::ptr m_buffer;
+};
+
+}
@@ -9,6 +9,7 @@
 #include "socket.h"
 #include "noncopyable.h"
 #include "config.h"
+#include "access_log.h"
 
 namespace frb{
 
@@ -20,6 +21,10 @@ struct TcpServerConf {
     int keepalive = 0;
     int timeout = 1000 * 2 * 60;
     int ssl = 0;
+    /// 每个io线程一个SO_REUSEPORT监听socket, 本线程accept并处理
+    int reuseport = 0;
+    /// reuseport时挂按CPU分流的CBPF程序
+    int reuseport_cbpf = 0;
     std::string id;
     /// 服务器类型，http, ws, rock
     std::string type = "http";
@@ -41,6 +46,8 @@ struct TcpServerConf {
             && timeout == oth.timeout
             && name == oth.name
             && ssl == oth.ssl
+            && reuseport == oth.reuseport
+            && reuseport_cbpf == oth.reuseport_cbpf
             && cert_file == oth.cert_file
             && key_file == oth.key_file
             && accept_worker == oth.accept_worker
@@ -64,6 +71,8 @@ public:
         conf.timeout = node["timeout"].as<int>(conf.timeout);
         conf.name = node["name"].as<std::string>(conf.name);
         conf.ssl = node["ssl"].as<int>(conf.ssl);
+        conf.reuseport = node["reuseport"].as<int>(conf.reuseport);
+        conf.reuseport_cbpf = node["reuseport_cbpf"].as<int>(conf.reuseport_cbpf);
         conf.cert_file = node["cert_file"].as<std::string>(conf.cert_file);
         conf.key_file = node["key_file"].as<std::string>(conf.key_file);
         conf.accept_worker = node["accept_worker"].as<std::string>();
@@ -91,6 +100,8 @@ public:
         node["keepalive"] = conf.keepalive;
         node["timeout"] = conf.timeout;
         node["ssl"] = conf.ssl;
+        node["reuseport"] = conf.reuseport;
+        node["reuseport_cbpf"] = conf.reuseport_cbpf;
         node["cert_file"] = conf.cert_file;
         node["key_file"] = conf.key_file;
         node["accept_worker"] = conf.accept_worker;
@@ -130,6 +141,7 @@ public:
 
     /**
      * @brief 绑定地址
+     * @param[in] ssl 是否SSL, 目前没有SSL的Socket实现, 为true时绑定失败
      * @return 返回是否绑定成功
      */
     virtual bool bind(frb::Address::ptr addr, bool ssl = false);
@@ -144,8 +156,6 @@ public:
                         ,std::vector<Address::ptr>& fails
                         ,bool ssl = false);
 
-    
-    bool loadCertificates(const std::string& cert_file, const std::string& key_file);
 
     /**
      * @brief 启动服务
@@ -184,16 +194,47 @@ public:
     bool isStop() const { return m_isStop;}
 
     TcpServerConf::ptr getConf() const { return m_conf;}
-    void setConf(TcpServerConf::ptr v) { m_conf = v;}
+    void setConf(TcpServerConf::ptr v);
     void setConf(const TcpServerConf& v);
 
+    /**
+     * @brief 设置分片监听模式, 需在bind之前设置
+     * @details 开启后每个io线程持有一个SO_REUSEPORT监听socket, 由内核分发连接,
+     *          accept和连接处理都在该线程上, 不再经过m_acceptWorker和跨线程转交
+     * @param[in] v 是否开启
+     * @param[in] cbpf 是否挂按CPU分流的CBPF程序(io线程需按下标绑核才有意义)
+     */
+    void setReusePort(bool v, bool cbpf = false) { m_reusePort = v; m_reusePortCbpf = cbpf;}
+    bool isReusePort() const { return m_reusePort;}
+
     virtual std::string toString(const std::string& prefix = "");
 
     std::vector<Socket::ptr> getSocks() const { return m_socks;}
+
+    /**
+     * @brief 访问日志, 默认取AccessLog::GetDefault(), 为空表示不记录
+     */
+    AccessLog::ptr getAccessLog() const { return m_accessLog;}
+    void setAccessLog(AccessLog::ptr v) { m_accessLog = v;}
 protected:
+    /**
+     * @brief 记录一次访问, 只拷贝字段, 不格式化字符串
+     * @param[in] client 客户端连接
+     * @param[in] method 方法, 非HTTP连接传"-"
+     * @param[in] path 路径
+     * @param[in] path_len 路径长度
+     * @param[in] status 状态码
+     * @param[in] bytes_in 收到的字节数
+     * @param[in] bytes_out 发送的字节数
+     * @param[in] start_us 开始处理的时间, 子类在handleClient开始时取GetCurrentUS()
+     */
+    void logAccess(Socket::ptr client, const char* method
+                   ,const char* path, size_t path_len, uint16_t status
+                   ,uint64_t bytes_in, uint64_t bytes_out, uint64_t start_us);
 
     /**
      * @brief 处理新连接的Socket类
+     * @details 子类收发完成后调用logAccess, 传入实际的收发字节数和开始时间
      */
     virtual void handleClient(Socket::ptr client);
 
@@ -204,6 +245,8 @@ protected:
 protected:
     /// 监听Socket数组
     std::vector<Socket::ptr> m_socks;
+    /// 与m_socks一一对应, 分片监听时为该socket所属的io线程id, 否则为-1
+    std::vector<int> m_sockThreads;
     /// 新连接的Socket工作的调度器
     IOManager* m_worker;
     IOManager* m_ioWorker;
@@ -219,8 +262,15 @@ protected:
     bool m_isStop;
 
     bool m_ssl = false;
+    /// 分片监听模式
+    bool m_reusePort = false;
+    /// 分片监听时挂CBPF按CPU分流
+    bool m_reusePortCbpf = false;
 
     TcpServerConf::ptr m_conf;
+
+    /// 访问日志
+    AccessLog::ptr m_accessLog;
 };
 
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <memory>
 #include <semaphore.h>
 #include <atomic>
+#include <vector>
 
 #include "./noncopyable.h"
 
@@ -390,8 +391,136 @@ namespace frb{
         volatile std::atomic_flag m_mutex;
     };
 
-    
-    
+    /**
+     * @brief 读多写少数据的RCU(read-copy-update)快照
+     * @details 当前快照挂在一个节点上, 槽位是"节点指针 + 读者登记数"打包的64位原子变量。
+     *          读者: fetch_add登记 -> 复制节点里的shared_ptr -> CAS撤销登记,
+     *          只有原子操作, 不加锁(std::atomic_load<shared_ptr>在libstdc++里是全局锁池)。
+     *          写者在锁内发布新节点, 把换下来时的登记数转成旧节点的引用计数,
+     *          最后一个撤销登记的读者(或写者)释放旧节点; 旧快照随最后一个持有者回收
+     * @attention 依赖用户态指针只用低48位(x86-64/aarch64)
+     */
+    template<class T>
+    class RCUValue : Noncopyable {
+    public:
+        /// 写者之间的互斥锁
+        typedef Mutex MutexType;
+        /// 只读快照
+        typedef std::shared_ptr<const T> ConstPtr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] v 初始快照
+         */
+        RCUValue(const T& v = T())
+            :m_word(Pack(new Node(std::make_shared<T>(v)))) {
+        }
+
+        /**
+         * @brief 析构函数, 调用方保证已经没有读者
+         */
+        ~RCUValue() {
+            delete Unpack(m_word.load(std::memory_order_relaxed));
+        }
+
+        /**
+         * @brief 返回当前快照, 不加锁
+         * @attention 快照在返回的指针释放前一直有效, 但看不到之后发布的修改
+         */
+        ConstPtr get() const {
+            uint64_t cur = m_word.fetch_add(s_reader, std::memory_order_acquire) + s_reader;
+            Node* node = Unpack(cur);
+            ConstPtr rt = node->value;
+            while(true) {
+                if(Unpack(cur) != node) {
+                    //节点已被换下, 写者把登记数转成了引用计数
+                    Release(node);
+                    break;
+                }
+                if(m_word.compare_exchange_weak(cur, cur - s_reader
+                            ,std::memory_order_release, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            return rt;
+        }
+
+        /**
+         * @brief 复制当前快照,交给cb修改,cb返回true时发布
+         * @param[in] cb bool(T&) 返回false表示没有修改,丢弃副本
+         * @return 是否发布了新快照
+         */
+        template<class Func>
+        bool update(Func cb) {
+            MutexType::Lock lock(m_mutex);
+            //写者互斥, 当前节点只会被自己换下
+            std::shared_ptr<T> v = std::make_shared<T>(*Unpack(m_word.load(std::memory_order_acquire))->value);
+            if(!cb(*v)) {
+                return false;
+            }
+            publish(ConstPtr(std::move(v)));
+            return true;
+        }
+
+        /**
+         * @brief 直接发布新快照
+         * @return 被替换下来的旧快照
+         */
+        ConstPtr set(const T& v) {
+            MutexType::Lock lock(m_mutex);
+            return publish(ConstPtr(std::make_shared<T>(v)));
+        }
+    private:
+        struct Node {
+            Node(ConstPtr v)
+                :value(std::move(v)) {
+            }
+            /// 换下之后的引用计数, 读者先撤销时会暂时为负
+            std::atomic<int64_t> refs{0};
+            ConstPtr value;
+        };
+
+        /// 读者登记数在高16位
+        static const uint64_t s_reader = 1ull << 48;
+        static const uint64_t s_ptr_mask = s_reader - 1;
+
+        static uint64_t Pack(Node* node) {
+            return (uint64_t)(uintptr_t)node;
+        }
+
+        static Node* Unpack(uint64_t word) {
+            return (Node*)(uintptr_t)(word & s_ptr_mask);
+        }
+
+        static void Release(Node* node) {
+            if(node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete node;
+            }
+        }
+
+        /**
+         * @brief 发布新节点, 调用方持有写锁
+         * @return 旧快照
+         */
+        ConstPtr publish(ConstPtr v) {
+            uint64_t old = m_word.exchange(Pack(new Node(std::move(v))), std::memory_order_acq_rel);
+            Node* node = Unpack(old);
+            ConstPtr rt = node->value;
+            int64_t readers = old >> 48;
+            //还在登记中的读者之后各撤销一次; 它们已经全部撤销时由这里释放
+            if(node->refs.fetch_add(readers, std::memory_order_acq_rel) == -readers) {
+                delete node;
+            }
+            return rt;
+        }
+    private:
+        /// 节点指针 | 读者登记数 << 48
+        mutable std::atomic<uint64_t> m_word;
+        /// 写锁
+        MutexType m_mutex;
+    };
+
+
     class Thread{
         public:
             //线程智能指针类型
@@ -7,6 +7,7 @@
 #include <sys/syscall.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <time.h>
 #include <vector>
 #include <string>
 #include <iomanip>
@@ -14,6 +15,7 @@
 namespace frb{
     /**
      * @brief 返回当前线程的ID
+     * @details 第一次调用时通过syscall获取, 之后从线程局部缓存读取
      */
     pid_t GetThreadId();
 
@@ -24,6 +26,16 @@ namespace frb{
 
     uint64_t GetCurrentMS();
 
+    /**
+     * @brief 返回当前时间(微秒)
+     */
+    uint64_t GetCurrentUS();
+
+    /**
+     * @brief 返回当前时间(秒), 使用CLOCK_REALTIME_COARSE, 精度为一个时钟节拍
+     */
+    time_t GetCoarseTime();
+
     /**
      * @brief 获取当前的调用栈
      * @param[out] bt 保存调用栈
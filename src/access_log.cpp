@@ -0,0 +1,395 @@
+#include "../include/access_log.h"
+#include "../include/config.h"
+#include "../include/log.h"
+#include "../include/utils.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+namespace frb{
+
+static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
+
+static frb::ConfigVar<std::string>::ptr g_access_log_file =
+    frb::Config::Lookup("access_log.file", std::string(""), "access log file, empty means disabled");
+
+static frb::ConfigVar<std::string>::ptr g_access_log_format =
+    frb::Config::Lookup("access_log.format", std::string("tsv"), "access log format: tsv or binary");
+
+static frb::ConfigVar<uint32_t>::ptr g_access_log_batch_size =
+    frb::Config::Lookup("access_log.batch_size", (uint32_t)4096, "access log records per batch");
+
+static frb::ConfigVar<uint32_t>::ptr g_access_log_flush_interval =
+    frb::Config::Lookup("access_log.flush_interval", (uint32_t)1000, "access log flush interval ms");
+
+//每条记录平均预留的路径长度
+static const size_t s_avg_path = 64;
+
+static std::atomic<uint64_t> s_access_log_id{0};
+
+static Mutex s_default_mutex;
+static AccessLog::ptr s_default;
+
+//配置变化后丢弃默认实例, 下次GetDefault()按新配置创建
+struct AccessLogIniter {
+    AccessLogIniter() {
+        auto reset = []() {
+            Mutex::Lock lock(s_default_mutex);
+            s_default.reset();
+        };
+        g_access_log_file->addListener([reset](const std::string&, const std::string&) { reset(); });
+        g_access_log_format->addListener([reset](const std::string&, const std::string&) { reset(); });
+        g_access_log_batch_size->addListener([reset](const uint32_t&, const uint32_t&) { reset(); });
+        g_access_log_flush_interval->addListener([reset](const uint32_t&, const uint32_t&) { reset(); });
+    }
+};
+
+static AccessLogIniter s_access_log_initer;
+
+AccessLog::Batch::Batch(uint32_t cap)
+    :capacity(cap)
+    ,times(cap)
+    ,families(cap)
+    ,ips(cap * 16)
+    ,ports(cap)
+    ,methods(cap * 8)
+    ,path_offs(cap)
+    ,path_lens(cap)
+    ,paths(std::max(cap * s_avg_path, AccessLog::s_max_path))
+    ,statuses(cap)
+    ,bytes_ins(cap)
+    ,bytes_outs(cap)
+    ,latencies(cap)
+    ,fiber_ids(cap) {
+}
+
+AccessLog::AccessLog(const std::string& file, Format format
+                     ,uint32_t batch_size, uint32_t flush_interval)
+    :m_file(file)
+    ,m_format(format)
+    ,m_batchSize(batch_size ? batch_size : 1)
+    ,m_flushInterval(flush_interval)
+    ,m_id(++s_access_log_id) {
+    m_fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        LOG_ERROR_STREAM(g_logger) << "AccessLog open file=" << file
+            << " errno=" << errno << " errstr=" << strerror(errno);
+    }
+    m_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(m_event < 0) {
+        LOG_ERROR_STREAM(g_logger) << "AccessLog eventfd errno=" << errno
+            << " errstr=" << strerror(errno);
+    }
+    m_thread.reset(new Thread(std::bind(&AccessLog::run, this), "access_log"));
+}
+
+AccessLog::~AccessLog() {
+    m_stop = true;
+    wakeup();
+    m_thread->join();
+    if(m_event >= 0) {
+        close(m_event);
+    }
+    flush();
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+AccessLog::Format AccessLog::FormatFromString(const std::string& v) {
+    if(v == "binary" || v == "BINARY") {
+        return BINARY;
+    }
+    return TSV;
+}
+
+AccessLog::ptr AccessLog::GetDefault() {
+    Mutex::Lock lock(s_default_mutex);
+    if(!s_default && !g_access_log_file->getValue().empty()) {
+        s_default.reset(new AccessLog(g_access_log_file->getValue()
+                    ,FormatFromString(g_access_log_format->getValue())
+                    ,g_access_log_batch_size->getValue()
+                    ,g_access_log_flush_interval->getValue()));
+    }
+    return s_default;
+}
+
+AccessLog::Slot* AccessLog::getSlot() {
+    static thread_local std::vector<std::pair<uint64_t, Slot::ptr> > t_slots;
+    for(auto& i : t_slots) {
+        if(i.first == m_id) {
+            return i.second.get();
+        }
+    }
+
+    //只剩本线程引用的Slot, 说明对应的AccessLog已经析构
+    for(auto it = t_slots.begin(); it != t_slots.end();) {
+        if(it->second.use_count() == 1) {
+            it = t_slots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    Slot::ptr slot(new Slot);
+    slot->active = allocBatch();
+    {
+        Mutex::Lock lock(m_mutex);
+        m_slots.push_back(slot);
+    }
+    t_slots.push_back(std::make_pair(m_id, slot));
+    return slot.get();
+}
+
+AccessLog::Batch::ptr AccessLog::allocBatch() {
+    {
+        Mutex::Lock lock(m_mutex);
+        if(!m_free.empty()) {
+            Batch::ptr b = m_free.back();
+            m_free.pop_back();
+            return b;
+        }
+    }
+    return Batch::ptr(new Batch(m_batchSize));
+}
+
+void AccessLog::submit(Batch::ptr batch) {
+    bool wake = false;
+    {
+        Mutex::Lock lock(m_mutex);
+        if(batch->size) {
+            //已经有满批次时刷新线程已被唤醒过
+            wake = m_full.empty();
+            m_full.push_back(batch);
+        } else {
+            m_free.push_back(batch);
+        }
+    }
+    if(wake) {
+        wakeup();
+    }
+}
+
+void AccessLog::wakeup() {
+    uint64_t one = 1;
+    if(m_event >= 0 && ::write(m_event, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_ERROR_STREAM_LIMIT(g_logger, 1) << "AccessLog wakeup errno=" << errno
+            << " errstr=" << strerror(errno);
+    }
+}
+
+void AccessLog::log(const sockaddr* addr, const char* method
+                    ,const char* path, size_t path_len, uint16_t status
+                    ,uint64_t bytes_in, uint64_t bytes_out
+                    ,uint64_t latency_us, uint32_t fiber_id) {
+    if(path_len > s_max_path) {
+        path_len = s_max_path;
+    }
+    Slot* slot = getSlot();
+    Batch::ptr spare;
+
+    Spinlock::Lock lock(slot->mutex);
+    if(!slot->active->hasRoom(path_len)) {
+        //分配不在自旋锁里做, 回来后刷新线程可能已经换走了满的批次
+        lock.unlock();
+        spare = allocBatch();
+        lock.lock();
+        if(!slot->active->hasRoom(path_len)) {
+            spare.swap(slot->active);
+        }
+    }
+
+    Batch& b = *slot->active;
+    uint32_t i = b.size++;
+    b.times[i] = GetCoarseTime();
+    uint8_t* ip = &b.ips[i * 16];
+    if(addr && addr->sa_family == AF_INET) {
+        const sockaddr_in* in = (const sockaddr_in*)addr;
+        b.families[i] = AF_INET;
+        memcpy(ip, &in->sin_addr, 4);
+        b.ports[i] = ntohs(in->sin_port);
+    } else if(addr && addr->sa_family == AF_INET6) {
+        const sockaddr_in6* in6 = (const sockaddr_in6*)addr;
+        b.families[i] = AF_INET6;
+        memcpy(ip, &in6->sin6_addr, 16);
+        b.ports[i] = ntohs(in6->sin6_port);
+    } else {
+        b.families[i] = 0;
+        b.ports[i] = 0;
+    }
+    strncpy(&b.methods[i * 8], method ? method : "-", 7);
+    b.methods[i * 8 + 7] = '\0';
+    b.path_offs[i] = b.path_used;
+    b.path_lens[i] = path_len;
+    memcpy(&b.paths[b.path_used], path, path_len);
+    b.path_used += path_len;
+    b.statuses[i] = status;
+    b.bytes_ins[i] = bytes_in;
+    b.bytes_outs[i] = bytes_out;
+    b.latencies[i] = latency_us;
+    b.fiber_ids[i] = fiber_id;
+    lock.unlock();
+
+    if(spare) {
+        submit(spare);
+    }
+}
+
+void AccessLog::flush() {
+    std::vector<Batch::ptr> full;
+    std::vector<Slot::ptr> slots;
+    {
+        Mutex::Lock lock(m_mutex);
+        full.swap(m_full);
+        slots = m_slots;
+    }
+    for(auto& i : full) {
+        write(i);
+    }
+
+    for(auto& s : slots) {
+        Batch::ptr b = allocBatch();
+        {
+            Spinlock::Lock lock(s->mutex);
+            if(s->active->size) {
+                b.swap(s->active);
+            }
+        }
+        if(b->size) {
+            write(b);
+        } else {
+            submit(b);
+        }
+    }
+}
+
+template<class T>
+static void AppendRaw(std::string& buf, const T& v) {
+    buf.append((const char*)&v, sizeof(v));
+}
+
+void AccessLog::write(Batch::ptr batch) {
+    Mutex::Lock lock(m_writeMutex);
+    const Batch& b = *batch;
+
+    time_t last_time = 0;
+    char time_buf[64] = {0};
+    char addr_buf[INET6_ADDRSTRLEN + 8];
+    for(uint32_t i = 0; i < b.size; ++i) {
+        const char* path = &b.paths[b.path_offs[i]];
+        uint16_t path_len = b.path_lens[i];
+        if(m_format == BINARY) {
+            //[u32 长度][u64 时间][u8 地址族][16B 地址][u16 端口][8B 方法][u16 状态码]
+            //[u64 收][u64 发][u64 耗时us][u32 协程ID][u16 路径长度][路径], 主机字节序
+            uint32_t len = 8 + 1 + 16 + 2 + 8 + 2 + 8 + 8 + 8 + 4 + 2 + path_len;
+            AppendRaw(m_buf, len);
+            AppendRaw(m_buf, b.times[i]);
+            AppendRaw(m_buf, b.families[i]);
+            m_buf.append((const char*)&b.ips[i * 16], 16);
+            AppendRaw(m_buf, b.ports[i]);
+            m_buf.append(&b.methods[i * 8], 8);
+            AppendRaw(m_buf, b.statuses[i]);
+            AppendRaw(m_buf, b.bytes_ins[i]);
+            AppendRaw(m_buf, b.bytes_outs[i]);
+            AppendRaw(m_buf, b.latencies[i]);
+            AppendRaw(m_buf, b.fiber_ids[i]);
+            AppendRaw(m_buf, path_len);
+            m_buf.append(path, path_len);
+        } else {
+            if((time_t)b.times[i] != last_time) {
+                last_time = b.times[i];
+                struct tm tm;
+                localtime_r(&last_time, &tm);
+                strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm);
+            }
+            m_buf.append(time_buf);
+            m_buf.push_back('\t');
+
+            addr_buf[0] = '-';
+            addr_buf[1] = '\0';
+            if(b.families[i]) {
+                inet_ntop(b.families[i], &b.ips[i * 16], addr_buf, INET6_ADDRSTRLEN);
+            }
+            m_buf.append(addr_buf);
+            m_buf.push_back(':');
+            m_buf.append(std::to_string(b.ports[i]));
+            m_buf.push_back('\t');
+            m_buf.append(&b.methods[i * 8]);
+            m_buf.push_back('\t');
+            m_buf.append(path, path_len);
+            m_buf.push_back('\t');
+            m_buf.append(std::to_string(b.statuses[i]));
+            m_buf.push_back('\t');
+            m_buf.append(std::to_string(b.bytes_ins[i]));
+            m_buf.push_back('\t');
+            m_buf.append(std::to_string(b.bytes_outs[i]));
+            m_buf.push_back('\t');
+            m_buf.append(std::to_string(b.latencies[i]));
+            m_buf.push_back('\t');
+            m_buf.append(std::to_string(b.fiber_ids[i]));
+            m_buf.push_back('\n');
+        }
+    }
+
+    size_t off = 0;
+    while(m_fd >= 0 && off < m_buf.size()) {
+        ssize_t rt = ::write(m_fd, m_buf.data() + off, m_buf.size() - off);
+        if(rt < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR_STREAM_LIMIT(g_logger, 1) << "AccessLog write file=" << m_file
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            break;
+        }
+        off += rt;
+    }
+    m_buf.clear();
+
+    batch->size = 0;
+    batch->path_used = 0;
+    submit(batch);
+}
+
+void AccessLog::run() {
+    uint64_t next = GetCurrentMS() + m_flushInterval;
+    while(!m_stop) {
+        //等满批次/停止的通知, 或者到下一次定时刷新
+        int timeout = -1;
+        if(m_flushInterval) {
+            uint64_t now = GetCurrentMS();
+            timeout = next > now ? next - now : 0;
+        }
+        pollfd pfd = {m_event, POLLIN, 0};
+        if(m_event < 0) {
+            //没有eventfd时退回到按刷新间隔轮询
+            usleep((m_flushInterval ? m_flushInterval : 10) * 1000);
+        } else if(poll(&pfd, 1, timeout) > 0) {
+            uint64_t n = 0;
+            while(::read(m_event, &n, sizeof(n)) < 0 && errno == EINTR);
+        }
+        if(m_stop) {
+            break;
+        }
+
+        bool has_full = false;
+        {
+            Mutex::Lock lock(m_mutex);
+            has_full = !m_full.empty();
+        }
+        uint64_t now = GetCurrentMS();
+        if(m_flushInterval && now >= next) {
+            next = now + m_flushInterval;
+            flush();
+        } else if(has_full) {
+            flush();
+        }
+    }
+}
+
+}
@@ -1,6 +1,8 @@
 
 #include "../include/address.h"
 #include "../include/endian.h"
+#include <netdb.h>
+#include <ifaddrs.h>
 #include "../include/log.h"
 
 namespace frb{
@@ -28,7 +30,7 @@ static uint32_t CountBytes(T value) {
     * @param[in] addrlen sockaddr的长度
     * @return 返回和sockaddr相匹配的Address,失败返回nullptr
     */
-static Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
+Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
     if(addr == nullptr) {
         return nullptr;
     }
@@ -126,7 +128,7 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
     * @param[in] protocol 协议,IPPROTO_TCP、IPPROTO_UDP 等
     * @return 返回满足条件的任意Address,失败返回nullptr
     */
-static Address::ptr Address::LookupAny(const std::string& host,
+Address::ptr Address::LookupAny(const std::string& host,
         int family, int type, int protocol){
     std::vector<Address::ptr> result;
     if(Lookup(result, host, family, type, protocol)) {
@@ -143,7 +145,7 @@ static Address::ptr Address::LookupAny(const std::string& host,
     * @param[in] protocol 协议,IPPROTO_TCP、IPPROTO_UDP 等
     * @return 返回满足条件的任意IPAddress,失败返回nullptr
     */
-    static std::shared_ptr<IPAddress> Address::LookupAnyIPAddress(const std::string& host,
+std::shared_ptr<IPAddress> Address::LookupAnyIPAddress(const std::string& host,
             int family, int type, int protocol) {
     std::vector<Address::ptr> result;
     if(Lookup(result, host, family, type, protocol)) {
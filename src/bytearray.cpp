@@ -1,26 +1,69 @@
 #include "../include/bytearray.h"
 #include "../include/endian.h"
 #include "../include/log.h"
+#include "../include/config.h"
 
-#include <fstream>
 #include <sstream>
 #include <string.h>
 #include <iomanip>
+#include <math.h>
+#include <stdlib.h>
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#if defined(__SSE2__) || defined(__BMI2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace frb{
 
 static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
 
+static frb::ConfigVar<uint32_t>::ptr g_bytearray_pool_nodes =
+    frb::Config::Lookup("bytearray.pool_nodes", (uint32_t)256, "free ByteArray nodes cached per thread and node size");
+
+static frb::ConfigVar<uint32_t>::ptr g_bytearray_keep_nodes =
+    frb::Config::Lookup("bytearray.keep_nodes", (uint32_t)1, "ByteArray nodes kept by clear()");
+
+//热路径上读的配置缓存一份, 由监听函数更新
+static std::atomic<uint32_t> s_pool_nodes{256};
+static std::atomic<uint32_t> s_keep_nodes{1};
+
+struct _ByteArrayIniter {
+    _ByteArrayIniter() {
+        s_pool_nodes = g_bytearray_pool_nodes->getValue();
+        s_keep_nodes = g_bytearray_keep_nodes->getValue();
+        g_bytearray_pool_nodes->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            s_pool_nodes = new_value;
+        });
+        g_bytearray_keep_nodes->addListener([](const uint32_t& old_value, const uint32_t& new_value){
+            s_keep_nodes = new_value;
+        });
+    }
+};
+
+static _ByteArrayIniter s_bytearray_initer;
+
 ByteArray::Node::Node(size_t s)
     :ptr(new char[s])
     ,next(nullptr)
-    ,size(s) {
+    ,size(s)
+    ,ref(1) {
 }
 
 ByteArray::Node::Node()
     :ptr(nullptr)
     ,next(nullptr)
-    ,size(0) {
+    ,size(0)
+    ,ref(1) {
 }
 
 ByteArray::Node::~Node() {
@@ -29,22 +72,153 @@ ByteArray::Node::~Node() {
     }
 }
 
+//线程局部节点池析构后置true, 之后(静态对象析构时)归还的节点直接释放
+static thread_local bool t_node_pool_destroyed = false;
+
+/**
+ * @brief 线程局部的空闲节点池, 按节点大小分开, 用Node::next串成链表
+ */
+class ByteArrayNodePool {
+public:
+    struct FreeList {
+        size_t size;
+        size_t count;
+        ByteArray::Node* head;
+    };
+
+    ~ByteArrayNodePool() {
+        for(auto& i : m_lists) {
+            while(i.head) {
+                ByteArray::Node* node = i.head;
+                i.head = node->next;
+                free(node);
+            }
+        }
+        t_node_pool_destroyed = true;
+    }
+
+    static ByteArrayNodePool* GetThis() {
+        if(t_node_pool_destroyed) {
+            return nullptr;
+        }
+        static thread_local ByteArrayNodePool s_pool;
+        return &s_pool;
+    }
+
+    ByteArray::Node* pop(size_t size) {
+        FreeList* list = find(size);
+        if(!list || !list->head) {
+            return nullptr;
+        }
+        ByteArray::Node* node = list->head;
+        list->head = node->next;
+        --list->count;
+        return node;
+    }
+
+    bool push(ByteArray::Node* node) {
+        FreeList* list = find(node->size);
+        if(!list) {
+            m_lists.push_back(FreeList{node->size, 0, nullptr});
+            list = &m_lists.back();
+        }
+        if(list->count >= s_pool_nodes.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        node->next = list->head;
+        list->head = node;
+        ++list->count;
+        return true;
+    }
+private:
+    FreeList* find(size_t size) {
+        //一般只有一两种节点大小, 线性查找就够了
+        for(auto& i : m_lists) {
+            if(i.size == size) {
+                return &i;
+            }
+        }
+        return nullptr;
+    }
+private:
+    std::vector<FreeList> m_lists;
+};
+
+ByteArray::Node* ByteArray::Node::Create(size_t s) {
+    ByteArrayNodePool* pool = ByteArrayNodePool::GetThis();
+    Node* node = pool ? pool->pop(s) : nullptr;
+    if(!node) {
+        void* mem = malloc(sizeof(Node) + s);
+        if(!mem) {
+            throw std::bad_alloc();
+        }
+        node = new(mem) Node();
+        node->ptr = (char*)mem + sizeof(Node);
+        node->size = s;
+    }
+    node->next = nullptr;
+    node->ref.store(1, std::memory_order_relaxed);
+    return node;
+}
+
+void ByteArray::Node::Release(Node* node) {
+    if(node->ref.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if(node->mapping) {
+        //mmap节点的内存属于映射, 只释放节点头
+        node->ptr = nullptr;
+        delete node;
+        return;
+    }
+    ByteArrayNodePool* pool = ByteArrayNodePool::GetThis();
+    if(!pool || !pool->push(node)) {
+        //内存块和节点头一起分配, 不走~Node()
+        free(node);
+    }
+}
+
+/**
+ * @brief mmapFile映射的文件
+ */
+struct MappedFile {
+    typedef std::shared_ptr<MappedFile> ptr;
+
+    ~MappedFile() {
+        if(addr != MAP_FAILED) {
+            munmap(addr, len);
+        }
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+
+    int fd = -1;
+    void* addr = MAP_FAILED;
+    size_t len = 0;
+};
+
+/**
+ * @brief 节点是否不能原地改写: 被Slice/其它ByteArray引用, 或者是只读映射
+ */
+static inline bool IsShared(const ByteArray::Node* node) {
+    return node->ref.load(std::memory_order_acquire) > 1 || node->mapping;
+}
+
 ByteArray::ByteArray(size_t base_size)
     :m_baseSize(base_size)
     ,m_position(0)
     ,m_capacity(base_size)
     ,m_size(0)
     ,m_endian(FRB_BIG_ENDIAN)
-    ,m_root(new Node(base_size))
-    ,m_cur(m_root) {
+    ,m_keepNodes(std::max(s_keep_nodes.load(std::memory_order_relaxed), (uint32_t)1))
+    ,m_cur(Node::Create(base_size)) {
+    m_nodes.push_back(m_cur);
 }
 
 ByteArray::~ByteArray() {
-    Node* tmp = m_root;
-    while(tmp) {
-        m_cur = tmp;
-        tmp = tmp->next;
-        delete m_cur;
+    for(auto& i : m_nodes) {
+        Node::Release(i);
     }
 }
 
@@ -112,19 +286,12 @@ void ByteArray::writeFuint64(uint64_t value) {
 }
 
 static uint32_t EncodeZigzag32(const int32_t& v) {
-    if(v < 0) {
-        return ((uint32_t)(-v)) * 2 - 1;
-    } else {
-        return v * 2;
-    }
+    //移位写法, 避免INT32_MIN取负溢出
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
 }
 
 static uint64_t EncodeZigzag64(const int64_t& v) {
-    if(v < 0) {
-        return ((uint64_t)(-v)) * 2 - 1;
-    } else {
-        return v * 2;
-    }
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
 }
 
 static int32_t DecodeZigzag32(const uint32_t& v) {
@@ -135,20 +302,80 @@ static int64_t DecodeZigzag64(const uint64_t& v) {
     return (v >> 1) ^ -(v & 1);
 }
 
+/**
+ * @brief 把value编码成varint写到p, p至少要有10字节
+ * @return 写入的字节数
+ */
+static inline size_t EncodeVarint(uint64_t value, uint8_t* p) {
+    size_t i = 0;
+    while(value >= 0x80) {
+        p[i++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    p[i++] = value;
+    return i;
+}
+
+/**
+ * @brief 把8个varint字节(小端排列, 已去掉结束字节之后的内容)压成7位一组的整数
+ */
+static inline uint64_t CompactVarint(uint64_t w) {
+#ifdef __BMI2__
+    return _pext_u64(w, 0x7f7f7f7f7f7f7f7full);
+#else
+    w &= 0x7f7f7f7f7f7f7f7full;
+    w = (w & 0x007f007f007f007full) | ((w & 0x7f007f007f007f00ull) >> 1);
+    w = (w & 0x00003fff00003fffull) | ((w & 0x3fff00003fff0000ull) >> 2);
+    return (w & 0x000000000fffffffull) | ((w & 0x0fffffff00000000ull) >> 4);
+#endif
+}
+
+/**
+ * @brief 从连续内存p解码varint, 最多读max_bytes字节(和逐字节读的语义一致)
+ * @param[in] avail p开始可读的字节数
+ * @return 消耗的字节数, 可读字节不够解出一个完整的varint时返回0
+ */
+static inline size_t DecodeVarint(const uint8_t* p, size_t avail, size_t max_bytes, uint64_t& value) {
+    if(avail >= 8) {
+        //一次取8字节, 用最高位找结束字节, 不用逐字节分支
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+#if FRB_BYTE_ORDER == FRB_BIG_ENDIAN
+        w = byteswap(w);
+#endif
+        uint64_t stop = ~w & 0x8080808080808080ull;
+        if(stop) {
+            size_t n = (__builtin_ctzll(stop) + 1) >> 3;
+            if(n <= max_bytes) {
+                if(n < 8) {
+                    w &= (1ull << (n * 8)) - 1;
+                }
+                value = CompactVarint(w);
+                return n;
+            }
+        }
+    }
+
+    uint64_t result = 0;
+    size_t n = avail < max_bytes ? avail : max_bytes;
+    for(size_t i = 0; i < n; ++i) {
+        uint8_t b = p[i];
+        result |= ((uint64_t)(b & 0x7f)) << (i * 7);
+        if(b < 0x80 || i + 1 == max_bytes) {
+            value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
 //
 void ByteArray::writeInt32  (int32_t value) {
     writeUint32(EncodeZigzag32(value));
 }
 
 void ByteArray::writeUint32 (uint32_t value) {
-    uint8_t tmp[5];
-    uint8_t i = 0;
-    while(value >= 0x80) {
-        tmp[i++] = (value & 0x7F) | 0x80;
-        value >>= 7;
-    }
-    tmp[i++] = value;
-    write(tmp, i);
+    writeVarint(value);
 }
 
 void ByteArray::writeInt64  (int64_t value) {
@@ -156,14 +383,27 @@ void ByteArray::writeInt64  (int64_t value) {
 }
 
 void ByteArray::writeUint64 (uint64_t value) {
-    uint8_t tmp[10];
-    uint8_t i = 0;
-    while(value >= 0x80) {
-        tmp[i++] = (value & 0x7F) | 0x80;
-        value >>= 7;
+    writeVarint(value);
+}
+
+void ByteArray::writeVarint(uint64_t value) {
+    if(m_shared) {
+        unshare(10);
     }
-    tmp[i++] = value;
-    write(tmp, i);
+    size_t npos = m_position % m_baseSize;
+    if(m_cur && m_cur->size - npos >= 10) {
+        //当前节点放得下最长的varint, 直接编码进去
+        m_position += EncodeVarint(value, (uint8_t*)m_cur->ptr + npos);
+        if(m_position % m_baseSize == 0) {
+            m_cur = nodeAt(m_position);
+        }
+        if(m_position > m_size) {
+            m_size = m_position;
+        }
+        return;
+    }
+    uint8_t tmp[10];
+    write(tmp, EncodeVarint(value, tmp));
 }
 
 void ByteArray::writeFloat  (float value) {
@@ -254,17 +494,7 @@ int32_t  ByteArray::readInt32() {
 }
 
 uint32_t ByteArray::readUint32() {
-    uint32_t result = 0;
-    for(int i = 0; i < 32; i += 7) {
-        uint8_t b = readFuint8();
-        if(b < 0x80) {
-            result |= ((uint32_t)b) << i;
-            break;
-        } else {
-            result |= (((uint32_t)(b & 0x7f)) << i);
-        }
-    }
-    return result;
+    return readVarint(5);
 }
 
 int64_t  ByteArray::readInt64() {
@@ -272,19 +502,387 @@ int64_t  ByteArray::readInt64() {
 }
 
 uint64_t ByteArray::readUint64() {
+    return readVarint(10);
+}
+
+uint64_t ByteArray::readVarint(size_t max_bytes) {
     uint64_t result = 0;
-    for(int i = 0; i < 64; i += 7) {
+    size_t read_size = getReadSize();
+    if(read_size) {
+        size_t npos = m_position % m_baseSize;
+        size_t avail = m_cur->size - npos;
+        if(avail > read_size) {
+            avail = read_size;
+        }
+        size_t n = DecodeVarint((const uint8_t*)m_cur->ptr + npos, avail, max_bytes, result);
+        if(n) {
+            m_position += n;
+            if(m_position % m_baseSize == 0) {
+                m_cur = nodeAt(m_position);
+            }
+            return result;
+        }
+    }
+
+    //跨节点(或数据不完整)时逐字节读, 不够时由read抛出std::out_of_range
+    for(size_t i = 0; i < max_bytes; ++i) {
         uint8_t b = readFuint8();
+        result |= ((uint64_t)(b & 0x7f)) << (i * 7);
         if(b < 0x80) {
-            result |= ((uint64_t)b) << i;
             break;
-        } else {
-            result |= (((uint64_t)(b & 0x7f)) << i);
         }
     }
     return result;
 }
 
+/**
+ * @brief 按width(2/4/8)字节交换字节序, 从src拷贝size字节到dst
+ * @details 每次处理32/16字节, 剩下不足一个向量的部分逐个元素交换
+ */
+static void SwapCopy(char* dst, const char* src, size_t size, size_t width) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    //字节交换的shuffle掩码, 下标依次是width 2/4/8
+    static const uint8_t s_masks[3][16] = {
+        {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+        {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+        {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8}
+    };
+    const uint8_t* mask = s_masks[width == 2 ? 0 : (width == 4 ? 1 : 2)];
+    __m128i m = _mm_loadu_si128((const __m128i*)mask);
+#if defined(__AVX2__)
+    __m256i m2 = _mm256_broadcastsi128_si256(m);
+    for(; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, m2));
+    }
+#endif
+    for(; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, m));
+    }
+#elif defined(__SSE2__)
+    //没有pshufb时先交换16位字的顺序, 再交换每个字里的两个字节
+    for(; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if(width == 4) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        } else if(width == 8) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        }
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+#elif defined(__ARM_NEON)
+    for(; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(src + i));
+        if(width == 2) {
+            v = vrev16q_u8(v);
+        } else if(width == 4) {
+            v = vrev32q_u8(v);
+        } else {
+            v = vrev64q_u8(v);
+        }
+        vst1q_u8((uint8_t*)(dst + i), v);
+    }
+#endif
+    for(; i < size; i += width) {
+        if(width == 2) {
+            uint16_t v;
+            memcpy(&v, src + i, 2);
+            v = byteswap(v);
+            memcpy(dst + i, &v, 2);
+        } else if(width == 4) {
+            uint32_t v;
+            memcpy(&v, src + i, 4);
+            v = byteswap(v);
+            memcpy(dst + i, &v, 4);
+        } else {
+            uint64_t v;
+            memcpy(&v, src + i, 8);
+            v = byteswap(v);
+            memcpy(dst + i, &v, 8);
+        }
+    }
+}
+
+/**
+ * @brief 在[p, p + len)里找字节c, 每次比较32(AVX2)/16(SSE2)字节
+ */
+static const char* FindByte(const char* p, size_t len, char c) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i v32 = _mm256_set1_epi8(c);
+    for(; i + 32 <= len; i += 32) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(p + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(d, v32));
+        if(mask) {
+            return p + i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i v16 = _mm_set1_epi8(c);
+    for(; i + 16 <= len; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(p + i));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(d, v16));
+        if(mask) {
+            return p + i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    return i < len ? (const char*)memchr(p + i, c, len - i) : nullptr;
+}
+
+/**
+ * @brief 在[p, p + len)里找长度为k(k >= 2)的pat
+ * @details 同时比较候选起点上的首字节和第k-1个字节, 两者都相等的位置再memcmp确认
+ */
+static const char* FindPattern(const char* p, size_t len, const char* pat, size_t k) {
+    if(len < k) {
+        return nullptr;
+    }
+    //最后一个可能的起点之后
+    size_t end = len - k + 1;
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i first32 = _mm256_set1_epi8(pat[0]);
+    __m256i last32 = _mm256_set1_epi8(pat[k - 1]);
+    for(; i + 32 <= end; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + k - 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_cmpeq_epi8(a, first32), _mm256_cmpeq_epi8(b, last32)));
+        while(mask) {
+            size_t off = i + __builtin_ctz(mask);
+            if(memcmp(p + off + 1, pat + 1, k - 2) == 0) {
+                return p + off;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i first16 = _mm_set1_epi8(pat[0]);
+    __m128i last16 = _mm_set1_epi8(pat[k - 1]);
+    for(; i + 16 <= end; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + k - 1));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_cmpeq_epi8(a, first16), _mm_cmpeq_epi8(b, last16)));
+        while(mask) {
+            size_t off = i + __builtin_ctz(mask);
+            if(memcmp(p + off + 1, pat + 1, k - 2) == 0) {
+                return p + off;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while(i < end) {
+        const char* f = (const char*)memchr(p + i, pat[0], end - i);
+        if(!f) {
+            return nullptr;
+        }
+        if(memcmp(f + 1, pat + 1, k - 1) == 0) {
+            return f;
+        }
+        i = f - p + 1;
+    }
+    return nullptr;
+}
+
+void ByteArray::writeFixedArray(const void* buf, size_t size, size_t width) {
+    if(m_endian == FRB_BYTE_ORDER) {
+        write(buf, size);
+        return;
+    }
+    if(size == 0) {
+        return;
+    }
+    if(m_shared) {
+        unshare(size);
+    }
+    addCapacity(size);
+
+    const char* src = (const char*)buf;
+    while(size > 0) {
+        size_t npos = m_position % m_baseSize;
+        size_t ncap = m_cur->size - npos;
+        //只交换完整落在当前节点里的元素
+        size_t len = (ncap < size ? ncap : size) / width * width;
+        if(len == 0) {
+            //跨节点的那个元素单独交换后走write
+            char tmp[8];
+            SwapCopy(tmp, src, width, width);
+            write(tmp, width);
+            src += width;
+            size -= width;
+            continue;
+        }
+        SwapCopy(m_cur->ptr + npos, src, len, width);
+        m_position += len;
+        src += len;
+        size -= len;
+        if(m_position % m_baseSize == 0) {
+            m_cur = nodeAt(m_position);
+        }
+    }
+
+    if(m_position > m_size) {
+        m_size = m_position;
+    }
+}
+
+void ByteArray::readFixedArray(void* buf, size_t size, size_t width) {
+    if(m_endian == FRB_BYTE_ORDER) {
+        read(buf, size);
+        return;
+    }
+    if(size > getReadSize()) {
+        throw std::out_of_range("not enough len");
+    }
+
+    char* dst = (char*)buf;
+    while(size > 0) {
+        size_t npos = m_position % m_baseSize;
+        size_t ncap = m_cur->size - npos;
+        size_t len = (ncap < size ? ncap : size) / width * width;
+        if(len == 0) {
+            char tmp[8];
+            read(tmp, width);
+            SwapCopy(dst, tmp, width, width);
+            dst += width;
+            size -= width;
+            continue;
+        }
+        SwapCopy(dst, m_cur->ptr + npos, len, width);
+        m_position += len;
+        dst += len;
+        size -= len;
+        if(m_position % m_baseSize == 0) {
+            m_cur = nodeAt(m_position);
+        }
+    }
+}
+
+#define XX(type, name) \
+    void ByteArray::write##name##Array(const type* values, size_t n) { \
+        writeFixedArray(values, n * sizeof(type), sizeof(type)); \
+    } \
+    void ByteArray::read##name##Array(type* values, size_t n) { \
+        readFixedArray(values, n * sizeof(type), sizeof(type)); \
+    }
+
+XX(int16_t, Fint16);
+XX(uint16_t, Fuint16);
+XX(int32_t, Fint32);
+XX(uint32_t, Fuint32);
+XX(int64_t, Fint64);
+XX(uint64_t, Fuint64);
+XX(float, Float);
+XX(double, Double);
+
+#undef XX
+
+template<class T, class F>
+void ByteArray::writeVarintArray(const T* values, size_t n, F encode) {
+    if(m_shared) {
+        unshare(n * 10);
+    }
+    size_t i = 0;
+    while(i < n) {
+        size_t npos = m_position % m_baseSize;
+        size_t ncap = m_cur ? m_cur->size - npos : 0;
+        if(ncap < 10) {
+            writeVarint(encode(values[i++]));
+            continue;
+        }
+        //剩余空间按最长10字节算, 能放下的个数不用再逐个检查
+        size_t count = ncap / 10;
+        if(count > n - i) {
+            count = n - i;
+        }
+        uint8_t* p = (uint8_t*)m_cur->ptr + npos;
+        size_t len = 0;
+        for(size_t end = i + count; i < end; ++i) {
+            len += EncodeVarint(encode(values[i]), p + len);
+        }
+        m_position += len;
+        if(m_position % m_baseSize == 0) {
+            m_cur = nodeAt(m_position);
+        }
+        if(m_position > m_size) {
+            m_size = m_position;
+        }
+    }
+}
+
+template<class T, class F>
+void ByteArray::readVarintArray(T* values, size_t n, size_t max_bytes, F decode) {
+    size_t i = 0;
+    while(i < n) {
+        size_t read_size = getReadSize();
+        size_t len = 0;
+        if(read_size) {
+            size_t npos = m_position % m_baseSize;
+            size_t avail = m_cur->size - npos;
+            if(avail > read_size) {
+                avail = read_size;
+            }
+            const uint8_t* p = (const uint8_t*)m_cur->ptr + npos;
+            uint64_t v;
+            size_t rt;
+            while(i < n && (rt = DecodeVarint(p + len, avail - len, max_bytes, v))) {
+                values[i++] = decode(v);
+                len += rt;
+            }
+            m_position += len;
+            if(len && m_position % m_baseSize == 0) {
+                m_cur = nodeAt(m_position);
+            }
+        }
+        if(i < n && len == 0) {
+            //节点开头就解不出来: 跨节点或者数据不够
+            values[i++] = decode(readVarint(max_bytes));
+        }
+    }
+}
+
+void ByteArray::writeInt32Array (const int32_t* values, size_t n) {
+    writeVarintArray(values, n, [](int32_t v) { return EncodeZigzag32(v); });
+}
+
+void ByteArray::writeUint32Array(const uint32_t* values, size_t n) {
+    writeVarintArray(values, n, [](uint32_t v) { return v; });
+}
+
+void ByteArray::writeInt64Array (const int64_t* values, size_t n) {
+    writeVarintArray(values, n, [](int64_t v) { return EncodeZigzag64(v); });
+}
+
+void ByteArray::writeUint64Array(const uint64_t* values, size_t n) {
+    writeVarintArray(values, n, [](uint64_t v) { return v; });
+}
+
+void ByteArray::readInt32Array (int32_t* values, size_t n) {
+    readVarintArray(values, n, 5, [](uint64_t v) { return DecodeZigzag32((uint32_t)v); });
+}
+
+void ByteArray::readUint32Array(uint32_t* values, size_t n) {
+    readVarintArray(values, n, 5, [](uint64_t v) { return (uint32_t)v; });
+}
+
+void ByteArray::readInt64Array (int64_t* values, size_t n) {
+    readVarintArray(values, n, 10, [](uint64_t v) { return DecodeZigzag64(v); });
+}
+
+void ByteArray::readUint64Array(uint64_t* values, size_t n) {
+    readVarintArray(values, n, 10, [](uint64_t v) { return v; });
+}
+
 float    ByteArray::readFloat() {
     uint32_t v = readFuint32();
     float value;
@@ -333,21 +931,197 @@ std::string ByteArray::readStringVint() {
 
 void ByteArray::clear() {
     m_position = m_size = 0;
-    m_capacity = m_baseSize;
-    Node* tmp = m_root->next;
-    while(tmp) {
-        m_cur = tmp;
-        tmp = tmp->next;
-        delete m_cur;
+    size_t keep = std::min(m_keepNodes, m_nodes.size());
+    for(size_t i = keep; i < m_nodes.size(); ++i) {
+        Node::Release(m_nodes[i]);
+    }
+    m_nodes.resize(keep);
+    if(m_shared) {
+        //保留下来的节点还会被重写, 不能和Slice共用
+        for(auto& i : m_nodes) {
+            if(IsShared(i)) {
+                Node::Release(i);
+                i = Node::Create(m_baseSize);
+            }
+        }
+        m_shared = false;
+    }
+    m_mapped.reset();
+    m_capacity = keep * m_baseSize;
+    m_cur = m_nodes[0];
+}
+
+void ByteArray::unshare(size_t size) {
+    if(m_mapped) {
+        throw std::logic_error("ByteArray is read only");
+    }
+    size_t end = std::min(m_position + size, m_capacity);
+    for(size_t i = m_position / m_baseSize; i * m_baseSize < end; ++i) {
+        Node* node = m_nodes[i];
+        if(!IsShared(node)) {
+            continue;
+        }
+        Node* copy = Node::Create(m_baseSize);
+        memcpy(copy->ptr, node->ptr, m_baseSize);
+        m_nodes[i] = copy;
+        if(m_cur == node) {
+            m_cur = copy;
+        }
+        Node::Release(node);
+    }
+}
+
+ByteArray::Slice::ptr ByteArray::slice(size_t position, size_t len) const {
+    if(position > m_size || len > m_size - position) {
+        throw std::out_of_range("slice out of range");
+    }
+    Slice::ptr rt(new Slice);
+    while(len > 0) {
+        size_t npos = position % m_baseSize;
+        size_t n = std::min(len, m_baseSize - npos);
+        rt->addSpan(nodeAt(position), npos, n);
+        position += n;
+        len -= n;
+    }
+    if(!rt->m_spans.empty()) {
+        m_shared = true;
+    }
+    return rt;
+}
+
+void ByteArray::writeSlice(const Slice& slice) {
+    if(m_mapped) {
+        throw std::logic_error("ByteArray is read only");
+    }
+    for(auto& i : slice.m_spans) {
+        if(i.off != 0 || i.len != m_baseSize || i.node->size != m_baseSize
+                || m_position % m_baseSize != 0) {
+            write(i.node->ptr + i.off, i.len);
+            continue;
+        }
+        //整个节点直接共享, 替换掉当前位置上的节点
+        size_t idx = m_position / m_baseSize;
+        i.node->ref.fetch_add(1, std::memory_order_relaxed);
+        if(idx < m_nodes.size()) {
+            Node::Release(m_nodes[idx]);
+            m_nodes[idx] = i.node;
+        } else {
+            m_nodes.push_back(i.node);
+            m_capacity += m_baseSize;
+        }
+        m_shared = true;
+        m_position += m_baseSize;
+        if(m_position > m_size) {
+            m_size = m_position;
+        }
+        m_cur = nodeAt(m_position);
+    }
+}
+
+ByteArray::Slice::~Slice() {
+    for(auto& i : m_spans) {
+        Node::Release(i.node);
+    }
+}
+
+void ByteArray::Slice::addSpan(Node* node, size_t off, size_t len) {
+    if(len == 0) {
+        return;
+    }
+    node->ref.fetch_add(1, std::memory_order_relaxed);
+    m_spans.push_back(Span{node, off, len, m_size});
+    m_size += len;
+}
+
+size_t ByteArray::Slice::findSpan(size_t position) const {
+    auto it = std::upper_bound(m_spans.begin(), m_spans.end(), position
+                ,[](size_t pos, const Span& span) { return pos < span.start; });
+    return it - m_spans.begin() - 1;
+}
+
+void ByteArray::Slice::read(void* buf, size_t size, size_t position) const {
+    if(position > m_size || size > m_size - position) {
+        throw std::out_of_range("not enough len");
+    }
+    if(size == 0) {
+        return;
+    }
+    char* dst = (char*)buf;
+    for(size_t i = findSpan(position); size > 0; ++i) {
+        const Span& span = m_spans[i];
+        size_t off = position - span.start;
+        size_t n = std::min(size, span.len - off);
+        memcpy(dst, span.node->ptr + span.off + off, n);
+        dst += n;
+        position += n;
+        size -= n;
+    }
+}
+
+std::string ByteArray::Slice::toString() const {
+    std::string str;
+    str.resize(m_size);
+    if(!str.empty()) {
+        read(&str[0], str.size());
+    }
+    return str;
+}
+
+uint64_t ByteArray::Slice::getReadBuffers(std::vector<iovec>& buffers, uint64_t len, uint64_t position) const {
+    if(position >= m_size) {
+        return 0;
+    }
+    len = std::min(len, (uint64_t)(m_size - position));
+    uint64_t size = len;
+    struct iovec iov;
+    for(size_t i = findSpan(position); len > 0; ++i) {
+        const Span& span = m_spans[i];
+        size_t off = position - span.start;
+        size_t n = std::min(len, (uint64_t)(span.len - off));
+        iov.iov_base = span.node->ptr + span.off + off;
+        iov.iov_len = n;
+        buffers.push_back(iov);
+        position += n;
+        len -= n;
+    }
+    return size;
+}
+
+ByteArray::Slice::ptr ByteArray::Slice::slice(size_t position, size_t len) const {
+    if(position > m_size || len > m_size - position) {
+        throw std::out_of_range("slice out of range");
+    }
+    Slice::ptr rt(new Slice);
+    if(len == 0) {
+        return rt;
+    }
+    for(size_t i = findSpan(position); len > 0; ++i) {
+        const Span& span = m_spans[i];
+        size_t off = position - span.start;
+        size_t n = std::min(len, span.len - off);
+        rt->addSpan(span.node, span.off + off, n);
+        position += n;
+        len -= n;
+    }
+    return rt;
+}
+
+void ByteArray::Slice::append(const Slice& other) {
+    //other可能就是自己, 先记下原来的片段数
+    size_t count = other.m_spans.size();
+    for(size_t i = 0; i < count; ++i) {
+        const Span& span = other.m_spans[i];
+        addSpan(span.node, span.off, span.len);
     }
-    m_cur = m_root;
-    m_root->next = NULL;
 }
 
 void ByteArray::write(const void* buf, size_t size) {
     if(size == 0) {
         return;
     }
+    if(m_shared) {
+        unshare(size);
+    }
     addCapacity(size);
 
     size_t npos = m_position % m_baseSize;
@@ -357,10 +1131,10 @@ void ByteArray::write(const void* buf, size_t size) {
     while(size > 0) {
         if(ncap >= size) {
             memcpy(m_cur->ptr + npos, (const char*)buf + bpos, size);
+            m_position += size;
             if(m_cur->size == (npos + size)) {
-                m_cur = m_cur->next;
+                m_cur = nodeAt(m_position);
             }
-            m_position += size;
             bpos += size;
             size = 0;
         } else {
@@ -368,7 +1142,7 @@ void ByteArray::write(const void* buf, size_t size) {
             m_position += ncap;
             bpos += ncap;
             size -= ncap;
-            m_cur = m_cur->next;
+            m_cur = nodeAt(m_position);
             ncap = m_cur->size;
             npos = 0;
         }
@@ -390,10 +1164,10 @@ void ByteArray::read(void* buf, size_t size) {
     while(size > 0) {
         if(ncap >= size) {
             memcpy((char*)buf + bpos, m_cur->ptr + npos, size);
+            m_position += size;
             if(m_cur->size == (npos + size)) {
-                m_cur = m_cur->next;
+                m_cur = nodeAt(m_position);
             }
-            m_position += size;
             bpos += size;
             size = 0;
         } else {
@@ -401,7 +1175,7 @@ void ByteArray::read(void* buf, size_t size) {
             m_position += ncap;
             bpos += ncap;
             size -= ncap;
-            m_cur = m_cur->next;
+            m_cur = nodeAt(m_position);
             ncap = m_cur->size;
             npos = 0;
         }
@@ -409,20 +1183,20 @@ void ByteArray::read(void* buf, size_t size) {
 }
 
 void ByteArray::read(void* buf, size_t size, size_t position) const {
-    if(size > (m_size - position)) {
+    if(position > m_size || size > (m_size - position)) {
         throw std::out_of_range("not enough len");
     }
+    if(size == 0) {
+        return;
+    }
 
     size_t npos = position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    Node* cur = nodeAt(position);
+    size_t ncap = cur->size - npos;
     size_t bpos = 0;
-    Node* cur = m_cur;
     while(size > 0) {
         if(ncap >= size) {
             memcpy((char*)buf + bpos, cur->ptr + npos, size);
-            if(cur->size == (npos + size)) {
-                cur = cur->next;
-            }
             position += size;
             bpos += size;
             size = 0;
@@ -431,7 +1205,7 @@ void ByteArray::read(void* buf, size_t size, size_t position) const {
             position += ncap;
             bpos += ncap;
             size -= ncap;
-            cur = cur->next;
+            cur = nodeAt(position);
             ncap = cur->size;
             npos = 0;
         }
@@ -439,63 +1213,161 @@ void ByteArray::read(void* buf, size_t size, size_t position) const {
 }
 
 void ByteArray::setPosition(size_t v) {
-    if(v > m_capacity) {
+    if(v > m_capacity || (m_mapped && v > m_size)) {
         throw std::out_of_range("set_position out of range");
     }
     m_position = v;
     if(m_position > m_size) {
         m_size = m_position;
     }
-    m_cur = m_root;
-    while(v > m_cur->size) {
-        v -= m_cur->size;
-        m_cur = m_cur->next;
-    }
-    if(v == m_cur->size) {
-        m_cur = m_cur->next;
-    }
+    m_cur = nodeAt(v);
 }
 
 bool ByteArray::writeToFile(const std::string& name) const {
-    std::ofstream ofs;
-    ofs.open(name, std::ios::trunc | std::ios::binary);
-    if(!ofs) {
+    int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
         LOG_ERROR_STREAM(g_logger) << "writeToFile name=" << name
             << " error , errno=" << errno << " errstr=" << strerror(errno);
         return false;
     }
 
-    int64_t read_size = getReadSize();
-    int64_t pos = m_position;
-    Node* cur = m_cur;
-
-    while(read_size > 0) {
-        int diff = pos % m_baseSize;
-        int64_t len = (read_size > (int64_t)m_baseSize ? m_baseSize : read_size) - diff;
-        ofs.write(cur->ptr + diff, len);
-        cur = cur->next;
-        pos += len;
-        read_size -= len;
+    size_t pos = m_position;
+    if(m_mapped) {
+        //源数据本身就在文件里, 让内核直接拷贝(同一文件系统上可能只是共享数据块)
+        MappedFile::ptr file = std::static_pointer_cast<MappedFile>(m_mapped);
+        while(pos < m_size) {
+            loff_t off = pos;
+            ssize_t rt = copy_file_range(file->fd, &off, fd, nullptr, m_size - pos, 0);
+            if(rt <= 0) {
+                if(rt < 0 && errno == EINTR) {
+                    continue;
+                }
+                //跨文件系统等情况内核不支持, 剩下的走writev
+                break;
+            }
+            pos += rt;
+        }
     }
 
+    std::vector<iovec> iovs;
+    while(pos < m_size) {
+        iovs.clear();
+        getReadBuffers(iovs, std::min(m_size - pos, (size_t)IOV_MAX * m_baseSize), pos);
+        if(iovs.size() > IOV_MAX) {
+            iovs.resize(IOV_MAX);
+        }
+        ssize_t rt = writev(fd, &iovs[0], iovs.size());
+        if(rt < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR_STREAM(g_logger) << "writeToFile name=" << name
+                << " writev error, errno=" << errno << " errstr=" << strerror(errno);
+            close(fd);
+            return false;
+        }
+        pos += rt;
+    }
+    close(fd);
     return true;
 }
 
 
 bool ByteArray::readFromFile(const std::string& name) {
-    std::ifstream ifs;
-    ifs.open(name, std::ios::binary);
-    if(!ifs) {
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
         LOG_ERROR_STREAM(g_logger) << "readFromFile name=" << name
             << " error, errno=" << errno << " errstr=" << strerror(errno);
         return false;
     }
 
-    std::shared_ptr<char> buff(new char[m_baseSize], [](char* ptr) { delete[] ptr;});
-    while(!ifs.eof()) {
-        ifs.read(buff.get(), m_baseSize);
-        write(buff.get(), ifs.gcount());
+    struct stat st;
+    size_t file_size = 0;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        file_size = st.st_size;
     }
+
+    //按文件剩余大小准备节点, 每次readv最多填满IOV_MAX个节点; 读到EOF为止(文件可能在读的过程中变长)
+    std::vector<iovec> iovs;
+    size_t bytes_read = 0;
+    while(true) {
+        size_t hint = file_size > bytes_read
+                        ? std::max(file_size - bytes_read, (size_t)m_baseSize) : m_baseSize;
+        iovs.clear();
+        getWriteBuffers(iovs, hint);
+        if(iovs.size() > IOV_MAX) {
+            iovs.resize(IOV_MAX);
+        }
+        ssize_t rt = readv(fd, &iovs[0], iovs.size());
+        if(rt < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR_STREAM(g_logger) << "readFromFile name=" << name
+                << " readv error, errno=" << errno << " errstr=" << strerror(errno);
+            close(fd);
+            return false;
+        }
+        if(rt == 0) {
+            break;
+        }
+        setPosition(m_position + rt);
+        bytes_read += rt;
+    }
+    close(fd);
+    return true;
+}
+
+bool ByteArray::mmapFile(const std::string& name) {
+    MappedFile::ptr file(new MappedFile);
+    file->fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if(file->fd < 0 || fstat(file->fd, &st) != 0) {
+        LOG_ERROR_STREAM(g_logger) << "mmapFile name=" << name
+            << " error, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    file->len = st.st_size;
+    if(file->len) {
+        file->addr = mmap(nullptr, file->len, PROT_READ, MAP_SHARED, file->fd, 0);
+        if(file->addr == MAP_FAILED) {
+            LOG_ERROR_STREAM(g_logger) << "mmapFile name=" << name << " len=" << file->len
+                << " mmap error, errno=" << errno << " errstr=" << strerror(errno);
+            return false;
+        }
+    }
+
+    for(auto& i : m_nodes) {
+        Node::Release(i);
+    }
+    m_nodes.clear();
+    if(file->len == 0) {
+        //空文件没有可映射的页, 当普通的空ByteArray处理
+        m_nodes.push_back(Node::Create(m_baseSize));
+        m_capacity = m_baseSize;
+        m_position = m_size = 0;
+        m_cur = m_nodes[0];
+        m_shared = false;
+        m_mapped.reset();
+        return true;
+    }
+
+    //每个节点仍是m_baseSize, 最后一个节点只有文件范围内的部分可读
+    size_t count = (file->len + m_baseSize - 1) / m_baseSize;
+    m_nodes.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        Node* node = new Node();
+        node->ptr = (char*)file->addr + i * m_baseSize;
+        node->size = m_baseSize;
+        node->mapping = file;
+        m_nodes.push_back(node);
+    }
+    m_capacity = count * m_baseSize;
+    m_position = 0;
+    m_size = file->len;
+    m_cur = m_nodes[0];
+    m_shared = true;
+    m_mapped = file;
     return true;
 }
 
@@ -510,18 +1382,14 @@ void ByteArray::addCapacity(size_t size) {
 
     size = size - old_cap;
     size_t count = ceil(1.0 * size / m_baseSize);
-    Node* tmp = m_root;
-    while(tmp->next) {
-        tmp = tmp->next;
-    }
-
     Node* first = NULL;
+    m_nodes.reserve(m_nodes.size() + count);
     for(size_t i = 0; i < count; ++i) {
-        tmp->next = new Node(m_baseSize);
+        Node* tmp = Node::Create(m_baseSize);
         if(first == NULL) {
-            first = tmp->next;
+            first = tmp;
         }
-        tmp = tmp->next;
+        m_nodes.push_back(tmp);
         m_capacity += m_baseSize;
     }
 
@@ -557,34 +1425,7 @@ std::string ByteArray::toHexString() const {
 
 
 uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len) const {
-    len = len > getReadSize() ? getReadSize() : len;
-    if(len == 0) {
-        return 0;
-    }
-
-    uint64_t size = len;
-
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
-    struct iovec iov;
-    Node* cur = m_cur;
-
-    while(len > 0) {
-        if(ncap >= len) {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;
-        } else {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
-        buffers.push_back(iov);
-    }
-    return size;
+    return getReadBuffers(buffers, len, m_position);
 }
 
 uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers ,uint64_t len, uint64_t position) const {
@@ -596,12 +1437,8 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers ,uint64_t len, ui
     uint64_t size = len;
 
     size_t npos = position % m_baseSize;
-    size_t count = position / m_baseSize;
-    Node* cur = m_root;
-    while(count > 0) {
-        cur = cur->next;
-        --count;
-    }
+    size_t idx = position / m_baseSize;
+    Node* cur = m_nodes[idx];
 
     size_t ncap = cur->size - npos;
     struct iovec iov;
@@ -614,7 +1451,7 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers ,uint64_t len, ui
             iov.iov_base = cur->ptr + npos;
             iov.iov_len = ncap;
             len -= ncap;
-            cur = cur->next;
+            cur = m_nodes[++idx];
             ncap = cur->size;
             npos = 0;
         }
@@ -627,13 +1464,17 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len) {
     if(len == 0) {
         return 0;
     }
+    if(m_shared) {
+        unshare(len);
+    }
     addCapacity(len);
     uint64_t size = len;
 
     size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    size_t idx = m_position / m_baseSize;
+    Node* cur = m_nodes[idx];
+    size_t ncap = cur->size - npos;
     struct iovec iov;
-    Node* cur = m_cur;
     while(len > 0) {
         if(ncap >= len) {
             iov.iov_base = cur->ptr + npos;
@@ -644,7 +1485,7 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len) {
             iov.iov_len = ncap;
 
             len -= ncap;
-            cur = cur->next;
+            cur = m_nodes[++idx];
             ncap = cur->size;
             npos = 0;
         }
@@ -653,5 +1494,121 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len) {
     return size;
 }
 
+const std::vector<iovec>& ByteArray::getReadIovecs(uint64_t len) {
+    m_iovs.clear();
+    getReadBuffers(m_iovs, len);
+    return m_iovs;
+}
+
+std::vector<iovec>& ByteArray::getWriteIovecs(uint64_t len) {
+    m_iovs.clear();
+    getWriteBuffers(m_iovs, len);
+    return m_iovs;
+}
+
+std::vector<iovec>& ByteArray::getFreeIovecs(size_t min_size) {
+    if(m_mapped) {
+        throw std::logic_error("ByteArray is read only");
+    }
+    if(min_size == 0) {
+        min_size = m_baseSize;
+    }
+    //addCapacity按整节点扩容
+    addCapacity(min_size);
+    m_iovs.clear();
+    getWriteBuffers(m_iovs, getCapacity());
+    return m_iovs;
+}
+
+ssize_t ByteArray::readSome(int fd) {
+    std::vector<iovec>& iovs = getFreeIovecs();
+    ssize_t rt = readv(fd, &iovs[0], std::min(iovs.size(), (size_t)IOV_MAX));
+    if(rt > 0) {
+        setPosition(m_position + rt);
+    }
+    return rt;
+}
+
+int64_t ByteArray::findByte(char c, size_t from) const {
+    size_t pos = from;
+    while(pos < m_size) {
+        size_t npos = pos % m_baseSize;
+        size_t len = std::min(m_baseSize - npos, m_size - pos);
+        const char* p = nodeAt(pos)->ptr + npos;
+        const char* f = FindByte(p, len, c);
+        if(f) {
+            return pos + (f - p);
+        }
+        pos += len;
+    }
+    return -1;
+}
+
+int64_t ByteArray::find(const std::string& pattern, size_t from) const {
+    size_t k = pattern.size();
+    if(k == 0) {
+        return from <= m_size ? (int64_t)from : -1;
+    }
+    if(k == 1) {
+        return findByte(pattern[0], from);
+    }
+
+    //跨节点检查用的缓冲区: 节点末尾k-1字节 + 后面k-1字节
+    char stack_buf[256];
+    std::string heap_buf;
+    char* border = stack_buf;
+    if(2 * (k - 1) > sizeof(stack_buf)) {
+        heap_buf.resize(2 * (k - 1));
+        border = &heap_buf[0];
+    }
+
+    size_t pos = from;
+    while(pos < m_size && m_size - pos >= k) {
+        size_t npos = pos % m_baseSize;
+        size_t len = std::min(m_baseSize - npos, m_size - pos);
+        const char* p = nodeAt(pos)->ptr + npos;
+        //完全落在本节点里的匹配
+        const char* f = FindPattern(p, len, pattern.c_str(), k);
+        if(f) {
+            return pos + (f - p);
+        }
+        if(pos + len >= m_size) {
+            break;
+        }
+        //起点在本节点最后k-1字节里的匹配
+        size_t head = std::min(len, k - 1);
+        size_t tail = std::min(k - 1, m_size - pos - len);
+        read(border, head + tail, pos + len - head);
+        f = FindPattern(border, head + tail, pattern.c_str(), k);
+        if(f) {
+            return pos + len - head + (f - border);
+        }
+        pos += len;
+    }
+    return -1;
+}
+
+int64_t ByteArray::indexOf(char c, size_t offset) const {
+    int64_t rt = findByte(c, m_position + offset);
+    return rt < 0 ? rt : rt - (int64_t)m_position;
+}
+
+int64_t ByteArray::indexOf(const std::string& delim, size_t offset) const {
+    int64_t rt = find(delim, m_position + offset);
+    return rt < 0 ? rt : rt - (int64_t)m_position;
+}
+
+bool ByteArray::readUntil(std::string& out, const std::string& delim) {
+    int64_t idx = indexOf(delim);
+    if(idx < 0) {
+        return false;
+    }
+    out.resize(idx);
+    if(idx) {
+        read(&out[0], idx);
+    }
+    setPosition(m_position + delim.size());
+    return true;
+}
 
 }
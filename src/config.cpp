@@ -1,71 +1,469 @@
 #include "../include/config.h"
+#include "../include/scheduler.h"
+#include "../include/bytearray.h"
+#include <fstream>
+#include <string.h>
+#include <unistd.h>
+#include <unordered_map>
 
 namespace frb{
 
      
 
      ConfigVarBase::ptr Config::LookUpBase(const std::string& name) {
-          RWMutexType::ReadLock lock(GetMutex());
-          auto it = Config::GetDatas().find(name);
-          return it == Config::GetDatas().end() ? nullptr : it->second;
+          auto index = GetIndex().get();
+          auto it = index->find(name);
+          if(it != index->end()) {
+               return it->second;
+          }
 
+          ConfigVarBase::ptr var;
+          {
+               RWMutexType::ReadLock lock(GetMutex());
+               auto it = Config::GetDatas().find(name);
+               if(it == Config::GetDatas().end()) {
+                    return nullptr;
+               }
+               var = it->second;
+          }
+          //注册之后还没发布到索引, 发布一次, 之后的查找都不用加锁
+          RWMutexType::WriteLock lock(GetMutex());
+          PublishIndexNoLock(true);
+          return var;
      }
 
-     
-     static void ListAllMember(const std::string& prefix, YAML::Node& node
-                              , std::list<std::pair<std::string , YAML::Node>>& output) {
-          if(prefix.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._012345678")
-                    != std::string::npos) {
-               LOG_ERROR(GET_LOG_ROOT, "Config invalid name: ");
-               return;
+     void Config::PublishIndexNoLock(bool force) {
+          size_t size = GetDatas().size();
+          size_t published = GetIndex().get()->size();
+          if(force ? size != published : size >= published * 2 + 16) {
+               GetIndex().set(GetDatas());
+               //加2不改变奇偶, 正在提交时仍是奇数
+               GetVersionRef().fetch_add(2, std::memory_order_release);
           }
+     }
 
-          output.push_back(std::make_pair(prefix, node));
+     
+     /**
+      * @brief 一次遍历YAML树, 找出所有已注册的配置项
+      * @param[in,out] key 当前节点的完整名称, 子节点在它后面追加再截回, 整个遍历只用这一个缓冲区
+      * @param[in] node 当前节点
+      * @param[in] datas 全局配置表, 调用方持有读锁
+      * @param[out] output 匹配到的配置项和对应节点
+      * @param[out] nodes 遍历的节点数
+      */
+     static void CollectMember(std::string& key, const YAML::Node& node
+                              ,const Config::ConfigVarMap& datas
+                              ,std::vector<std::pair<ConfigVarBase::ptr, YAML::Node> >& output
+                              ,size_t& nodes) {
+          ++nodes;
+          if(!key.empty()) {
+               auto it = datas.find(key);
+               if(it != datas.end()) {
+                    output.push_back(std::make_pair(it->second, node));
+               }
+          }
 
-          if(node.IsMap()) {
-               for(auto it = node.begin();
-                         it != node.end(); ++it) {
-                    ListAllMember(prefix.empty() ? it->first.Scalar()
-                              : prefix + "." + it->first.Scalar(), it->second, output);
+          if(!node.IsMap()) {
+               return;
+          }
+          size_t len = key.size();
+          for(auto it = node.begin(); it != node.end(); ++it) {
+               if(len) {
+                    key.push_back('.');
+               }
+               size_t start = key.size();
+               key.append(it->first.Scalar());
+               if(key.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._0123456789", start)
+                         != std::string::npos) {
+                    LOG_ERROR_STREAM(GET_LOG_ROOT) << "Config invalid name: " << key;
+               } else {
+                    std::transform(key.begin() + start, key.end(), key.begin() + start, ::tolower);
+                    CollectMember(key, it->second, datas, output, nodes);
                }
+               key.resize(len);
           }
+     }
 
+     /**
+      * @brief 覆盖层的值按YAML解析, 空值或解析失败时当作字符串标量
+      */
+     static YAML::Node OverrideNode(const std::string& value) {
+          try {
+               YAML::Node node = YAML::Load(value);
+               if(node.IsDefined() && !node.IsNull()) {
+                    return node;
+               }
+          } catch (std::exception& e) {
+          }
+          return YAML::Node(value);
      }
 
-     void Config::LoadFromYaml(YAML::Node& root) {
-          std::list<std::pair<std::string, YAML::Node>> all_nodes;
-     
+     bool Config::LoadFromEnv(const std::string& prefix) {
+          uint64_t start = GetCurrentUS();
 
+          //配置名->环境变量名, 在索引快照上做, 不加锁
+          RCUValue<ConfigVarMap>::ConstPtr index;
+          uint64_t version = 0;
+          {
+               RWMutexType::WriteLock lock(GetMutex());
+               PublishIndexNoLock(true);
+               index = GetIndex().get();
+               version = GetVersion();
+          }
 
-          //将yaml文件中的各参数记录在all_nodes中
-          ListAllMember("", root, all_nodes);    
+          //环境变量名表只在版本号或前缀变化后重建; 注册新配置项发布索引时版本号也会变
+          static Mutex s_env_mutex;
+          static uint64_t s_env_version = ~0ull;
+          static std::string s_env_prefix;
+          static std::unordered_map<std::string, ConfigVarBase::ptr> s_env_names;
+          Mutex::Lock env_lock(s_env_mutex);
+          auto& env_names = s_env_names;
+          if(s_env_version != version || s_env_prefix != prefix) {
+               s_env_version = version;
+               s_env_prefix = prefix;
+               env_names.clear();
+               for(auto& i : *index) {
+                    std::string env = prefix + i.first;
+                    for(size_t n = prefix.size(); n < env.size(); ++n) {
+                         env[n] = env[n] == '.' ? '_' : toupper(env[n]);
+                    }
+                    auto it = env_names.find(env);
+                    if(it == env_names.end()) {
+                         env_names[env] = i.second;
+                    } else {
+                         if(it->second) {
+                              LOG_WARN_STREAM(GET_LOG_ROOT) << "env " << env << " is ambiguous: "
+                                   << it->second->getName() << " and " << i.first << ", ignored";
+                         }
+                         it->second = nullptr;
+                    }
+               }
+          }
 
-          for(auto& i : all_nodes) {
-               std::string key = i.first;
-               if(key.empty())
+          NodeList matched;
+          size_t nodes = 0;
+          for(char** e = environ; *e; ++e) {
+               if(strncmp(*e, prefix.c_str(), prefix.size())) {
                     continue;
-               
-               std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+               }
+               ++nodes;
+               const char* eq = strchr(*e, '=');
+               if(!eq) {
+                    continue;
+               }
+               auto it = env_names.find(std::string(*e, eq - *e));
+               if(it != env_names.end() && it->second) {
+                    matched.push_back(std::make_pair(it->second, OverrideNode(eq + 1)));
+               }
+          }
+          return Apply(matched, "Env", nodes, start);
+     }
 
-               //在全局的配置参数图s_datas中查找该参数是否存在
-               //存在：用yaml文件中的值覆盖
-               //不存在：说明系统中没有用到该参数，不用处理
+     bool Config::LoadFromArgs(int argc, char** argv) {
+          uint64_t start = GetCurrentUS();
+          NodeList matched;
+          size_t nodes = 0;
+          for(int i = 1; i < argc; ++i) {
+               const char* arg = argv[i];
+               const char* eq = strchr(arg, '=');
+               if(strncmp(arg, "--", 2) || !eq) {
+                    continue;
+               }
+               ++nodes;
+               std::string key(arg + 2, eq - arg - 2);
+               std::transform(key.begin(), key.end(), key.begin(), ::tolower);
                ConfigVarBase::ptr var = LookUpBase(key);
+               if(!var) {
+                    LOG_WARN_STREAM(GET_LOG_ROOT) << "LoadFromArgs unknown config " << key;
+                    continue;
+               }
+               matched.push_back(std::make_pair(var, OverrideNode(eq + 1)));
+          }
+          return Apply(matched, "Args", nodes, start);
+     }
+
+     bool Config::LoadFromYaml(YAML::Node& root) {
+          uint64_t start = GetCurrentUS();
+          NodeList matched;
+          size_t nodes = 0;
 
-               if(var){
+          //只在遍历时持有读锁; 监听函数里可能再Lookup
+          {
+               RWMutexType::ReadLock lock(GetMutex());
+               std::string key;
+               key.reserve(256);
+               CollectMember(key, root, GetDatas(), matched, nodes);
+          }
 
-                    if(i.second.IsScalar()) {
-                         var->fromString(i.second.Scalar());
+          return Apply(matched, "Yaml", nodes, start);
+     }
+
+     bool Config::Apply(const NodeList& matched, const char* source, size_t nodes, uint64_t start) {
+          Mutex::Lock lock(GetLoadMutex());
+
+          //第一步: 全部转换成待提交的值, 任何一项失败都整体放弃, 不会只生效一半
+          //系统中没有用到的参数不用处理; 值没有变化的参数不提交
+          std::vector<ConfigVarBase::ptr> staged;
+          for(auto& i : matched) {
+               try {
+                    if(i.first->stage(i.second)) {
+                         staged.push_back(i.first);
                     } else {
-                         std::stringstream ss;
-                         ss << i.second;
-                         var->fromString(ss.str());
+                         i.first->rollback();
                     }
+               } catch (std::exception& e) {
+                    LOG_ERROR_STREAM(GET_LOG_ROOT) << "LoadFrom" << source << " name=" << i.first->getName()
+                         << " convert to " << i.first->getTypeName()
+                         << " fail: " << e.what() << ", reload aborted";
+                    i.first->rollback();
+                    for(auto& s : staged) {
+                         s->rollback();
+                    }
+                    return false;
+               }
+          }
+
+          //第二步: 提交, 只是一次次替换快照指针
+          std::vector<std::function<void()> > notifies;
+          auto& version = GetVersionRef();
+          ++version;
+          for(auto& i : staged) {
+               auto cb = i->commit();
+               if(cb) {
+                    //通知里要用到配置项, 一起持有
+                    notifies.push_back([i, cb]() { cb(); });
                }
-               
           }
+          ++version;
+          lock.unlock();
+
+          LOG_INFO_STREAM(GET_LOG_ROOT) << "LoadFrom" << source << " nodes=" << nodes
+               << " matched=" << matched.size() << " changed=" << staged.size()
+               << " cost=" << (GetCurrentUS() - start) << "us";
 
+          //第三步: 执行监听函数, 按提交顺序在一个任务里依次执行
+          if(!notifies.empty()) {
+               std::function<void()> run = [notifies]() {
+                    for(auto& i : notifies) {
+                         i();
+                    }
+               };
+               Scheduler* scheduler = GetListenerScheduler();
+               if(scheduler) {
+                    scheduler->schedule(run);
+               } else {
+                    run();
+               }
+          }
+          return true;
+     }
+
+     //快照文件头: "FRBC" + 格式版本 + YAML内容hash + 文件个数
+     static const uint32_t s_snapshot_magic = 0x46524243;
+     static const uint32_t s_snapshot_version = 1;
+
+     //快照中节点的类型
+     enum SnapshotNodeType {
+          SNAPSHOT_NULL = 0,
+          SNAPSHOT_SCALAR = 1,
+          SNAPSHOT_SEQUENCE = 2,
+          SNAPSHOT_MAP = 3
+     };
+
+     static void EncodeNode(ByteArray& ba, const YAML::Node& node) {
+          if(node.IsScalar()) {
+               ba.writeFuint8(SNAPSHOT_SCALAR);
+               ba.writeStringVint(node.Scalar());
+          } else if(node.IsSequence()) {
+               ba.writeFuint8(SNAPSHOT_SEQUENCE);
+               ba.writeUint64(node.size());
+               for(auto it = node.begin(); it != node.end(); ++it) {
+                    EncodeNode(ba, *it);
+               }
+          } else if(node.IsMap()) {
+               ba.writeFuint8(SNAPSHOT_MAP);
+               ba.writeUint64(node.size());
+               for(auto it = node.begin(); it != node.end(); ++it) {
+                    ba.writeStringVint(it->first.Scalar());
+                    EncodeNode(ba, it->second);
+               }
+          } else {
+               ba.writeFuint8(SNAPSHOT_NULL);
+          }
+     }
+
+     static YAML::Node DecodeNode(ByteArray& ba) {
+          uint8_t type = ba.readFuint8();
+          switch(type) {
+               case SNAPSHOT_SCALAR:
+                    return YAML::Node(ba.readStringVint());
+               case SNAPSHOT_SEQUENCE: {
+                    YAML::Node node(YAML::NodeType::Sequence);
+                    uint64_t size = ba.readUint64();
+                    for(uint64_t i = 0; i < size; ++i) {
+                         node.push_back(DecodeNode(ba));
+                    }
+                    return node;
+               }
+               case SNAPSHOT_MAP: {
+                    YAML::Node node(YAML::NodeType::Map);
+                    uint64_t size = ba.readUint64();
+                    for(uint64_t i = 0; i < size; ++i) {
+                         //快照里的键不会重复, 不用node[key]逐个比较已有的键
+                         std::string key = ba.readStringVint();
+                         node.force_insert(key, DecodeNode(ba));
+                    }
+                    return node;
+               }
+               case SNAPSHOT_NULL:
+                    return YAML::Node(YAML::NodeType::Null);
+               default:
+                    throw std::logic_error("invalid snapshot node type " + std::to_string(type));
+          }
+     }
+
+     /**
+      * @brief 计算YAML文件名和内容的FNV-1a hash, 只读文件不解析
+      * @return 有文件读取失败时返回false
+      */
+     static bool HashFiles(const std::vector<std::string>& files, uint64_t& hash) {
+          hash = 14695981039346656037ull;
+          auto update = [&hash](const char* p, size_t len) {
+               for(size_t i = 0; i < len; ++i) {
+                    hash ^= (uint8_t)p[i];
+                    hash *= 1099511628211ull;
+               }
+          };
+          for(auto& i : files) {
+               std::ifstream ifs(i, std::ios::binary);
+               if(!ifs) {
+                    return false;
+               }
+               std::string content((std::istreambuf_iterator<char>(ifs))
+                                   ,std::istreambuf_iterator<char>());
+               update(i.c_str(), i.size() + 1);
+               update(content.c_str(), content.size());
+          }
+          return true;
+     }
+
+     bool Config::CompileSnapshot(const std::vector<std::string>& yaml_files
+                                  ,const std::string& snapshot_file) {
+          uint64_t hash = 0;
+          if(!HashFiles(yaml_files, hash)) {
+               LOG_ERROR_STREAM(GET_LOG_ROOT) << "CompileSnapshot read yaml files fail";
+               return false;
+          }
+
+          ByteArray ba;
+          ba.writeFuint32(s_snapshot_magic);
+          ba.writeFuint32(s_snapshot_version);
+          ba.writeFuint64(hash);
+          ba.writeUint64(yaml_files.size());
+          for(auto& i : yaml_files) {
+               try {
+                    YAML::Node root = YAML::LoadFile(i);
+                    ba.writeStringVint(i);
+                    EncodeNode(ba, root);
+               } catch (std::exception& e) {
+                    LOG_ERROR_STREAM(GET_LOG_ROOT) << "CompileSnapshot parse " << i
+                         << " fail: " << e.what();
+                    return false;
+               }
+          }
+          ba.setPosition(0);
+          return ba.writeToFile(snapshot_file);
+     }
+
+     bool Config::LoadFromSnapshot(const std::string& snapshot_file
+                                   ,const std::vector<std::string>& yaml_files) {
+          uint64_t start = GetCurrentUS();
+          uint64_t hash = 0;
+          bool hashed = HashFiles(yaml_files, hash);
+
+          std::vector<YAML::Node> roots;
+          ByteArray ba;
+          if(hashed && ba.mmapFile(snapshot_file)) {
+               try {
+                    ba.setPosition(0);
+                    if(ba.readFuint32() != s_snapshot_magic
+                              || ba.readFuint32() != s_snapshot_version) {
+                         LOG_WARN_STREAM(GET_LOG_ROOT) << "snapshot " << snapshot_file << " format mismatch";
+                    } else if(ba.readFuint64() != hash) {
+                         LOG_INFO_STREAM(GET_LOG_ROOT) << "snapshot " << snapshot_file << " is stale";
+                    } else {
+                         uint64_t count = ba.readUint64();
+                         for(uint64_t i = 0; i < count; ++i) {
+                              ba.readStringVint();
+                              roots.push_back(DecodeNode(ba));
+                         }
+                    }
+               } catch (std::exception& e) {
+                    LOG_WARN_STREAM(GET_LOG_ROOT) << "snapshot " << snapshot_file
+                         << " corrupted: " << e.what();
+                    roots.clear();
+               }
+          }
+
+          bool from_snapshot = !roots.empty() || (hashed && yaml_files.empty());
+          if(!from_snapshot) {
+               roots.clear();
+               for(auto& i : yaml_files) {
+                    try {
+                         roots.push_back(YAML::LoadFile(i));
+                    } catch (std::exception& e) {
+                         LOG_ERROR_STREAM(GET_LOG_ROOT) << "LoadFromSnapshot parse " << i
+                              << " fail: " << e.what();
+                         return false;
+                    }
+               }
+          }
+
+          //所有文件合成一个事务: 任一项转换失败整体放弃; 同一配置项出现多次时后面的文件覆盖前面的
+          NodeList matched;
+          size_t nodes = 0;
+          {
+               RWMutexType::ReadLock lock(GetMutex());
+               std::string key;
+               key.reserve(256);
+               for(auto& i : roots) {
+                    CollectMember(key, i, GetDatas(), matched, nodes);
+               }
+          }
+          std::unordered_map<ConfigVarBase*, size_t> last;
+          for(size_t i = 0; i < matched.size(); ++i) {
+               last[matched[i].first.get()] = i;
+          }
+          if(last.size() != matched.size()) {
+               NodeList dedup;
+               dedup.reserve(last.size());
+               for(size_t i = 0; i < matched.size(); ++i) {
+                    if(last[matched[i].first.get()] == i) {
+                         dedup.push_back(std::move(matched[i]));
+                    }
+               }
+               matched.swap(dedup);
+          }
+
+          bool ok = Apply(matched, "Snapshot", nodes, start);
+          LOG_INFO_STREAM(GET_LOG_ROOT) << "LoadFromSnapshot files=" << yaml_files.size()
+               << " from=" << (from_snapshot ? snapshot_file : std::string("yaml"))
+               << " cost=" << (GetCurrentUS() - start) << "us";
+          return ok;
+     }
+
+     static std::atomic<Scheduler*> s_listener_scheduler{nullptr};
+
+     void Config::SetListenerScheduler(Scheduler* scheduler) {
+          s_listener_scheduler = scheduler;
+     }
+
+     Scheduler* Config::GetListenerScheduler() {
+          return s_listener_scheduler;
+     }
 
+     uint64_t Config::GetVersion() {
+          return GetVersionRef().load(std::memory_order_acquire);
      }
     
-}
\ No newline at end of file
+}
@@ -20,6 +20,23 @@ FdCtx::FdCtx(int fd)
     init();
 }
 
+FdCtx::FdCtx(int fd, bool nonblock)
+    :m_isInit(true)
+    ,m_isSocket(true)
+    ,m_sysNonblock(true)
+    ,m_userNonblock(false)
+    ,m_isClosed(false)
+    ,m_fd(fd)
+    ,m_recvTimeout(-1)
+    ,m_sendTimeout(-1) {
+    if(!nonblock) {
+        int flags = fcntl_f(m_fd, F_GETFL, 0);
+        if(!(flags & O_NONBLOCK)) {
+            fcntl_f(m_fd, F_SETFL, flags | O_NONBLOCK);
+        }
+    }
+}
+
 FdCtx::~FdCtx() {
 }
 
@@ -113,6 +130,19 @@ FdCtx::ptr FdManager::get(int fd, bool auto_create) {
 }
 
 
+FdCtx::ptr FdManager::addSocket(int fd, bool nonblock) {
+    if(fd < 0) {
+        return nullptr;
+    }
+    FdCtx::ptr ctx(new FdCtx(fd, nonblock));
+    RWMutexType::WriteLock lock(m_mutex);
+    if(fd >= (int)m_datas.size()) {
+        m_datas.resize(fd * 1.5);
+    }
+    m_datas[fd] = ctx;
+    return ctx;
+}
+
 void FdManager::del(int fd) {
     RWMutexType::WriteLock lock(m_mutex);
     if((int)m_datas.size() <= fd) {
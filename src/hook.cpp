@@ -26,6 +26,7 @@ static thread_local bool t_hook_enable = false;
     XX(socket) \
     XX(connect) \
     XX(accept) \
+    XX(accept4) \
     XX(read) \
     XX(readv) \
     XX(recv) \
@@ -36,6 +37,8 @@ static thread_local bool t_hook_enable = false;
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendfile) \
+    XX(splice) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -165,7 +168,8 @@ retry:
         
         //添加失败
         if(rt) {
-            LOG_ERROR_STREAM(g_logger) << hook_fun_name << " addEvent("
+            //fd耗尽等情况下会在每次IO上重复失败,限流避免刷屏
+            LOG_ERROR_STREAM_LIMIT(g_logger, 10) << hook_fun_name << " addEvent("
                 << fd << ", " << event << ")";
             
             if(timer){
@@ -209,11 +213,13 @@ unsigned int sleep(unsigned int seconds) {
     }
     frb::Fiber::ptr fiber = frb::Fiber::GetThis();
     frb::IOManager* iom = frb::IOManager::GetThis();
+    //绑定线程的协程醒来后回到原线程
+    int thread = frb::Scheduler::GetTaskThread();
 
     //BIND模板函数要提前声明类型
     //这里bind的是指向Scheduler成员函数的函数指针
     iom->addTimer(seconds * 1000, std::bind((void(frb::Scheduler::*)
-        (frb::Fiber::ptr, int))&frb::IOManager::schedule, iom, fiber, -1));
+        (frb::Fiber::ptr, int))&frb::IOManager::schedule, iom, fiber, thread));
 
     frb::Fiber::YieldToHold();
     return 0;
@@ -226,9 +232,11 @@ int usleep(useconds_t usec) {
     }
     frb::Fiber::ptr fiber = frb::Fiber::GetThis();
     frb::IOManager* iom = frb::IOManager::GetThis();
+    //绑定线程的协程醒来后回到原线程
+    int thread = frb::Scheduler::GetTaskThread();
 
     iom->addTimer(usec / 1000, std::bind((void(frb::Scheduler::*)
-        (frb::Fiber::ptr, int))&frb::IOManager::schedule, iom, fiber, -1));
+        (frb::Fiber::ptr, int))&frb::IOManager::schedule, iom, fiber, thread));
 
     frb::Fiber::YieldToHold();
     return 0;
@@ -242,8 +250,10 @@ int nanosleep(const struct timespec *req, struct timespec *rem){
     int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 /1000;
     frb::Fiber::ptr fiber = frb::Fiber::GetThis();
     frb::IOManager* iom = frb::IOManager::GetThis();
+    //绑定线程的协程醒来后回到原线程
+    int thread = frb::Scheduler::GetTaskThread();
     iom->addTimer(timeout_ms, std::bind((void(frb::Scheduler::*)
-        (frb::Fiber::ptr, int))&frb::IOManager::schedule, iom, fiber, -1));
+        (frb::Fiber::ptr, int))&frb::IOManager::schedule, iom, fiber, thread));
     frb::Fiber::YieldToHold();
     return 0;  
 }
@@ -259,8 +269,8 @@ int socket(int domain, int type, int protocol) {
         return fd;
     }
 
-    //如果是socket，会设置其为非阻塞
-    frb::FdMgr::GetInstance()->get(fd, true);
+    //已知是socket, 不用fstat; 没带SOCK_NONBLOCK时设置为非阻塞
+    frb::FdMgr::GetInstance()->addSocket(fd, type & SOCK_NONBLOCK);
     return fd;
 }
 
@@ -351,7 +361,16 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
     int fd = do_io(s, accept_f, "accept", frb::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
     if(fd >= 0) {
-        frb::FdMgr::GetInstance()->get(fd, true);
+        frb::FdMgr::GetInstance()->addSocket(fd, false);
+    }
+    return fd;
+}
+
+//和socket一样, flags里的SOCK_NONBLOCK只省掉fcntl, 不算用户设置的非阻塞
+int accept4(int s, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    int fd = do_io(s, accept4_f, "accept4", frb::IOManager::READ, SO_RCVTIMEO, addr, addrlen, flags);
+    if(fd >= 0) {
+        frb::FdMgr::GetInstance()->addSocket(fd, flags & SOCK_NONBLOCK);
     }
     return fd;
 }
@@ -398,6 +417,29 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
     return do_io(s, sendmsg_f, "sendmsg", frb::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return do_io(out_fd, sendfile_f, "sendfile", frb::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
+/**
+ * @brief 输出端在前的splice, 供do_io按输出fd等待可写
+ */
+static ssize_t splice_out(int fd_out, int fd_in, loff_t *off_in, loff_t *off_out, size_t len, unsigned int flags) {
+    return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+}
+
+//splice两端至少一端是pipe: 输入端是socket时等可读, 否则输出端是socket时等可写
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+    if(!frb::t_hook_enable) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    frb::FdCtx::ptr ctx = frb::FdMgr::GetInstance()->get(fd_in);
+    if(ctx && ctx->isSocket()) {
+        return do_io(fd_in, splice_f, "splice", frb::IOManager::READ, SO_RCVTIMEO, off_in, fd_out, off_out, len, flags);
+    }
+    return do_io(fd_out, splice_out, "splice", frb::IOManager::WRITE, SO_SNDTIMEO, fd_in, off_in, off_out, len, flags);
+}
+
 int close(int fd) {
     if(!frb::t_hook_enable) {
         return close_f(fd);
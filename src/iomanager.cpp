@@ -1,9 +1,11 @@
 
 #include "../include/iomanager.h"
+#include "../include/log.h"
 
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/epoll.h>
 #include <string.h>
 #include <unistd.h>
@@ -11,6 +13,43 @@
 namespace frb{
 static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
 
+/// tickle(thread)用的唤醒信号, SIGURG默认忽略, 误投递也无害
+static const int s_wake_signal = SIGURG;
+
+static void wake_signal_handler(int) {
+}
+
+/**
+ * @brief 安装唤醒信号的空处理函数(不带SA_RESTART, 让epoll_pwait返回EINTR)
+ *        用户已自行处理SIGURG时不覆盖, 此时绑定线程的任务退化为等idle超时
+ */
+struct _WakeSignalIniter {
+    _WakeSignalIniter() {
+        struct sigaction old;
+        if(sigaction(s_wake_signal, nullptr, &old) == 0
+                && old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) {
+            LOG_WARN_STREAM(g_logger) << "wake signal " << s_wake_signal << " already handled";
+            return;
+        }
+        struct sigaction act;
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = wake_signal_handler;
+        sigemptyset(&act.sa_mask);
+        sigaction(s_wake_signal, &act, nullptr);
+    }
+};
+
+//持有限流汇总定时器的IOManager
+static Mutex& GetLogFlushMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+static IOManager*& GetLogFlushOwner() {
+    static IOManager* s_owner = nullptr;
+    return s_owner;
+}
+
 IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
     switch(event) {
         case IOManager::READ  : return read;
@@ -26,6 +65,7 @@ void IOManager::FdContext::resetContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.cb = nullptr;
+    ctx.thread = -1;
 }
 
 //将event的event_ctx中任务放入调度队列
@@ -34,13 +74,16 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     //fd的事件events有event
     ASSERT(events & event);
 
+    //事件只触发一次, 清掉后同一fd才能再次addEvent, cancelAll也不会再触发它
+    events = (Event)(events & ~event);
     EventContext& ctx = getContext(event);
     if(ctx.cb){
-        ctx.scheduler->schedule(&(ctx.cb));
+        ctx.scheduler->schedule(&(ctx.cb), ctx.thread);
     } else {
-        ctx.scheduler->schedule(&ctx.fiber);
+        ctx.scheduler->schedule(&ctx.fiber, ctx.thread);
     }
     ctx.scheduler = nullptr;
+    ctx.thread = -1;
     return ;
 
 
@@ -48,6 +91,7 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
 
 IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
     :Scheduler(threads, use_caller, name) {
+    static _WakeSignalIniter s_wake_initer;
     
     //申请内核事件表
     m_epfd = epoll_create(5000);
@@ -73,9 +117,19 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
     contextResize(32);
 
     start();   
+
+    //第一个启动的IOManager负责周期地输出被限流日志的汇总,
+    //否则突发之后再也没有日志的调用点要等到进程退出才汇总
+    Mutex::Lock lock(GetLogFlushMutex());
+    if(!GetLogFlushOwner()) {
+        GetLogFlushOwner() = this;
+        m_logFlush = true;
+        m_logFlushTimer = addTimer(1000, &LogLimiter::FlushAll, true);
+    }
 }
 
 IOManager::~IOManager(){
+    releaseLogFlush();
     stop();
     close(m_epfd);
     close(m_tickleFds[0]);
@@ -157,6 +211,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb){
         event_ctx.cb.swap(cb);
     } else {
         event_ctx.fiber = Fiber::GetThis();
+        event_ctx.thread = Scheduler::GetTaskThread();
         ASSERT2(event_ctx.fiber->getState() == Fiber::EXEC
                 ,"state=" << event_ctx.fiber->getState());
     }
@@ -299,10 +354,22 @@ void IOManager::tickle(){
     ASSERT(rt == 1);
 }
 
+void IOManager::tickle(int thread){
+    RWMutexType::ReadLock lock(m_wakeMutex);
+    auto it = m_wakeThreads.find(thread);
+    //还没进过idle的线程, 进idle后第一轮不阻塞, 会先回调度循环取任务
+    if(it != m_wakeThreads.end()) {
+        pthread_kill(it->second, s_wake_signal);
+    }
+}
+
 
 
 bool IOManager::stopping(uint64_t& timeout){
-    //
+    //stop()之后周期定时器不再保留, 否则永远停不下来
+    if(m_stopping && m_logFlush) {
+        releaseLogFlush();
+    }
     timeout = getNextTimer();
     return timeout == ~0ull
         && m_pendingEventCount == 0
@@ -310,6 +377,17 @@ bool IOManager::stopping(uint64_t& timeout){
 
 }
 
+void IOManager::releaseLogFlush() {
+    Mutex::Lock lock(GetLogFlushMutex());
+    if(!m_logFlush) {
+        return;
+    }
+    m_logFlushTimer->cancel();
+    m_logFlushTimer.reset();
+    GetLogFlushOwner() = nullptr;
+    m_logFlush = false;
+}
+
 bool IOManager::stopping(){
     uint64_t timeout = 0;
     return stopping(timeout);
@@ -330,6 +408,18 @@ void IOManager::idle(){
         delete[] ptr;
     });
 
+    //唤醒信号只在epoll_pwait期间放开
+    sigset_t block_mask, wait_mask;
+    sigemptyset(&block_mask);
+    sigaddset(&block_mask, s_wake_signal);
+    pthread_sigmask(SIG_BLOCK, &block_mask, &wait_mask);
+    sigdelset(&wait_mask, s_wake_signal);
+    {
+        RWMutexType::WriteLock lock(m_wakeMutex);
+        m_wakeThreads[frb::GetThreadId()] = pthread_self();
+    }
+    //登记之前发来的唤醒可能已经错过, 第一轮不阻塞
+    bool first = true;
 
 
     while(true) {
@@ -342,27 +432,29 @@ void IOManager::idle(){
         if(stopping(next_timeout)) {
             LOG_INFO_STREAM(g_logger) << "name =" << getName()
                                << " idle stopping exit";
+            {
+                RWMutexType::WriteLock lock(m_wakeMutex);
+                m_wakeThreads.erase(frb::GetThreadId());
+            }
+            pthread_sigmask(SIG_UNBLOCK, &block_mask, nullptr);
             break;
         }
 
-        int rt = 0;
-
-        do {
-            static const int MAX_TIMEOUT = 3000;
-            if(next_timeout != ~0ull){
-                next_timeout = (int)next_timeout > MAX_TIMEOUT ? MAX_TIMEOUT : next_timeout;
-            } else {
-                next_timeout = MAX_TIMEOUT;
-            }
-            rt = epoll_wait(m_epfd, events, MAX_EVENTS, (int)next_timeout);
-
-            if(rt < 0 && errno == EINTR){
-                //继续等待
-            } else {
-                //唤醒epoll_wait后，
-                break;
-            }
-        } while(true);
+        static const int MAX_TIMEOUT = 3000;
+        if(next_timeout != ~0ull){
+            next_timeout = (int)next_timeout > MAX_TIMEOUT ? MAX_TIMEOUT : next_timeout;
+        } else {
+            next_timeout = MAX_TIMEOUT;
+        }
+        if(first) {
+            next_timeout = 0;
+            first = false;
+        }
+        int rt = epoll_pwait(m_epfd, events, MAX_EVENTS, (int)next_timeout, &wait_mask);
+        if(rt < 0) {
+            //EINTR: 被tickle(thread)打断, 回调度循环取绑定到本线程的任务
+            rt = 0;
+        }
 
         std::vector<std::function<void()> > cbs;
         listExpiredCb(cbs);
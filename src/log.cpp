@@ -1,5 +1,12 @@
 #include "../include/log.h"
 #include "../include/config.h"
+#include <set>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
 
 namespace frb{
 
@@ -57,12 +64,69 @@ namespace frb{
 
             }
 
+            //每个线程缓存的事件个数, 打日志时嵌套打日志才会同时用到多个
+            static const size_t s_log_event_pool_size = 4;
+
+            struct LogEventPool {
+                ~LogEventPool();
+                std::vector<LogEvent::ptr> events;
+            };
+
+            static thread_local LogEventPool t_log_event_pool;
+            //线程退出时, 池可能先于其它线程局部对象析构, 之后打日志不再用池
+            static thread_local bool t_log_event_pool_destroyed = false;
+
+            LogEventPool::~LogEventPool() {
+                t_log_event_pool_destroyed = true;
+            }
+
+            LogEvent::ptr LogEvent::Create(std::shared_ptr<Logger> logger, LogLevel::Level level
+                        ,const char* file, int32_t line) {
+                LogEvent::ptr event;
+                if(!t_log_event_pool_destroyed) {
+                    auto& events = t_log_event_pool.events;
+                    for(auto& i : events) {
+                        //只有池自己持有, 说明上一条日志已经写完
+                        if(i.use_count() == 1) {
+                            event = i;
+                            break;
+                        }
+                    }
+                    if(!event && events.size() < s_log_event_pool_size) {
+                        event.reset(new LogEvent);
+                        events.push_back(event);
+                    }
+                }
+                if(!event) {
+                    event.reset(new LogEvent);
+                }
+                event->reset(logger, level, file, line);
+                return event;
+            }
+
+            void LogEvent::reset(std::shared_ptr<Logger> logger, LogLevel::Level level
+                        ,const char* file, int32_t line) {
+                m_file = file;
+                m_line = line;
+                m_elapse = 0;
+                m_threadId = GetThreadId();
+                m_fiberId = GetFiberId();
+                m_time = GetCoarseTime();
+                m_threadName.assign(Thread::GetName());
+                m_logger = std::move(logger);
+                m_level = level;
+                //保留缓冲区, 只清空内容和错误状态
+                m_ss.str(std::string());
+                m_ss.clear();
+            }
+
             LogEventWrap::LogEventWrap(LogEvent::ptr e)
                 :m_event(e) {
             }
 
             LogEventWrap::~LogEventWrap() {
-                GET_Manager->log(m_event, m_event->getLogger()->getName());
+                //事件里已经带了logger，不用再按名字查一遍
+                m_event->getLogger()->log(m_event->getLevel(), m_event);
             }
 
             std::stringstream& LogEventWrap::getSS() {
@@ -77,18 +141,17 @@ namespace frb{
 
             void Logger::log(LogLevel::Level level, LogEvent::ptr event ){              
                 if(level <= m_level){
-                    auto self = shared_from_this();
-
-                    //不能同时向logger里写日志
-                    MutexType::Lock lock(m_mutex);
+                    //无锁拿到appender快照，并发写日志的线程之间不再争logger的锁
+                    auto appenders = m_appenders.get();
 
                     //这里有个细节没完善：如果logger没有appender，直接向root写（root自带一个stdappender）
-                    if(m_appenders.empty()){
+                    if(appenders->empty()){
                         if(m_root){
                             m_root->log(level, event);
                         }
                     } else {
-                        for(auto& apd : m_appenders){                    
+                        auto self = shared_from_this();
+                        for(auto& apd : *appenders){                    
                             apd->log(self, level, event);
                         }
                     }
@@ -98,22 +161,37 @@ namespace frb{
             
             void Logger::addAppender(LogAppender::ptr appender){
                 
-                //不能同时向logger中添加appender（emplace_back不是原子操作吧..）
+                //m_formatter 可能同时被修改
                 MutexType::Lock lock(m_mutex);
                 if(!appender->getFormatter()){
                     appender->m_logformatter = m_formatter;
                 }
-                m_appenders.emplace_back(appender);
+                m_appenders.update([&appender](std::vector<LogAppender::ptr>& apds){
+                    apds.push_back(appender);
+                    return true;
+                });
             }
             
             void Logger::delAppender(LogAppender::ptr appender){
-                MutexType::Lock lock(m_mutex);
-                for(auto it = m_appenders.begin(); it != m_appenders.end(); ++it){
-                    if(*it == appender){
-                        m_appenders.erase(it);
-                        break;
+                m_appenders.update([&appender](std::vector<LogAppender::ptr>& apds){
+                    for(auto it = apds.begin(); it != apds.end(); ++it){
+                        if(*it == appender){
+                            apds.erase(it);
+                            return true;
+                        }
                     }
-                }
+                    return false;
+                });
+            }
+
+            void Logger::clearAppenders() {
+                m_appenders.update([](std::vector<LogAppender::ptr>& apds){
+                    if(apds.empty()) {
+                        return false;
+                    }
+                    apds.clear();
+                    return true;
+                });
             }
 
             void Logger::setFormatter(LogFormatter::ptr val) {
@@ -123,7 +201,9 @@ namespace frb{
                 m_formatter = val; 
 
                 //当 appender 没有formatter时，使用logger的formatter
-                for(auto& i : m_appenders) {
+                //快照放在局部变量里, 循环期间不会被释放
+                auto appenders = m_appenders.get();
+                for(auto& i : *appenders) {
                     //这个锁有必要吗？ 
                     MutexType::Lock ll(i->m_mutex);   
                     if(!i->m_hasFormatter) {
@@ -162,7 +242,18 @@ namespace frb{
                     node["formatter"] = m_formatter->getPattern();
                 }
 
-                for(auto &i : m_appenders){
+                if(m_rateLimit) {
+                    node["rate_limit"] = m_rateLimit;
+                    if(m_rateBurst) {
+                        node["burst"] = m_rateBurst;
+                    }
+                }
+                if(m_sample > 1) {
+                    node["sample"] = m_sample;
+                }
+
+                auto appenders = m_appenders.get();
+                for(auto &i : *appenders){
                     node["appenders"].push_back(YAML::Load(i->toYamlString()));
                 }
 
@@ -173,6 +264,123 @@ namespace frb{
 
             }
 
+            //所有调用点的LogLimiter, 在第一个LogLimiter构造时创建, 最后一个析构之后才销毁
+            static Mutex& GetLimiterMutex() {
+                static Mutex s_mutex;
+                return s_mutex;
+            }
+
+            static std::set<LogLimiter*>& GetLimiters() {
+                static std::set<LogLimiter*> s_limiters;
+                return s_limiters;
+            }
+
+            LogLimiter::LogLimiter(const Logger::ptr& logger, LogLevel::Level level
+                        ,const char* file, int32_t line
+                        ,uint32_t rate, uint32_t burst, uint32_t sample)
+                :m_logger(logger)
+                ,m_level(level)
+                ,m_file(file)
+                ,m_line(line)
+                ,m_rate(rate)
+                ,m_burst(burst)
+                ,m_sample(sample) {
+                Mutex& mutex = GetLimiterMutex();
+                std::set<LogLimiter*>& limiters = GetLimiters();
+                Mutex::Lock lock(mutex);
+                limiters.insert(this);
+            }
+
+            LogLimiter::~LogLimiter() {
+                {
+                    Mutex::Lock lock(GetLimiterMutex());
+                    GetLimiters().erase(this);
+                }
+                flush();
+            }
+
+            bool LogLimiter::allow(const Logger::ptr& logger, LogLevel::Level level) {
+                //调用点自己指定的参数优先,否则跟随logger的配置(配置可能被热更新)
+                uint32_t sample = m_sample ? m_sample : logger->getSample();
+                uint32_t rate = m_rate ? m_rate : logger->getRateLimit();
+                uint32_t burst = m_rate ? m_burst : logger->getRateBurst();
+
+                bool pass = true;
+                uint64_t now = 0;
+                if(sample > 1 && m_count.fetch_add(1, std::memory_order_relaxed) % sample != 0) {
+                    pass = false;
+                }
+                if(pass && rate) {
+                    now = GetCurrentMS();
+                    pass = takeToken(rate, burst ? burst : rate, now);
+                }
+                if(!pass) {
+                    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                if(m_suppressed.load(std::memory_order_relaxed) == 0) {
+                    return true;
+                }
+                //有被丢弃的日志,最多每秒汇总一次
+                if(!now) {
+                    now = GetCurrentMS();
+                }
+                uint64_t last = m_lastReport.load(std::memory_order_relaxed);
+                if(now - last < 1000
+                        || !m_lastReport.compare_exchange_strong(last, now)) {
+                    return true;
+                }
+                uint64_t n = m_suppressed.exchange(0, std::memory_order_relaxed);
+                if(n) {
+                    report(logger, level, n);
+                }
+                return true;
+            }
+
+            void LogLimiter::flush() {
+                uint64_t n = m_suppressed.exchange(0, std::memory_order_relaxed);
+                if(n) {
+                    m_lastReport.store(GetCurrentMS(), std::memory_order_relaxed);
+                    report(m_logger, m_level, n);
+                }
+            }
+
+            void LogLimiter::FlushAll() {
+                //汇总写日志时可能构造新的LogLimiter, 不持锁输出
+                std::vector<LogLimiter*> limiters;
+                {
+                    Mutex::Lock lock(GetLimiterMutex());
+                    limiters.assign(GetLimiters().begin(), GetLimiters().end());
+                }
+                for(auto i : limiters) {
+                    i->flush();
+                }
+            }
+
+            void LogLimiter::report(const Logger::ptr& logger, LogLevel::Level level, uint64_t n) {
+                LogEvent::ptr event = LogEvent::Create(logger, level, m_file, m_line);
+                event->getSS() << "suppressed " << n << " log records at " << m_file << ":" << m_line;
+                logger->log(level, event);
+            }
+
+            bool LogLimiter::takeToken(uint32_t rate, uint32_t burst, uint64_t now) {
+                const int64_t cap = (int64_t)burst * 1000;
+                uint64_t last = m_lastRefill.load(std::memory_order_relaxed);
+                //只有抢到更新时间戳的线程负责补充令牌
+                if(now > last && m_lastRefill.compare_exchange_strong(last, now)) {
+                    //每毫秒补充rate个千分之一令牌,第一次直接装满
+                    int64_t add = last ? (int64_t)(now - last) * rate : cap;
+                    int64_t cur = m_tokens.load(std::memory_order_relaxed);
+                    while(!m_tokens.compare_exchange_weak(cur, std::min(cap, cur + add)));
+                }
+                if(m_tokens.fetch_sub(1000, std::memory_order_relaxed) >= 1000) {
+                    return true;
+                }
+                m_tokens.fetch_add(1000, std::memory_order_relaxed);
+                return false;
+            }
+
             std::string StdoutLogAppender::toYamlString()  {
 
                 //要读吗？ 只加读锁可以吗？
@@ -257,6 +465,209 @@ namespace frb{
                     return !m_filestream;
             }
             
+            MmapFileLogAppender::MmapFileLogAppender(const std::string& name, uint64_t chunk_size)
+                :m_filename(name) {
+                m_file = MappedFile::Open(name, chunk_size);
+            }
+
+            MmapFileLogAppender::MappedFile::ptr MmapFileLogAppender::MappedFile::Open(const std::string& name
+                                                                                    ,uint64_t chunk_size) {
+                int fd = open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+                struct stat st;
+                if(fd < 0 || fstat(fd, &st)) {
+                    std::cout << "MmapFileLogAppender open file=" << name
+                            << " errno=" << errno << " errstr=" << strerror(errno)
+                            << std::endl;
+                    if(fd >= 0) {
+                        close(fd);
+                    }
+                    return nullptr;
+                }
+
+                //进程内已打开的文件, 按(设备号, inode)索引; 只保存weak_ptr, 最后一个appender析构时关闭
+                static Mutex s_mutex;
+                static std::map<std::pair<dev_t, ino_t>, std::weak_ptr<MappedFile> > s_files;
+
+                Mutex::Lock lock(s_mutex);
+                auto key = std::make_pair(st.st_dev, st.st_ino);
+                ptr file = s_files[key].lock();
+                if(file) {
+                    close(fd);
+                    return file;
+                }
+                for(auto it = s_files.begin(); it != s_files.end();) {
+                    if(it->second.expired()) {
+                        it = s_files.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                file.reset(new MappedFile(name, fd, chunk_size));
+                s_files[key] = file;
+                return file;
+            }
+
+            MmapFileLogAppender::MappedFile::MappedFile(const std::string& name, int fd, uint64_t chunk_size)
+                :m_filename(name)
+                ,m_fd(fd) {
+                uint64_t page = sysconf(_SC_PAGESIZE);
+                m_chunkSize = (std::max(chunk_size, page) + page - 1) / page * page;
+                //每个打开的文件持有共享锁, 析构时据此判断自己是不是最后一个(可能在别的进程里)
+                //上一个打开者正在截断文件时会持有排他锁, 这里等它截断完再找写入位置
+                flock(m_fd, LOCK_SH);
+                m_start = findEnd(0);
+                m_cursor = m_start;
+            }
+
+            MmapFileLogAppender::MappedFile::~MappedFile() {
+                for(auto& i : m_chunks) {
+                    if(i.second->addr) {
+                        msync(i.second->addr, m_chunkSize, MS_ASYNC);
+                        munmap(i.second->addr, m_chunkSize);
+                    }
+                    delete i.second;
+                }
+                //去掉预分配但没有用到的部分; 文件还被别的打开者持有时不动文件, 由最后一个截断
+                //(异常退出留下的0字节由下次打开时的findEnd跳过)
+                if(flock(m_fd, LOCK_EX | LOCK_NB) == 0) {
+                    uint64_t end = std::max<uint64_t>(m_cursor, findEnd(m_cursor));
+                    struct stat st;
+                    if(fstat(m_fd, &st) == 0 && (uint64_t)st.st_size > end
+                            && ftruncate(m_fd, end)) {
+                        std::cout << "MmapFileLogAppender ftruncate file=" << m_filename
+                                << " errno=" << errno << std::endl;
+                    }
+                }
+                close(m_fd);
+            }
+
+            uint64_t MmapFileLogAppender::MappedFile::findEnd(uint64_t floor) {
+                struct stat st;
+                if(fstat(m_fd, &st)) {
+                    return floor;
+                }
+                //上次没有正常析构时, 文件末尾是预分配出来的0字节
+                uint64_t end = st.st_size;
+                char buf[4096];
+                while(end > floor) {
+                    size_t n = std::min<uint64_t>(end - floor, sizeof(buf));
+                    if(pread(m_fd, buf, n, end - n) != (ssize_t)n) {
+                        break;
+                    }
+                    size_t i = n;
+                    while(i > 0 && buf[i - 1] == '\0') {
+                        --i;
+                    }
+                    if(i > 0) {
+                        end = end - n + i;
+                        break;
+                    }
+                    end -= n;
+                }
+                return std::max(end, floor);
+            }
+
+            MmapFileLogAppender::Chunk* MmapFileLogAppender::MappedFile::getChunk(uint64_t idx) {
+                Chunk* c = m_cur.load(std::memory_order_acquire);
+                if(c && c->index == idx) {
+                    return c;
+                }
+
+                ChunkMutexType::Lock lock(m_chunkMutex);
+                auto it = m_chunks.find(idx);
+                if(it != m_chunks.end()) {
+                    return it->second;
+                }
+
+                uint64_t offset = idx * m_chunkSize;
+                if(fallocate(m_fd, 0, offset, m_chunkSize)) {
+                    //文件系统不支持fallocate时退化为ftruncate扩展文件
+                    struct stat st;
+                    if(fstat(m_fd, &st) || ((uint64_t)st.st_size < offset + m_chunkSize
+                                && ftruncate(m_fd, offset + m_chunkSize))) {
+                        std::cout << "MmapFileLogAppender extend file=" << m_filename
+                                << " errno=" << errno << " errstr=" << strerror(errno)
+                                << std::endl;
+                        return nullptr;
+                    }
+                }
+                void* addr = mmap(nullptr, m_chunkSize, PROT_READ | PROT_WRITE
+                                    ,MAP_SHARED, m_fd, offset);
+                if(addr == MAP_FAILED) {
+                    std::cout << "MmapFileLogAppender mmap file=" << m_filename
+                            << " errno=" << errno << " errstr=" << strerror(errno)
+                            << std::endl;
+                    return nullptr;
+                }
+
+                c = new Chunk;
+                c->index = idx;
+                c->addr = (char*)addr;
+                //第一块里打开文件前已有的内容算作已写完
+                c->committed = offset < m_start ? m_start - offset : 0;
+                m_chunks[idx] = c;
+
+                Chunk* cur = m_cur.load(std::memory_order_relaxed);
+                if(!cur || cur->index < idx) {
+                    m_cur.store(c, std::memory_order_release);
+                }
+                return c;
+            }
+
+            void MmapFileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
+                if(level > m_level || !m_file) {
+                    return;
+                }
+                //格式化不需要持锁, 只在取formatter时短暂加锁
+                std::string str = getFormatter()->format(logger, level, event);
+                if(str.empty()) {
+                    return;
+                }
+
+                m_file->write(str.data(), str.size());
+            }
+
+            void MmapFileLogAppender::MappedFile::write(const char* p, size_t left) {
+                //预留空间, 一条日志可能跨越两个块
+                uint64_t off = m_cursor.fetch_add(left, std::memory_order_relaxed);
+                while(left > 0) {
+                    Chunk* c = getChunk(off / m_chunkSize);
+                    if(!c) {
+                        return;
+                    }
+                    uint64_t pos = off % m_chunkSize;
+                    size_t n = std::min<uint64_t>(left, m_chunkSize - pos);
+                    memcpy(c->addr + pos, p, n);
+
+                    //最后一个写完这一块的线程负责解除映射
+                    if(c->committed.fetch_add(n, std::memory_order_acq_rel) + n == m_chunkSize) {
+                        ChunkMutexType::Lock lock(m_chunkMutex);
+                        msync(c->addr, m_chunkSize, MS_ASYNC);
+                        munmap(c->addr, m_chunkSize);
+                        c->addr = nullptr;
+                    }
+                    off += n;
+                    p += n;
+                    left -= n;
+                }
+            }
+
+            std::string MmapFileLogAppender::toYamlString()  {
+                MutexType::Lock lock(m_mutex);
+                YAML::Node node;
+                node["type"] = "MmapFileLogAppender";
+                node["file"] = m_filename;
+                if(m_level != LogLevel::UNKNOW) {
+                    node["level"] = LogLevel::ToString(m_level);
+                }
+                if(m_hasFormatter ) {
+                    node["formatter"] = m_logformatter->getPattern();
+                }
+                std::stringstream ss;
+                ss << node;
+                return ss.str();
+            }
+
             class MessageFormatItem : public LogFormatter::FormatItem {
                 public:
                     MessageFormatItem(const std::string& str = "") {}
@@ -524,23 +935,34 @@ namespace frb{
               m_root->setLevel(LogLevel::ERROR);
               m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
               
-              //这里为什么不加锁。是因为logmanager只会构造一次吗
-              m_loggers[m_root->getName()] = m_root;
+              m_loggers.update([this](LoggerMap& loggers){
+                  loggers[m_root->getName()] = m_root;
+                  return true;
+              });
             }
 
             Logger::ptr LogManager::getLogger(const std::string& name){       
                 
-                //读 写 m_loggers
-                MutexType::Lock lock(m_mutex);
-                auto it = m_loggers.find(name);
-
-                if(it != m_loggers.end()){
+                //绝大多数情况logger已经存在，直接在快照里无锁查找
+                auto loggers = m_loggers.get();
+                auto it = loggers->find(name);
+                if(it != loggers->end()){
                     return it->second;
                 }
 
-                Logger::ptr logger(new Logger(name));
-                logger->m_root = m_root;
-                m_loggers[name] = logger;
+                Logger::ptr logger;
+                m_loggers.update([this, &name, &logger](LoggerMap& loggers){
+                    //等锁期间可能已经被其它线程创建
+                    auto it = loggers.find(name);
+                    if(it != loggers.end()){
+                        logger = it->second;
+                        return false;
+                    }
+                    logger.reset(new Logger(name));
+                    logger->m_root = m_root;
+                    loggers[name] = logger;
+                    return true;
+                });
 
                 return logger;
             };
@@ -548,10 +970,9 @@ namespace frb{
 
             std::string LogManager::toYamlString() {
                 
-                //要读m_loggers
-                MutexType::Lock lock(m_mutex);
                 YAML::Node node;
-                for(auto &i : m_loggers){
+                auto loggers = m_loggers.get();
+                for(auto &i : *loggers){
                     node.push_back(YAML::Load((i.second)->toYamlString()));
                 }
 
@@ -566,7 +987,7 @@ namespace frb{
 
 
             struct LogAppenderDefine {
-                int type = 0; //1 File, 2 Stdout
+                int type = 0; //1 File, 2 Stdout, 3 MmapFile
                 LogLevel::Level level = LogLevel::UNKNOW;
                 std::string formatter;
                 std::string file;
@@ -585,6 +1006,11 @@ namespace frb{
                 std::string name;
                 LogLevel::Level level = LogLevel::UNKNOW;
                 std::string formatter;
+                //每个调用点每秒最多输出的条数, 0不限流
+                uint32_t rate_limit = 0;
+                uint32_t burst = 0;
+                //每个调用点每sample条输出1条
+                uint32_t sample = 0;
                 std::vector<LogAppenderDefine> appenders;
 
 
@@ -594,7 +1020,10 @@ namespace frb{
                     return name == other.name
                         && level == other.level
                         && formatter == other.formatter
-                        && appenders == appenders;
+                        && rate_limit == other.rate_limit
+                        && burst == other.burst
+                        && sample == other.sample
+                        && appenders == other.appenders;
                 }
 
 
@@ -606,12 +1035,11 @@ namespace frb{
 
             };
 
-            //类型装换特化：（YAML string 到 LogDefine）
+            //类型装换特化：（YAML::Node 到 LogDefine）, 加载配置时不用再转成字符串
             template<>
-            class LexicalCast<std::string, LogDefine> {
+            class YamlCast<LogDefine> {
             public:
-                LogDefine operator()(const std::string& v) {
-                    YAML::Node n = YAML::Load(v);
+                LogDefine operator()(const YAML::Node& n) {
                     LogDefine ld;
                     if(!n["name"].IsDefined()) {
                         std::cout << "log config error: name is null, " << n
@@ -623,6 +1051,15 @@ namespace frb{
                     if(n["formatter"].IsDefined()) {
                         ld.formatter = n["formatter"].as<std::string>();
                     }
+                    if(n["rate_limit"].IsDefined()) {
+                        ld.rate_limit = n["rate_limit"].as<uint32_t>();
+                    }
+                    if(n["burst"].IsDefined()) {
+                        ld.burst = n["burst"].as<uint32_t>();
+                    }
+                    if(n["sample"].IsDefined()) {
+                        ld.sample = n["sample"].as<uint32_t>();
+                    }
 
                     if(n["appenders"].IsDefined()) {
                         //std::cout << "==" << ld.name << " = " << n["appenders"].size() << std::endl;
@@ -648,6 +1085,17 @@ namespace frb{
                                 if(a["formatter"].IsDefined()) {
                                     lad.formatter = a["formatter"].as<std::string>();
                                 }
+                            } else if(type == "MmapFileLogAppender") {
+                                lad.type = 3;
+                                if(!a["file"].IsDefined()) {
+                                    std::cout << "log config error: mmapfileappender file is null, " << a
+                                        << std::endl;
+                                    continue;
+                                }
+                                lad.file = a["file"].as<std::string>();
+                                if(a["formatter"].IsDefined()) {
+                                    lad.formatter = a["formatter"].as<std::string>();
+                                }
                             } else if(type == "StdoutLogAppender") {
                                 lad.type = 2;
                                 if(a["formatter"].IsDefined()) {
@@ -666,6 +1114,15 @@ namespace frb{
                 }
             };
 
+            //类型装换特化：（YAML string 到 LogDefine）
+            template<>
+            class LexicalCast<std::string, LogDefine> {
+            public:
+                LogDefine operator()(const std::string& v) {
+                    return YamlCast<LogDefine>()(YAML::Load(v));
+                }
+            };
+
             //类型装换特化：（YAML string 到 LogDefine）
             template<>
             class LexicalCast<LogDefine, std::string> {
@@ -679,6 +1136,15 @@ namespace frb{
                     if(!i.formatter.empty()) {
                         n["formatter"] = i.formatter;
                     }
+                    if(i.rate_limit) {
+                        n["rate_limit"] = i.rate_limit;
+                    }
+                    if(i.burst) {
+                        n["burst"] = i.burst;
+                    }
+                    if(i.sample) {
+                        n["sample"] = i.sample;
+                    }
 
                     for(auto& a : i.appenders) {
                         YAML::Node na;
@@ -687,6 +1153,9 @@ namespace frb{
                             na["file"] = a.file;
                         } else if(a.type == 2) {
                             na["type"] = "StdoutLogAppender";
+                        } else if(a.type == 3) {
+                            na["type"] = "MmapFileLogAppender";
+                            na["file"] = a.file;
                         }
                         if(a.level != LogLevel::UNKNOW) {
                             na["level"] = LogLevel::ToString(a.level);
@@ -736,6 +1205,8 @@ namespace frb{
                         }
                         
                         logger->setLevel(i.level);
+                        logger->setRateLimit(i.rate_limit, i.burst);
+                        logger->setSample(i.sample);
 
                         if(!i.formatter.empty()) {
                             logger->setFormatter(i.formatter);
@@ -750,6 +1221,8 @@ namespace frb{
                                 ap.reset(new FileLogAppender(a.file));
                             } else if(a.type == 2) {
                                 ap.reset(new StdoutLogAppender);
+                            } else if(a.type == 3) {
+                                ap.reset(new MmapFileLogAppender(a.file));
                             }
                             
                             
@@ -775,6 +1248,8 @@ namespace frb{
                             //删除logger
                             auto logger = GET_LOG_NAME(i.name);
                             logger->setLevel((LogLevel::Level)0);
+                            logger->setRateLimit(0);
+                            logger->setSample(0);
                             logger->clearAppenders();
                         }
                     }
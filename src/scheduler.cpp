@@ -10,6 +10,8 @@ namespace frb{
     static thread_local Scheduler* t_scheduler = nullptr;
     //当前调度协程
     static thread_local Fiber* t_scheduler_fiber = nullptr;
+    //当前执行的任务绑定的线程
+    static thread_local int t_task_thread = -1;
 
     Scheduler::Scheduler(size_t threads , bool use_caller , const std::string& name )
         : m_name(name) {
@@ -54,6 +56,10 @@ namespace frb{
         return t_scheduler_fiber;
     }
 
+    int Scheduler::GetTaskThread(){
+        return t_task_thread;
+    }
+
     void Scheduler::start(){
         MutexType::Lock lock(m_mutex);
 
@@ -67,6 +73,10 @@ namespace frb{
             m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this)
                                 , m_name + "_" + std::to_string(i)));
             m_threadIds.push_back(m_threads[i]->getId());
+            m_workerIds.push_back(m_threads[i]->getId());
+        }
+        if(m_workerIds.empty() && m_rootThread != -1) {
+            m_workerIds.push_back(m_rootThread);
         }
     }
 
@@ -130,6 +140,21 @@ namespace frb{
         LOG_INFO_STREAM(g_logger) << "tickle";
     }
 
+    void Scheduler::tickle(int thread){
+        tickle();
+    }
+
+    void Scheduler::notify(bool need_tickle, int thread){
+        if(thread != -1) {
+            //绑定到当前线程的任务, 本线程回到调度循环时自然会取到
+            if(thread != frb::GetThreadId()) {
+                tickle(thread);
+            }
+        } else if(need_tickle) {
+            tickle();
+        }
+    }
+
     /**
      *  @brief 线程开始调度，即找到一个合适的任务开始执行
     */
@@ -156,10 +181,10 @@ namespace frb{
                 auto it = m_fibers.begin();
                 while(it != m_fibers.end()){
                     //协程有期望的线程号，但不是当前线程
+                    //入队时已经唤醒过目标线程, 这里不再tickle, 否则唤醒的多半又是别的空闲线程
                     if(it->thread != -1 &&
                         it->thread != frb::GetThreadId()) {
                             ++it;
-                            tickle_me = true;
                             continue;
                         }
 
@@ -195,11 +220,13 @@ namespace frb{
                 task.fiber->getState() != Fiber::TERM
                 && task.fiber->getState() != Fiber::EXCEPT)){
 
+                t_task_thread = task.thread;
                 task.fiber->swapIn();
+                t_task_thread = -1;
                 --m_activeThreadCount;
 
                 if(task.fiber->getState() == Fiber::READY){
-                    schedule(task.fiber);
+                    schedule(task.fiber, task.thread);
                 } else if(task.fiber->getState() != Fiber::TERM
                     && task.fiber->getState() != Fiber::EXCEPT) {
                     task.fiber->m_state = Fiber::HOLD;
@@ -213,11 +240,14 @@ namespace frb{
                     cb_fiber.reset(new Fiber(task.cb));
                 }
 
+                int thread = task.thread;
                 task.reset();
+                t_task_thread = thread;
                 cb_fiber->swapIn();
+                t_task_thread = -1;
                 --m_activeThreadCount;
                 if(cb_fiber->getState() == Fiber::READY) {
-                    schedule(cb_fiber);
+                    schedule(cb_fiber, thread);
                     cb_fiber.reset();
                 } else if(cb_fiber->getState() == Fiber::EXCEPT
                         || cb_fiber->getState() == Fiber::TERM) {
@@ -5,6 +5,7 @@
 #include "../include/macro.h"
 #include "../include/hook.h"
 #include <limits.h>
+#include <linux/filter.h>
 
 namespace frb{
 
@@ -116,17 +117,83 @@ bool Socket::setOption(int level, int option, const void* result, socklen_t len)
     return true;
 }
 
+/**
+ * @brief 按协议簇创建空地址, 用来接收accept/getpeername/getsockname的结果
+ */
+static Address::ptr NewAddress(int family) {
+    switch(family) {
+        case AF_INET:
+            return Address::ptr(new IPv4Address());
+        case AF_INET6:
+            return Address::ptr(new IPv6Address());
+        case AF_UNIX:
+            return Address::ptr(new UnixAddress());
+        default:
+            return Address::ptr(new UnknownAddress(family));
+    }
+}
+
 Socket::ptr Socket::accept() {
-    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
-    int newsock = ::accept(m_sock, nullptr, nullptr);
+    return acceptOne(true);
+}
+
+size_t Socket::accept(std::vector<Socket::ptr>& clients, size_t max) {
+    if(max == 0) {
+        return 0;
+    }
+    Socket::ptr client = acceptOne(true);
+    if(!client) {
+        return 0;
+    }
+    clients.push_back(client);
+    size_t count = 1;
+    //监听socket不是hook管理的非阻塞socket时, 不等待的accept会阻塞, 只取一个
+    FdCtx::ptr ctx = FdMgr::GetInstance()->get(m_sock);
+    if(!ctx || !ctx->getSysNonblock() || ctx->isClose()) {
+        return count;
+    }
+    while(count < max) {
+        client = acceptOne(false);
+        if(!client) {
+            break;
+        }
+        clients.push_back(client);
+        ++count;
+    }
+    return count;
+}
+
+Socket::ptr Socket::acceptOne(bool wait) {
+    //对端地址由accept4直接填进Address, 不再getpeername;
+    //SOCK_NONBLOCK让hook登记FdCtx时不用再fcntl
+    Address::ptr remote = NewAddress(m_family);
+    socklen_t addrlen = remote->getAddrLen();
+    int newsock = -1;
+    if(wait) {
+        newsock = ::accept4(m_sock, remote->getAddr(), &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    } else {
+        //监听socket已是非阻塞, 直接调系统函数, 取空时不注册事件也不挂起
+        newsock = accept4_f(m_sock, remote->getAddr(), &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(newsock >= 0) {
+            FdMgr::GetInstance()->addSocket(newsock, true);
+        }
+    }
     if(newsock == -1) {
-        LOG_ERROR_STREAM(g_logger) << "accept(" << m_sock << ") errno="
-            << errno << " errstr=" << strerror(errno);
+        if(wait || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            LOG_ERROR_STREAM(g_logger) << "accept(" << m_sock << ") errno="
+                << errno << " errstr=" << strerror(errno);
+        }
         return nullptr;
     }
+    if(m_family == AF_UNIX) {
+        std::static_pointer_cast<UnixAddress>(remote)->setAddrLen(addrlen);
+    }
+    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
     if(sock->init(newsock)) {
+        sock->m_remoteAddress = remote;
         return sock;
     }
+    ::close(newsock);
     return nullptr;
 }
 
@@ -135,9 +202,8 @@ bool Socket::init(int sock) {
     if(ctx && ctx->isSocket() && !ctx->isClose()) {
         m_sock = sock;
         m_isConnected = true;
-        initSock();
-        getLocalAddress();
-        getRemoteAddress();
+        //accept出的socket从监听socket继承TCP_NODELAY, 不再setsockopt;
+        //本地地址用到时再getsockname
         return true;
     }
     return false;
@@ -229,6 +295,33 @@ bool Socket::connect(const Address::ptr addr, uint64_t timeout_ms) {
     return true;
 }
 
+bool Socket::setReusePort() {
+    if(!isValid()) {
+        newSock();
+        if(!isValid()) {
+            return false;
+        }
+    }
+    int val = 1;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
+bool Socket::attachReusePortCpuBpf(uint32_t groups) {
+    if(!isValid() || groups == 0) {
+        return false;
+    }
+    //A = 收包CPU; A = A % groups; return A
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, groups },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    return setOption(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
 bool Socket::listen(int backlog) {
     if(!isValid()) {
         LOG_ERROR_STREAM(g_logger) << "listen error sock=-1";
@@ -339,21 +432,7 @@ Address::ptr Socket::getRemoteAddress() {
         return m_remoteAddress;
     }
 
-    Address::ptr result;
-    switch(m_family) {
-        case AF_INET:
-            result.reset(new IPv4Address());
-            break;
-        case AF_INET6:
-            result.reset(new IPv6Address());
-            break;
-        case AF_UNIX:
-            result.reset(new UnixAddress());
-            break;
-        default:
-            result.reset(new UnknownAddress(m_family));
-            break;
-    }
+    Address::ptr result = NewAddress(m_family);
     socklen_t addrlen = result->getAddrLen();
     if(getpeername(m_sock, result->getAddr(), &addrlen)) {
         //SYLAR_LOG_ERROR(g_logger) << "getpeername error sock=" << m_sock
@@ -373,21 +452,7 @@ Address::ptr Socket::getLocalAddress() {
         return m_localAddress;
     }
 
-    Address::ptr result;
-    switch(m_family) {
-        case AF_INET:
-            result.reset(new IPv4Address());
-            break;
-        case AF_INET6:
-            result.reset(new IPv6Address());
-            break;
-        case AF_UNIX:
-            result.reset(new UnixAddress());
-            break;
-        default:
-            result.reset(new UnknownAddress(m_family));
-            break;
-    }
+    Address::ptr result = NewAddress(m_family);
     socklen_t addrlen = result->getAddrLen();
     if(getsockname(m_sock, result->getAddr(), &addrlen)) {
         LOG_ERROR_STREAM(g_logger) << "getsockname error sock=" << m_sock
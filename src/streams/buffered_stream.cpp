@@ -0,0 +1,144 @@
+#include "../../include/streams/buffered_stream.h"
+
+namespace frb{
+
+BufferedStream::BufferedStream(Stream::ptr stream, size_t read_size, size_t write_size)
+    :m_stream(stream)
+    ,m_readSize(read_size ? read_size : 16 * 1024)
+    ,m_writeSize(write_size ? write_size : 16 * 1024)
+    ,m_rbuf(new ByteArray)
+    ,m_wbuf(new ByteArray) {
+    //缓冲的节点clear后保留, 稳态下不再申请内存
+    m_rbuf->setKeepNodes(m_readSize / m_rbuf->getBaseSize() + 1);
+    m_wbuf->setKeepNodes(m_writeSize / m_wbuf->getBaseSize() + 1);
+}
+
+BufferedStream::~BufferedStream() {
+    flush();
+}
+
+int BufferedStream::fill() {
+    if(m_flushBeforeRead && flush() < 0) {
+        return -1;
+    }
+    if(m_rbuf->getReadSize() == 0) {
+        m_rbuf->clear();
+    }
+    //追加在未读数据之后, 读完恢复读位置
+    size_t pos = m_rbuf->getPosition();
+    m_rbuf->setPosition(m_rbuf->getSize());
+    int rt = m_stream->read(m_rbuf, m_readSize);
+    m_rbuf->setPosition(pos);
+    return rt;
+}
+
+int BufferedStream::read(void* buffer, size_t length) {
+    if(length == 0) {
+        return 0;
+    }
+    if(m_rbuf->getReadSize() == 0) {
+        if(length >= m_readSize) {
+            //大块读不经过缓冲
+            if(m_flushBeforeRead && flush() < 0) {
+                return -1;
+            }
+            return m_stream->read(buffer, length);
+        }
+        int rt = fill();
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, m_rbuf->getReadSize());
+    m_rbuf->read(buffer, len);
+    return len;
+}
+
+int BufferedStream::read(ByteArray::ptr ba, size_t length) {
+    if(length == 0) {
+        return 0;
+    }
+    if(m_rbuf->getReadSize() == 0) {
+        if(length >= m_readSize) {
+            if(m_flushBeforeRead && flush() < 0) {
+                return -1;
+            }
+            return m_stream->read(ba, length);
+        }
+        int rt = fill();
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, m_rbuf->getReadSize());
+    for(auto& i : m_rbuf->getReadIovecs(len)) {
+        ba->write(i.iov_base, i.iov_len);
+    }
+    m_rbuf->setPosition(m_rbuf->getPosition() + len);
+    return len;
+}
+
+int BufferedStream::peek(void* buffer, size_t length) {
+    while(m_rbuf->getReadSize() < length) {
+        int rt = fill();
+        if(rt < 0) {
+            return rt;
+        }
+        if(rt == 0) {
+            break;
+        }
+    }
+    size_t len = std::min(length, m_rbuf->getReadSize());
+    m_rbuf->read(buffer, len, m_rbuf->getPosition());
+    return len;
+}
+
+int BufferedStream::write(const void* buffer, size_t length) {
+    if(m_wbuf->getSize() == 0 && length >= m_writeSize) {
+        //没有积压时大块写直接交给下层流, 不拷贝
+        return m_stream->write(buffer, length);
+    }
+    m_wbuf->write(buffer, length);
+    if(m_wbuf->getSize() >= m_writeSize) {
+        int rt = flush();
+        if(rt < 0) {
+            return rt;
+        }
+    }
+    return length;
+}
+
+int BufferedStream::write(ByteArray::ptr ba, size_t length) {
+    size_t len = std::min(length, ba->getReadSize());
+    if(len == 0) {
+        return 0;
+    }
+    //整节点共享进写缓冲, 和前面积压的小块一起一次发出
+    m_wbuf->writeSlice(*ba->slice(ba->getPosition(), len));
+    ba->setPosition(ba->getPosition() + len);
+    if(m_wbuf->getSize() >= m_writeSize) {
+        int rt = flush();
+        if(rt < 0) {
+            return rt;
+        }
+    }
+    return len;
+}
+
+void BufferedStream::close() {
+    flush();
+    m_stream->close();
+}
+
+int BufferedStream::flush() {
+    size_t size = m_wbuf->getSize();
+    if(size == 0) {
+        return 0;
+    }
+    m_wbuf->setPosition(0);
+    int rt = m_stream->writeFixSize(m_wbuf, size);
+    m_wbuf->clear();
+    return rt <= 0 ? -1 : 0;
+}
+
+}
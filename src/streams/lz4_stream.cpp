@@ -0,0 +1,198 @@
+#include "../../include/streams/lz4_stream.h"
+
+#ifdef FRB_HAVE_LZ4
+
+#include <lz4.h>
+#include <string.h>
+#include "../../include/endian.h"
+#include "../../include/log.h"
+
+namespace frb{
+
+static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
+
+static const uint32_t s_stored_flag = 0x80000000u;
+static const size_t s_header_size = sizeof(uint32_t) * 2;
+
+Lz4Stream::ptr Lz4Stream::CreateCompress(Stream::ptr stream, int acceleration, size_t block_size) {
+    return Lz4Stream::ptr(new Lz4Stream(stream, true, acceleration, block_size));
+}
+
+Lz4Stream::ptr Lz4Stream::CreateDecompress(Stream::ptr stream) {
+    return Lz4Stream::ptr(new Lz4Stream(stream, false, 1, 0));
+}
+
+Lz4Stream::Lz4Stream(Stream::ptr stream, bool encode, int acceleration, size_t block_size)
+    :m_stream(stream)
+    ,m_encode(encode)
+    ,m_acceleration(acceleration < 1 ? 1 : acceleration)
+    ,m_blockSize(std::min(block_size ? block_size : 64 * 1024, (size_t)MAX_BLOCK_SIZE)) {
+    if(m_encode) {
+        m_block.reserve(m_blockSize);
+        m_buffer.resize(s_header_size + LZ4_compressBound(m_blockSize));
+    }
+}
+
+Lz4Stream::~Lz4Stream() {
+    if(m_encode && !m_closed) {
+        flush();
+    }
+}
+
+int Lz4Stream::readBlock() {
+    uint32_t header[2];
+    int rt = m_stream->readFixSize(header, sizeof(header));
+    if(rt <= 0) {
+        return rt;
+    }
+    uint32_t raw = byteswapOnLittleEndian(header[0]);
+    uint32_t len = byteswapOnLittleEndian(header[1]);
+    bool stored = raw & s_stored_flag;
+    raw &= ~s_stored_flag;
+    if(raw > MAX_BLOCK_SIZE || len > (uint32_t)LZ4_compressBound(MAX_BLOCK_SIZE)
+            || (stored && raw != len)) {
+        LOG_ERROR_STREAM(g_logger) << "Lz4Stream bad block header raw=" << raw << " len=" << len;
+        return -1;
+    }
+    m_offset = 0;
+    m_block.resize(raw);
+    if(stored) {
+        rt = m_stream->readFixSize(&m_block[0], raw);
+    } else {
+        m_buffer.resize(len);
+        rt = m_stream->readFixSize(&m_buffer[0], len);
+        if(rt > 0 && LZ4_decompress_safe(m_buffer.data(), &m_block[0], len, raw) != (int)raw) {
+            LOG_ERROR_STREAM(g_logger) << "Lz4Stream decompress fail raw=" << raw << " len=" << len;
+            return -1;
+        }
+    }
+    if(rt <= 0) {
+        //块只读了一半, 下层流提前结束也算数据损坏
+        return -1;
+    }
+    m_totalIn += s_header_size + len;
+    m_totalOut += raw;
+    return 1;
+}
+
+int Lz4Stream::read(void* buffer, size_t length) {
+    if(m_encode) {
+        return -1;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    while(m_offset == m_block.size()) {
+        int rt = readBlock();
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, m_block.size() - m_offset);
+    memcpy(buffer, m_block.data() + m_offset, len);
+    m_offset += len;
+    return len;
+}
+
+int Lz4Stream::read(ByteArray::ptr ba, size_t length) {
+    if(m_encode) {
+        return -1;
+    }
+    std::vector<iovec>& iovs = ba->getWriteIovecs(length);
+    std::vector<iovec> buffers(iovs);
+    size_t total = 0;
+    for(auto& i : buffers) {
+        int rt = read(i.iov_base, i.iov_len);
+        if(rt < 0) {
+            return rt;
+        }
+        total += rt;
+        //当前块用完就返回, 不为填满ba阻塞在下层流上
+        if((size_t)rt < i.iov_len || m_offset == m_block.size()) {
+            break;
+        }
+    }
+    if(total > 0) {
+        ba->setPosition(ba->getPosition() + total);
+    }
+    return total;
+}
+
+int Lz4Stream::write(const void* buffer, size_t length) {
+    if(!m_encode || m_closed) {
+        return -1;
+    }
+    const char* p = (const char*)buffer;
+    size_t left = length;
+    while(left > 0) {
+        size_t len = std::min(left, m_blockSize - m_block.size());
+        m_block.append(p, len);
+        p += len;
+        left -= len;
+        if(m_block.size() == m_blockSize) {
+            int rt = flush();
+            if(rt < 0) {
+                return rt;
+            }
+        }
+    }
+    return length;
+}
+
+int Lz4Stream::write(ByteArray::ptr ba, size_t length) {
+    if(!m_encode || m_closed) {
+        return -1;
+    }
+    size_t pos = ba->getPosition();
+    for(auto& i : ba->getReadIovecs(length)) {
+        int rt = write(i.iov_base, i.iov_len);
+        if(rt < 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, ba->getReadSize());
+    ba->setPosition(pos + len);
+    return len;
+}
+
+void Lz4Stream::close() {
+    if(m_encode && !m_closed) {
+        flush();
+    }
+    m_closed = true;
+    m_stream->close();
+}
+
+int Lz4Stream::flush() {
+    if(!m_encode || m_block.empty()) {
+        return 0;
+    }
+    uint32_t raw = m_block.size();
+    char* out = &m_buffer[0];
+    int len = LZ4_compress_fast(m_block.data(), out + s_header_size, raw
+                                ,m_buffer.size() - s_header_size, m_acceleration);
+    uint32_t header[2];
+    if(len <= 0 || (uint32_t)len >= raw) {
+        //压不动的块原样存放
+        memcpy(out + s_header_size, m_block.data(), raw);
+        len = raw;
+        header[0] = byteswapOnLittleEndian(raw | s_stored_flag);
+    } else {
+        header[0] = byteswapOnLittleEndian(raw);
+    }
+    header[1] = byteswapOnLittleEndian((uint32_t)len);
+    memcpy(out, header, sizeof(header));
+    m_block.clear();
+
+    int rt = m_stream->writeFixSize(out, s_header_size + len);
+    if(rt <= 0) {
+        return -1;
+    }
+    m_totalIn += raw;
+    m_totalOut += s_header_size + len;
+    return 0;
+}
+
+}
+
+#endif
@@ -1,8 +1,16 @@
-#include "../include/streams/socket_stream.h"
-#include "../include/util.h"
+#include "../../include/streams/socket_stream.h"
+#include "../../include/utils.h"
+#include "../../include/hook.h"
+#include "../../include/log.h"
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace frb{
 
+static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
+
 SocketStream::SocketStream(Socket::ptr sock, bool owner)
     :m_socket(sock)
     ,m_owner(owner) {
@@ -29,8 +37,7 @@ int SocketStream::read(ByteArray::ptr ba, size_t length) {
     if(!isConnected()) {
         return -1;
     }
-    std::vector<iovec> iovs;
-    ba->getWriteBuffers(iovs, length);
+    std::vector<iovec>& iovs = ba->getWriteIovecs(length);
     int rt = m_socket->recv(&iovs[0], iovs.size());
     if(rt > 0) {
         ba->setPosition(ba->getPosition() + rt);
@@ -38,6 +45,18 @@ int SocketStream::read(ByteArray::ptr ba, size_t length) {
     return rt;
 }
 
+int SocketStream::readSome(ByteArray::ptr ba) {
+    if(!isConnected()) {
+        return -1;
+    }
+    std::vector<iovec>& iovs = ba->getFreeIovecs();
+    int rt = m_socket->recv(&iovs[0], std::min(iovs.size(), (size_t)IOV_MAX));
+    if(rt > 0) {
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
 int SocketStream::write(const void* buffer, size_t length) {
     if(!isConnected()) {
         return -1;
@@ -49,8 +68,7 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
     if(!isConnected()) {
         return -1;
     }
-    std::vector<iovec> iovs;
-    ba->getReadBuffers(iovs, length);
+    const std::vector<iovec>& iovs = ba->getReadIovecs(length);
     int rt = m_socket->send(&iovs[0], iovs.size());
     if(rt > 0) {
         ba->setPosition(ba->getPosition() + rt);
@@ -58,6 +76,91 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
     return rt;
 }
 
+int64_t SocketStream::sendFile(int fd, off_t offset, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    size_t left = length;
+    while(left > 0) {
+        ssize_t rt = sendfile(m_socket->getSocket(), fd, &offset, left);
+        if(rt < 0) {
+            return rt;
+        }
+        if(rt == 0) {
+            break;
+        }
+        left -= rt;
+    }
+    return length - left;
+}
+
+int64_t SocketStream::pump(Stream::ptr out, uint64_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    //一次搬运的上限, 和pipe默认容量一致
+    static const size_t s_chunk = 64 * 1024;
+    uint64_t total = 0;
+    SocketStream::ptr sout = std::dynamic_pointer_cast<SocketStream>(out);
+    if(!sout) {
+        ByteArray::ptr ba(new ByteArray);
+        while(total < length) {
+            ba->clear();
+            int rt = read(ba, std::min(length - total, (uint64_t)s_chunk));
+            if(rt <= 0) {
+                return rt < 0 && !total ? (int64_t)rt : (int64_t)total;
+            }
+            ba->setPosition(0);
+            if(out->writeFixSize(ba, rt) <= 0) {
+                LOG_WARN_STREAM(g_logger) << "pump write fail, forwarded=" << total
+                    << " dropped=" << rt;
+                return total ? (int64_t)total : -1;
+            }
+            total += rt;
+        }
+        return total;
+    }
+    if(!sout->isConnected()) {
+        return -1;
+    }
+
+    //socket -> pipe -> socket, 每轮把pipe里的数据全部写出再读, 读端EAGAIN只会来自socket
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC | O_NONBLOCK)) {
+        return -1;
+    }
+    int in = m_socket->getSocket();
+    int outfd = sout->getSocket()->getSocket();
+    int64_t rt = 0;
+    while(total < length) {
+        ssize_t n = splice(in, nullptr, fds[1], nullptr
+                        ,std::min(length - total, (uint64_t)s_chunk), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(n <= 0) {
+            rt = n;
+            break;
+        }
+        while(n > 0) {
+            ssize_t w = splice(fds[0], nullptr, outfd, nullptr, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(w <= 0) {
+                //已经从本socket读出, 留在pipe里的数据发不出去了
+                LOG_WARN_STREAM(g_logger) << "pump splice to fd=" << outfd << " fail, errno=" << errno
+                    << " errstr=" << strerror(errno) << " forwarded=" << total << " dropped=" << n;
+                rt = -1;
+                break;
+            }
+            n -= w;
+            total += w;
+        }
+        if(rt < 0) {
+            break;
+        }
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+    //已经转发过数据时返回转发的长度, 调用方据此知道对端收到了多少
+    return rt < 0 && !total ? rt : (int64_t)total;
+}
+
 void SocketStream::close() {
     if(m_socket) {
         m_socket->close();
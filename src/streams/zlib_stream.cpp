@@ -0,0 +1,228 @@
+#include "../../include/streams/zlib_stream.h"
+#include "../../include/log.h"
+#include <string.h>
+
+namespace frb{
+
+static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
+
+ZlibStream::ptr ZlibStream::CreateCompress(Stream::ptr stream, Type type, int level, size_t buffer_size) {
+    ZlibStream::ptr rt(new ZlibStream(stream, true, type, level, buffer_size));
+    return rt->isValid() ? rt : nullptr;
+}
+
+ZlibStream::ptr ZlibStream::CreateDecompress(Stream::ptr stream, Type type, size_t buffer_size) {
+    ZlibStream::ptr rt(new ZlibStream(stream, false, type, Z_DEFAULT_COMPRESSION, buffer_size));
+    return rt->isValid() ? rt : nullptr;
+}
+
+ZlibStream::ZlibStream(Stream::ptr stream, bool encode, Type type, int level, size_t buffer_size)
+    :m_stream(stream)
+    ,m_encode(encode)
+    ,m_bufferSize(buffer_size ? buffer_size : 64 * 1024) {
+    memset(&m_zs, 0, sizeof(m_zs));
+    m_buffer.reset(new ByteArray);
+    //缓存的节点clear后保留, 稳态下不再申请内存
+    m_buffer->setKeepNodes(m_bufferSize / m_buffer->getBaseSize() + 1);
+
+    int window_bits = 15;
+    if(type == DEFLATE) {
+        window_bits = -15;
+    } else if(type == GZIP) {
+        window_bits += 16;
+    }
+
+    int rt = 0;
+    if(m_encode) {
+        rt = deflateInit2(&m_zs, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    } else {
+        rt = inflateInit2(&m_zs, window_bits);
+    }
+    if(rt != Z_OK) {
+        LOG_ERROR_STREAM(g_logger) << "ZlibStream init fail encode=" << m_encode
+            << " type=" << type << " level=" << level << " rt=" << rt;
+        return;
+    }
+    m_valid = true;
+}
+
+ZlibStream::~ZlibStream() {
+    if(!m_valid) {
+        return;
+    }
+    if(m_encode) {
+        if(!m_finished) {
+            encodeFlush(Z_FINISH);
+            drain(true);
+        }
+        deflateEnd(&m_zs);
+    } else {
+        inflateEnd(&m_zs);
+    }
+}
+
+int ZlibStream::read(void* buffer, size_t length) {
+    if(!m_valid || m_encode) {
+        return -1;
+    }
+    if(length == 0 || m_finished) {
+        return 0;
+    }
+    m_zs.next_out = (Bytef*)buffer;
+    m_zs.avail_out = length;
+    while(m_zs.avail_out == length) {
+        if(m_buffer->getReadSize() == 0) {
+            m_buffer->clear();
+            int rt = m_stream->read(m_buffer, m_bufferSize);
+            if(rt <= 0) {
+                return rt;
+            }
+            m_buffer->setPosition(0);
+        }
+        //inflate直接读节点内存, 一次一个节点
+        const iovec& iov = m_buffer->getReadIovecs()[0];
+        m_zs.next_in = (Bytef*)iov.iov_base;
+        m_zs.avail_in = iov.iov_len;
+        int rt = inflate(&m_zs, Z_NO_FLUSH);
+        m_buffer->setPosition(m_buffer->getPosition() + iov.iov_len - m_zs.avail_in);
+        if(rt == Z_STREAM_END) {
+            m_finished = true;
+            break;
+        }
+        if(rt != Z_OK && rt != Z_BUF_ERROR) {
+            LOG_ERROR_STREAM(g_logger) << "ZlibStream inflate fail rt=" << rt
+                << " msg=" << (m_zs.msg ? m_zs.msg : "");
+            return -1;
+        }
+    }
+    return length - m_zs.avail_out;
+}
+
+int ZlibStream::read(ByteArray::ptr ba, size_t length) {
+    if(!m_valid || m_encode) {
+        return -1;
+    }
+    std::vector<iovec>& iovs = ba->getWriteIovecs(length);
+    //getWriteIovecs的结果在ba内部, 先拷出来再逐段解压
+    std::vector<iovec> buffers(iovs);
+    size_t total = 0;
+    for(auto& i : buffers) {
+        int rt = read(i.iov_base, i.iov_len);
+        if(rt < 0) {
+            return rt;
+        }
+        total += rt;
+        //段没填满或手上没有待解的输入就不再等下层流, 避免阻塞在已经读到数据的情况下
+        if((size_t)rt < i.iov_len || m_finished || m_buffer->getReadSize() == 0) {
+            break;
+        }
+    }
+    if(total > 0) {
+        ba->setPosition(ba->getPosition() + total);
+    }
+    return total;
+}
+
+int ZlibStream::write(const void* buffer, size_t length) {
+    if(!m_valid || !m_encode || m_finished) {
+        return -1;
+    }
+    int rt = encode(buffer, length);
+    if(rt < 0) {
+        return rt;
+    }
+    rt = drain(false);
+    return rt < 0 ? rt : (int)length;
+}
+
+int ZlibStream::write(ByteArray::ptr ba, size_t length) {
+    if(!m_valid || !m_encode || m_finished) {
+        return -1;
+    }
+    size_t pos = ba->getPosition();
+    //逐个节点喂给deflate, 不拼接
+    for(auto& i : ba->getReadIovecs(length)) {
+        int rt = encode(i.iov_base, i.iov_len);
+        if(rt < 0) {
+            return rt;
+        }
+    }
+    size_t len = std::min(length, ba->getReadSize());
+    ba->setPosition(pos + len);
+    int rt = drain(false);
+    return rt < 0 ? rt : (int)len;
+}
+
+void ZlibStream::close() {
+    if(m_valid && m_encode && !m_finished) {
+        encodeFlush(Z_FINISH);
+        drain(true);
+    }
+    m_finished = true;
+    m_stream->close();
+}
+
+int ZlibStream::flush() {
+    if(!m_valid || !m_encode || m_finished) {
+        return -1;
+    }
+    int rt = encodeFlush(Z_SYNC_FLUSH);
+    if(rt < 0) {
+        return rt;
+    }
+    return drain(true);
+}
+
+int ZlibStream::encode(const void* buffer, size_t length) {
+    m_zs.next_in = (Bytef*)buffer;
+    m_zs.avail_in = length;
+    while(m_zs.avail_in > 0) {
+        //deflate直接写进输出缓存的空闲节点
+        iovec& iov = m_buffer->getFreeIovecs()[0];
+        m_zs.next_out = (Bytef*)iov.iov_base;
+        m_zs.avail_out = iov.iov_len;
+        int rt = deflate(&m_zs, Z_NO_FLUSH);
+        if(rt == Z_STREAM_ERROR) {
+            LOG_ERROR_STREAM(g_logger) << "ZlibStream deflate fail rt=" << rt;
+            return -1;
+        }
+        m_buffer->setPosition(m_buffer->getPosition() + iov.iov_len - m_zs.avail_out);
+    }
+    return 0;
+}
+
+int ZlibStream::encodeFlush(int flush) {
+    m_zs.next_in = nullptr;
+    m_zs.avail_in = 0;
+    while(true) {
+        iovec& iov = m_buffer->getFreeIovecs()[0];
+        m_zs.next_out = (Bytef*)iov.iov_base;
+        m_zs.avail_out = iov.iov_len;
+        int rt = deflate(&m_zs, flush);
+        if(rt == Z_STREAM_ERROR) {
+            LOG_ERROR_STREAM(g_logger) << "ZlibStream deflate flush=" << flush << " fail rt=" << rt;
+            return -1;
+        }
+        m_buffer->setPosition(m_buffer->getPosition() + iov.iov_len - m_zs.avail_out);
+        if(flush == Z_FINISH ? rt == Z_STREAM_END : m_zs.avail_out != 0) {
+            break;
+        }
+    }
+    if(flush == Z_FINISH) {
+        m_finished = true;
+    }
+    return 0;
+}
+
+int ZlibStream::drain(bool force) {
+    size_t size = m_buffer->getSize();
+    if(size == 0 || (!force && size < m_bufferSize)) {
+        return 0;
+    }
+    m_buffer->setPosition(0);
+    int rt = m_stream->writeFixSize(m_buffer, size);
+    m_buffer->clear();
+    return rt <= 0 ? -1 : 0;
+}
+
+}
@@ -1,6 +1,8 @@
-#include "tcp_server.h"
-#include "config.h"
-#include "log.h"
+#include "../include/tcp_server.h"
+#include "../include/config.h"
+#include "../include/log.h"
+#include <string.h>
+#include <sys/socket.h>
 
 
 namespace frb{
@@ -9,7 +11,11 @@ static frb::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
     frb::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
             "tcp server read timeout");
 
-static frb::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+static frb::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+    frb::Config::Lookup("tcp_server.accept_batch", (uint32_t)64,
+            "tcp server max accepts per wakeup");
+
+static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
 
 TcpServer::TcpServer(frb::IOManager* worker,
                     frb::IOManager* io_worker,
@@ -19,7 +25,8 @@ TcpServer::TcpServer(frb::IOManager* worker,
     ,m_acceptWorker(accept_worker)
     ,m_recvTimeout(g_tcp_server_read_timeout->getValue())
     ,m_name("frb/1.0.0")
-    ,m_isStop(true) {
+    ,m_isStop(true)
+    ,m_accessLog(AccessLog::GetDefault()) {
 }
 
 TcpServer::~TcpServer() {
@@ -29,8 +36,15 @@ TcpServer::~TcpServer() {
     m_socks.clear();
 }
 
+void TcpServer::setConf(TcpServerConf::ptr v) {
+    m_conf = v;
+    if(v) {
+        setReusePort(v->reuseport, v->reuseport_cbpf);
+    }
+}
+
 void TcpServer::setConf(const TcpServerConf& v) {
-    m_conf.reset(new TcpServerConf(v));
+    setConf(std::make_shared<TcpServerConf>(v));
 }
 
 bool TcpServer::bind(frb::Address::ptr addr, bool ssl) {
@@ -44,27 +58,64 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs
                         ,std::vector<Address::ptr>& fails
                         ,bool ssl) {
     m_ssl = ssl;
-    for(auto& addr : addrs) {
-        Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        if(!sock->bind(addr)) {
-            LOG_ERROR_STREAM(g_logger) << "bind fail errno="
-                << errno << " errstr=" << strerror(errno)
-                << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
+    //没有SSL的Socket实现, 要求SSL时整体失败, 不退化成明文监听
+    if(ssl) {
+        LOG_ERROR_STREAM(g_logger) << "ssl is not supported, name=" << m_name;
+        fails.insert(fails.end(), addrs.begin(), addrs.end());
+        return false;
+    }
+    //分片监听时每个io线程一个socket
+    std::vector<int> threads(1, -1);
+    //只给一直在调度的线程建socket; use_caller时caller线程要到stop()才调度,
+    //给它建的socket上内核分过去的连接没人accept
+    if(m_reusePort && !m_ioWorker->getWorkerThreadIds().empty()) {
+        threads = m_ioWorker->getWorkerThreadIds();
+    }
+    for(auto& conf_addr : addrs) {
+        size_t group = m_socks.size();
+        Address::ptr addr = conf_addr;
+        for(auto thread : threads) {
+            //端口为0时组内第一个socket绑定后才知道端口, 其余的绑定到同一个地址
+            if(m_socks.size() > group) {
+                addr = m_socks[group]->getLocalAddress();
+            }
+            Socket::ptr sock = Socket::CreateTCP(addr);
+            if(thread != -1 && !sock->setReusePort()) {
+                LOG_ERROR_STREAM(g_logger) << "set SO_REUSEPORT fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(conf_addr);
+                break;
+            }
+            if(!sock->bind(addr)) {
+                LOG_ERROR_STREAM(g_logger) << "bind fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(conf_addr);
+                break;
+            }
+            if(!sock->listen()) {
+                LOG_ERROR_STREAM(g_logger) << "listen fail errno="
+                    << errno << " errstr=" << strerror(errno)
+                    << " addr=[" << addr->toString() << "]";
+                fails.push_back(conf_addr);
+                break;
+            }
+            m_socks.push_back(sock);
+            m_sockThreads.push_back(thread);
         }
-        if(!sock->listen()) {
-            LOG_ERROR_STREAM(g_logger) << "listen fail errno="
+        //CBPF挂在组内任一socket上即对整组生效, 失败时退回内核默认的哈希分流
+        if(m_reusePortCbpf && threads.size() > 1 && m_socks.size() - group == threads.size()
+                && !m_socks[group]->attachReusePortCpuBpf(threads.size())) {
+            LOG_WARN_STREAM(g_logger) << "attach reuseport cbpf fail errno="
                 << errno << " errstr=" << strerror(errno)
                 << " addr=[" << addr->toString() << "]";
-            fails.push_back(addr);
-            continue;
         }
-        m_socks.push_back(sock);
     }
 
     if(!fails.empty()) {
         m_socks.clear();
+        m_sockThreads.clear();
         return false;
     }
 
@@ -78,15 +129,32 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs
 }
 
 void TcpServer::startAccept(Socket::ptr sock) {
+    std::vector<Socket::ptr> clients;
+    std::vector<std::function<void()> > tasks;
+    //分片监听时accept协程绑定在所属io线程上, 新连接留在本线程处理
+    int local = Scheduler::GetTaskThread();
     while(!m_isStop) {
-        Socket::ptr client = sock->accept();
-        if(client) {
+        //一次可读事件取走一批连接, 整批一次入队, 按轮转分给io线程
+        clients.clear();
+        if(sock->accept(clients, std::max(g_tcp_server_accept_batch->getValue(), 1u)) == 0) {
+            if(m_isStop) {
+                break;
+            }
+            //EMFILE时accept会一直失败,限流避免刷屏
+            LOG_ERROR_STREAM_LIMIT(g_logger, 10) << "accept errno=" << errno
+                << " errstr=" << strerror(errno);
+            continue;
+        }
+        tasks.clear();
+        for(auto& client : clients) {
             client->setRecvTimeout(m_recvTimeout);
-            m_ioWorker->schedule(std::bind(&TcpServer::handleClient,
+            tasks.push_back(std::bind(&TcpServer::handleClient,
                         shared_from_this(), client));
+        }
+        if(local != -1) {
+            m_ioWorker->schedule(tasks.begin(), tasks.end(), local);
         } else {
-            LOG_ERROR_STREAM(g_logger) << "accept errno=" << errno
-                << " errstr=" << strerror(errno);
+            m_ioWorker->scheduleRoundRobin(tasks.begin(), tasks.end());
         }
     }
 }
@@ -96,9 +164,14 @@ bool TcpServer::start() {
         return true;
     }
     m_isStop = false;
-    for(auto& sock : m_socks) {
-        m_acceptWorker->schedule(std::bind(&TcpServer::startAccept,
-                    shared_from_this(), sock));
+    for(size_t i = 0; i < m_socks.size(); ++i) {
+        if(m_sockThreads[i] != -1) {
+            m_ioWorker->schedule(std::bind(&TcpServer::startAccept,
+                        shared_from_this(), m_socks[i]), m_sockThreads[i]);
+        } else {
+            m_acceptWorker->schedule(std::bind(&TcpServer::startAccept,
+                        shared_from_this(), m_socks[i]));
+        }
     }
     return true;
 }
@@ -107,28 +180,31 @@ void TcpServer::stop() {
     m_isStop = true;
     auto self = shared_from_this();
     m_acceptWorker->schedule([this, self]() {
+        //不能先cancelAll再close: 被唤醒的accept协程可能在两者之间又拿到EAGAIN重新注册可读事件,
+        //fd关闭后这个事件永远不会触发, IOManager停不下来。
+        //shutdown后监听socket可读, accept返回EINVAL, accept协程退出循环后释放socket
         for(auto& sock : m_socks) {
-            sock->cancelAll();
-            sock->close();
+            ::shutdown(sock->getSocket(), SHUT_RDWR);
         }
         m_socks.clear();
     });
 }
 
 void TcpServer::handleClient(Socket::ptr client) {
+    //默认实现不收发数据, 访问日志由子类在处理完请求后用logAccess记录
     LOG_INFO_STREAM(g_logger) << "handleClient: " << *client;
 }
 
-bool TcpServer::loadCertificates(const std::string& cert_file, const std::string& key_file) {
-    for(auto& i : m_socks) {
-        auto ssl_socket = std::dynamic_pointer_cast<SSLSocket>(i);
-        if(ssl_socket) {
-            if(!ssl_socket->loadCertificates(cert_file, key_file)) {
-                return false;
-            }
-        }
+void TcpServer::logAccess(Socket::ptr client, const char* method
+                          ,const char* path, size_t path_len, uint16_t status
+                          ,uint64_t bytes_in, uint64_t bytes_out, uint64_t start_us) {
+    if(!m_accessLog) {
+        return;
     }
-    return true;
+    Address::ptr addr = client->getRemoteAddress();
+    m_accessLog->log(addr ? addr->getAddr() : nullptr, method, path, path_len
+                ,status, bytes_in, bytes_out
+                ,frb::GetCurrentUS() - start_us, frb::GetFiberId());
 }
 
 std::string TcpServer::toString(const std::string& prefix) {
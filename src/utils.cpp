@@ -1,6 +1,7 @@
 
 #include <execinfo.h>
 #include <sys/time.h>
+#include <time.h>
 #include "../include/fiber.h"
 #include "../include/utils.h"
 #include "../include/log.h"
@@ -11,8 +12,22 @@ namespace frb{
 
     static frb::Logger::ptr g_logger = GET_LOG_NAME("system");
 
+    //线程ID缓存, 避免每次都陷入内核
+    static thread_local pid_t t_thread_id = 0;
+
+    //fork出的子进程里只剩调用fork的线程, 它的线程ID变了, 缓存要作废
+    struct ThreadIdForkIniter {
+        ThreadIdForkIniter() {
+            pthread_atfork(nullptr, nullptr, []() { t_thread_id = 0; });
+        }
+    };
+    static ThreadIdForkIniter s_thread_id_fork_initer;
+
     pid_t GetThreadId() {
-        return syscall(SYS_gettid);
+        if(!t_thread_id) {
+            t_thread_id = syscall(SYS_gettid);
+        }
+        return t_thread_id;
     }
 
     uint32_t GetFiberId() {
@@ -27,6 +42,18 @@ namespace frb{
         return time.tv_sec * 1000ul + time.tv_usec / 1000;
     }
 
+    uint64_t GetCurrentUS() {
+        timeval time;
+        gettimeofday(&time, 0);
+        return time.tv_sec * 1000 * 1000ul + time.tv_usec;
+    }
+
+    time_t GetCoarseTime() {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return ts.tv_sec;
+    }
+
     /**
      * @brief 获取当前的调用栈
      * @param[out] bt 保存调用栈
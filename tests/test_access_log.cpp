@@ -0,0 +1,213 @@
+#include "../include/access_log.h"
+#include "../include/log.h"
+#include "../include/utils.h"
+#include "../include/macro.h"
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+frb::Logger::ptr g_logger = GET_LOG_ROOT;
+
+static const int s_threads = 4;
+static const int s_records = 1000;
+
+static std::string read_file(const std::string& name) {
+    std::ifstream ifs(name, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+static std::vector<std::string> split(const std::string& str, char sep) {
+    std::vector<std::string> rt;
+    size_t start = 0;
+    while(true) {
+        size_t pos = str.find(sep, start);
+        rt.push_back(str.substr(start, pos - start));
+        if(pos == std::string::npos) {
+            break;
+        }
+        start = pos + 1;
+    }
+    return rt;
+}
+
+template<class T>
+static T read_raw(const std::string& data, size_t& off) {
+    T v;
+    ASSERT(off + sizeof(v) <= data.size());
+    memcpy(&v, data.data() + off, sizeof(v));
+    off += sizeof(v);
+    return v;
+}
+
+/**
+ * @brief 一条访问记录的字段
+ */
+struct Record {
+    std::string addr;
+    std::string method;
+    std::string path;
+    uint16_t status;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t latency;
+};
+
+/**
+ * @brief 解析TSV: 时间 地址:端口 方法 路径 状态码 收 发 耗时 协程ID
+ */
+static std::vector<Record> parse_tsv(const std::string& data) {
+    std::vector<Record> rt;
+    for(auto& line : split(data, '\n')) {
+        if(line.empty()) {
+            continue;
+        }
+        std::vector<std::string> f = split(line, '\t');
+        ASSERT(f.size() == 9);
+        ASSERT(f[0].size() == 19);
+        rt.push_back({f[1], f[2], f[3], (uint16_t)std::stoul(f[4])
+                      ,std::stoull(f[5]), std::stoull(f[6]), std::stoull(f[7])});
+    }
+    return rt;
+}
+
+/**
+ * @brief 按access_log.h里的二进制布局解析
+ */
+static std::vector<Record> parse_binary(const std::string& data) {
+    std::vector<Record> rt;
+    size_t off = 0;
+    while(off < data.size()) {
+        uint32_t len = read_raw<uint32_t>(data, off);
+        size_t end = off + len;
+        ASSERT(end <= data.size());
+        Record r;
+        ASSERT(read_raw<uint64_t>(data, off) > 0);
+        uint8_t family = read_raw<uint8_t>(data, off);
+        char ip[INET6_ADDRSTRLEN] = {0};
+        inet_ntop(family, data.data() + off, ip, sizeof(ip));
+        off += 16;
+        uint16_t port = read_raw<uint16_t>(data, off);
+        r.addr = std::string(ip) + ":" + std::to_string(port);
+        r.method = std::string(data.data() + off);
+        off += 8;
+        r.status = read_raw<uint16_t>(data, off);
+        r.bytes_in = read_raw<uint64_t>(data, off);
+        r.bytes_out = read_raw<uint64_t>(data, off);
+        r.latency = read_raw<uint64_t>(data, off);
+        read_raw<uint32_t>(data, off);
+        uint16_t path_len = read_raw<uint16_t>(data, off);
+        r.path = data.substr(off, path_len);
+        off += path_len;
+        ASSERT(off == end);
+        rt.push_back(r);
+    }
+    return rt;
+}
+
+static std::vector<Record> parse(const std::string& file, frb::AccessLog::Format format) {
+    std::string data = read_file(file);
+    return format == frb::AccessLog::TSV ? parse_tsv(data) : parse_binary(data);
+}
+
+/**
+ * @brief 多线程写入, 析构后读回文件, 每条记录的字段都要和写入的一致, 不丢不重
+ */
+void test_access_log(const std::string& file, frb::AccessLog::Format format) {
+    unlink(file.c_str());
+    frb::AccessLog::ptr access_log(new frb::AccessLog(file, format, 128, 100));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8080);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr.s_addr);
+
+    std::vector<frb::Thread::ptr> thrs;
+    for(int i = 0; i < s_threads; ++i) {
+        thrs.push_back(frb::Thread::ptr(new frb::Thread([access_log, &addr, i]() {
+            for(int n = 0; n < s_records; ++n) {
+                std::string path = "/index/" + std::to_string(i) + "/" + std::to_string(n);
+                access_log->log((const sockaddr*)&addr, i % 2 ? "POST" : "GET", path.c_str(), path.size()
+                            ,200 + i, n, n * 2, n * 3, frb::GetFiberId());
+            }
+        }, "access_" + std::to_string(i))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    access_log.reset();
+
+    std::vector<Record> records = parse(file, format);
+    ASSERT(records.size() == s_threads * s_records);
+    std::map<std::string, int> seen;
+    for(auto& r : records) {
+        std::vector<std::string> p = split(r.path, '/');
+        ASSERT(p.size() == 4 && p[1] == "index");
+        int i = std::stoi(p[2]);
+        uint64_t n = std::stoull(p[3]);
+        ASSERT(r.addr == "127.0.0.1:8080");
+        ASSERT(r.method == (i % 2 ? "POST" : "GET"));
+        ASSERT(r.status == 200 + i);
+        ASSERT(r.bytes_in == n && r.bytes_out == n * 2 && r.latency == n * 3);
+        ++seen[r.path];
+    }
+    ASSERT(seen.size() == s_threads * s_records);
+    unlink(file.c_str());
+    LOG_INFO_STREAM(g_logger) << "test_access_log " << file << " ok";
+}
+
+/**
+ * @brief 刷新线程不靠轮询: 批次写满立即写出, 没写满的按刷新间隔写出, 析构不等刷新间隔
+ */
+void test_access_log_wakeup() {
+    const std::string file = "./access_wakeup.log";
+    unlink(file.c_str());
+
+    //刷新间隔很长, 写满批次时被唤醒(同时写出其它没写满的批次)
+    frb::AccessLog::ptr access_log(new frb::AccessLog(file, frb::AccessLog::TSV, 16, 60 * 1000));
+    for(int n = 0; n < 15; ++n) {
+        access_log->log(nullptr, "GET", "/full", 5, 200, 0, 0, 0, 0);
+    }
+    usleep(100 * 1000);
+    ASSERT(read_file(file).empty());
+    for(int n = 15; n < 20; ++n) {
+        access_log->log(nullptr, "GET", "/full", 5, 200, 0, 0, 0, 0);
+    }
+    size_t count = 0;
+    for(int i = 0; i < 100 && count < 16; ++i) {
+        usleep(10 * 1000);
+        count = parse_tsv(read_file(file)).size();
+    }
+    ASSERT(count >= 16);
+
+    uint64_t start = frb::GetCurrentMS();
+    access_log.reset();
+    ASSERT(frb::GetCurrentMS() - start < 1000);
+    std::vector<Record> records = parse_tsv(read_file(file));
+    ASSERT(records.size() == 20);
+    ASSERT(records[0].addr == "-:0");
+    unlink(file.c_str());
+
+    //没写满的批次按刷新间隔写出
+    access_log.reset(new frb::AccessLog(file, frb::AccessLog::TSV, 16, 50));
+    access_log->log(nullptr, "GET", "/interval", 9, 200, 0, 0, 0, 0);
+    count = 0;
+    for(int i = 0; i < 100 && count < 1; ++i) {
+        usleep(10 * 1000);
+        count = parse_tsv(read_file(file)).size();
+    }
+    ASSERT(count == 1);
+    access_log.reset();
+    unlink(file.c_str());
+    LOG_INFO_STREAM(g_logger) << "test_access_log_wakeup ok";
+}
+
+int main(int argc, char** argv) {
+    test_access_log("./access.log", frb::AccessLog::TSV);
+    test_access_log("./access.bin", frb::AccessLog::BINARY);
+    test_access_log_wakeup();
+    return 0;
+}
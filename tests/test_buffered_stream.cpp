@@ -0,0 +1,195 @@
+#include "../include/streams/buffered_stream.h"
+#include "../include/log.h"
+#include "../include/macro.h"
+#include "../include/utils.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string.h>
+
+frb::Logger::ptr g_logger = GET_LOG_ROOT;
+
+/**
+ * @brief fd上的Stream, 统计系统调用次数
+ */
+class FdStream : public frb::Stream {
+public:
+    typedef std::shared_ptr<FdStream> ptr;
+    FdStream(int fd) :m_fd(fd) {}
+
+    int read(void* buffer, size_t length) override {
+        ++m_syscalls;
+        return ::read(m_fd, buffer, length);
+    }
+
+    int read(frb::ByteArray::ptr ba, size_t length) override {
+        std::vector<iovec>& iovs = ba->getWriteIovecs(length);
+        ++m_syscalls;
+        int rt = ::readv(m_fd, &iovs[0], iovs.size());
+        if(rt > 0) {
+            ba->setPosition(ba->getPosition() + rt);
+        }
+        return rt;
+    }
+
+    int write(const void* buffer, size_t length) override {
+        ++m_syscalls;
+        return ::write(m_fd, buffer, length);
+    }
+
+    int write(frb::ByteArray::ptr ba, size_t length) override {
+        const std::vector<iovec>& iovs = ba->getReadIovecs(length);
+        ++m_syscalls;
+        int rt = ::writev(m_fd, &iovs[0], iovs.size());
+        if(rt > 0) {
+            ba->setPosition(ba->getPosition() + rt);
+        }
+        return rt;
+    }
+
+    void close() override {
+        ::shutdown(m_fd, SHUT_WR);
+    }
+
+    uint64_t getSyscalls() const { return m_syscalls;}
+private:
+    int m_fd;
+    uint64_t m_syscalls = 0;
+};
+
+/**
+ * @brief 模拟一次小RPC: 4字节长度头 + 若干小字段, 逐字段写/读
+ */
+void send_request(frb::Stream::ptr s, uint32_t id) {
+    std::string name = "user_" + std::to_string(id);
+    uint32_t len = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint32_t) + name.size();
+    uint16_t type = 7;
+    uint64_t time = 1000 + id;
+    uint32_t name_len = name.size();
+    s->writeFixSize(&len, sizeof(len));
+    s->writeFixSize(&id, sizeof(id));
+    s->writeFixSize(&type, sizeof(type));
+    s->writeFixSize(&time, sizeof(time));
+    s->writeFixSize(&name_len, sizeof(name_len));
+    s->writeFixSize(name.c_str(), name.size());
+}
+
+void recv_request(frb::Stream::ptr s, uint32_t expect_id) {
+    uint32_t len = 0, id = 0, name_len = 0;
+    uint16_t type = 0;
+    uint64_t time = 0;
+    ASSERT(s->readFixSize(&len, sizeof(len)) > 0);
+    ASSERT(s->readFixSize(&id, sizeof(id)) > 0);
+    ASSERT(s->readFixSize(&type, sizeof(type)) > 0);
+    ASSERT(s->readFixSize(&time, sizeof(time)) > 0);
+    ASSERT(s->readFixSize(&name_len, sizeof(name_len)) > 0);
+    std::string name(name_len, 0);
+    ASSERT(s->readFixSize(&name[0], name_len) > 0);
+    ASSERT(id == expect_id && type == 7 && time == 1000 + id && name == "user_" + std::to_string(id));
+    ASSERT(len == 18 + name_len);
+}
+
+void test_syscalls() {
+    int fds[2];
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    FdStream::ptr client(new FdStream(fds[0]));
+    FdStream::ptr server(new FdStream(fds[1]));
+
+    send_request(client, 1);
+    recv_request(server, 1);
+    LOG_INFO_STREAM(g_logger) << "raw stream: write syscalls=" << client->getSyscalls()
+        << " read syscalls=" << server->getSyscalls();
+    uint64_t raw = client->getSyscalls() + server->getSyscalls();
+
+    FdStream::ptr c2(new FdStream(fds[0]));
+    FdStream::ptr s2(new FdStream(fds[1]));
+    frb::BufferedStream::ptr bc(new frb::BufferedStream(c2));
+    frb::BufferedStream::ptr bs(new frb::BufferedStream(s2));
+    send_request(bc, 2);
+    ASSERT(c2->getSyscalls() == 0);
+    ASSERT(bc->flush() == 0);
+    recv_request(bs, 2);
+    LOG_INFO_STREAM(g_logger) << "buffered stream: write syscalls=" << c2->getSyscalls()
+        << " read syscalls=" << s2->getSyscalls() << " (raw " << raw << ")";
+    ASSERT(c2->getSyscalls() == 1 && s2->getSyscalls() == 1);
+
+    //读之前自动flush: 请求没有显式flush, 等响应时发出
+    send_request(bc, 3);
+    char c;
+    frb::Thread::ptr thr(new frb::Thread([&bs]() {
+        recv_request(bs, 3);
+        bs->write("k", 1);
+        bs->flush();
+    }, "server"));
+    ASSERT(bc->read(&c, 1) == 1 && c == 'k');
+    thr->join();
+
+    //peek不消费
+    bc->write("abcdef", 6);
+    bc->flush();
+    char buf[16];
+    ASSERT(bs->peek(buf, 4) == 4 && memcmp(buf, "abcd", 4) == 0);
+    ASSERT(bs->getReadBuffered() == 6);
+    ASSERT(bs->read(buf, sizeof(buf)) == 6 && memcmp(buf, "abcdef", 6) == 0);
+
+    //ByteArray写入: 整节点共享, 和前面的小块一起发出
+    frb::ByteArray::ptr ba(new frb::ByteArray(1000));
+    std::string body(5000, 'x');
+    ba->write(body.c_str(), body.size());
+    ba->setPosition(0);
+    bc->write("head", 4);
+    ASSERT(bc->write(ba, ba->getSize()) == (int)body.size());
+    ASSERT(ba->getReadSize() == 0);
+    uint64_t before = c2->getSyscalls();
+    bc->close();
+    ASSERT(c2->getSyscalls() == before + 1);
+    frb::ByteArray::ptr out(new frb::ByteArray);
+    ASSERT(bs->readFixSize(out, 4 + body.size()) > 0);
+    out->setPosition(0);
+    ASSERT(out->toString() == "head" + body);
+    ASSERT(bs->read(buf, sizeof(buf)) == 0);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+    LOG_INFO_STREAM(g_logger) << "test_syscalls ok";
+}
+
+/**
+ * @brief 小RPC往返的系统调用次数和耗时
+ */
+void bench_rpc() {
+    const uint32_t n = 100000;
+    for(int buffered = 0; buffered < 2; ++buffered) {
+        int fds[2];
+        ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        FdStream::ptr c(new FdStream(fds[0]));
+        FdStream::ptr s(new FdStream(fds[1]));
+        frb::Stream::ptr cs = c, ss = s;
+        if(buffered) {
+            cs.reset(new frb::BufferedStream(c));
+            ss.reset(new frb::BufferedStream(s));
+        }
+        uint64_t start = frb::GetCurrentUS();
+        for(uint32_t i = 0; i < n; ++i) {
+            send_request(cs, i);
+            if(buffered) {
+                std::static_pointer_cast<frb::BufferedStream>(cs)->flush();
+            }
+            recv_request(ss, i);
+        }
+        uint64_t used = frb::GetCurrentUS() - start;
+        LOG_INFO_STREAM(g_logger) << (buffered ? "buffered" : "raw") << " rpc=" << n
+            << " syscalls/rpc=" << (double)(c->getSyscalls() + s->getSyscalls()) / n
+            << " used=" << used / 1000.0 << "ms";
+        cs.reset();
+        ss.reset();
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+}
+
+int main(int argc, char** argv) {
+    test_syscalls();
+    bench_rpc();
+    return 0;
+}
@@ -0,0 +1,527 @@
+#include "../include/bytearray.h"
+#include "../include/log.h"
+#include "../include/macro.h"
+#include "../include/utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <unistd.h>
+
+frb::Logger::ptr g_logger = GET_LOG_ROOT;
+
+void test() {
+#define XX(type, len, write_fun, read_fun, base_len) {\
+    std::vector<type> vec; \
+    for(int i = 0; i < len; ++i) { \
+        vec.push_back((type)((uint64_t)rand() << 33 ^ (uint64_t)rand() << (i % 40) ^ rand())); \
+    } \
+    frb::ByteArray::ptr ba(new frb::ByteArray(base_len)); \
+    for(auto& i : vec) { \
+        ba->write_fun(i); \
+    } \
+    ba->setPosition(0); \
+    for(size_t i = 0; i < vec.size(); ++i) { \
+        type v = ba->read_fun(); \
+        ASSERT(v == vec[i]); \
+    } \
+    ASSERT(ba->getReadSize() == 0); \
+    LOG_INFO_STREAM(g_logger) << #write_fun "/" #read_fun \
+                    " (" #type " ) len=" << len \
+                    << " base_len=" << base_len \
+                    << " size=" << ba->getSize(); \
+}
+
+    XX(int8_t,  100, writeFint8, readFint8, 1);
+    XX(uint8_t, 100, writeFuint8, readFuint8, 1);
+    XX(int16_t,  100, writeFint16,  readFint16, 1);
+    XX(uint16_t, 100, writeFuint16, readFuint16, 1);
+    XX(int32_t,  100, writeFint32,  readFint32, 1);
+    XX(uint32_t, 100, writeFuint32, readFuint32, 1);
+    XX(int64_t,  100, writeFint64,  readFint64, 1);
+    XX(uint64_t, 100, writeFuint64, readFuint64, 1);
+
+    //小节点让varint经常跨节点, 大节点走节点内的快速路径
+    for(size_t base_len : {1, 3, 7, 11, 4096}) {
+        XX(int32_t,  1000, writeInt32,  readInt32, base_len);
+        XX(uint32_t, 1000, writeUint32, readUint32, base_len);
+        XX(int64_t,  1000, writeInt64,  readInt64, base_len);
+        XX(uint64_t, 1000, writeUint64, readUint64, base_len);
+    }
+#undef XX
+
+    //边界值
+    frb::ByteArray::ptr ba(new frb::ByteArray(5));
+    ba->writeInt32(INT32_MIN);
+    ba->writeInt32(INT32_MAX);
+    ba->writeInt64(INT64_MIN);
+    ba->writeInt64(INT64_MAX);
+    ba->writeUint64(UINT64_MAX);
+    ba->setPosition(0);
+    ASSERT(ba->readInt32() == INT32_MIN);
+    ASSERT(ba->readInt32() == INT32_MAX);
+    ASSERT(ba->readInt64() == INT64_MIN);
+    ASSERT(ba->readInt64() == INT64_MAX);
+    ASSERT(ba->readUint64() == UINT64_MAX);
+
+    //不完整的varint要抛异常
+    ba->clear();
+    ba->writeFuint8(0x80);
+    ba->setPosition(0);
+    bool thrown = false;
+    try {
+        ba->readUint64();
+    } catch(std::out_of_range&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+}
+
+/**
+ * @brief 批量接口和逐个调用的结果要一致
+ */
+void test_array() {
+#define XX(type, name, base_len, little) {\
+    std::vector<type> vec(1000); \
+    for(size_t i = 0; i < vec.size(); ++i) { \
+        uint64_t r = (uint64_t)rand() << 33 ^ (uint64_t)rand() << (i % 40) ^ rand(); \
+        memcpy(&vec[i], &r, sizeof(type)); \
+    } \
+    frb::ByteArray::ptr one(new frb::ByteArray(base_len)); \
+    frb::ByteArray::ptr bulk(new frb::ByteArray(base_len)); \
+    one->setIsLittleEndian(little); \
+    bulk->setIsLittleEndian(little); \
+    for(auto& i : vec) { \
+        one->write##name(i); \
+    } \
+    bulk->write##name##Array(&vec[0], 3); \
+    bulk->write##name##Array(&vec[3], vec.size() - 3); \
+    one->setPosition(0); \
+    bulk->setPosition(0); \
+    ASSERT(one->toString() == bulk->toString()); \
+    std::vector<type> out(vec.size()); \
+    bulk->read##name##Array(&out[0], out.size()); \
+    ASSERT(memcmp(&out[0], &vec[0], vec.size() * sizeof(type)) == 0); \
+    ASSERT(bulk->getReadSize() == 0); \
+}
+
+    for(size_t base_len : {1, 3, 7, 11, 4096}) {
+        for(bool little : {false, true}) {
+            XX(int16_t, Fint16, base_len, little);
+            XX(uint16_t, Fuint16, base_len, little);
+            XX(int32_t, Fint32, base_len, little);
+            XX(uint32_t, Fuint32, base_len, little);
+            XX(int64_t, Fint64, base_len, little);
+            XX(uint64_t, Fuint64, base_len, little);
+            XX(float, Float, base_len, little);
+            XX(double, Double, base_len, little);
+            XX(int32_t, Int32, base_len, little);
+            XX(uint32_t, Uint32, base_len, little);
+            XX(int64_t, Int64, base_len, little);
+            XX(uint64_t, Uint64, base_len, little);
+        }
+    }
+#undef XX
+    LOG_INFO_STREAM(g_logger) << "test_array ok";
+}
+
+/**
+ * @brief 逐个写/读和批量写/读100万个float(大端, 需要交换字节序)
+ */
+void bench_array() {
+    const size_t count = 1000000;
+    std::vector<float> vec(count);
+    for(size_t i = 0; i < count; ++i) {
+        vec[i] = rand() / 3.0f;
+    }
+    std::vector<float> out(count);
+
+    frb::ByteArray one;
+    uint64_t start = frb::GetCurrentUS();
+    for(auto& i : vec) {
+        one.writeFloat(i);
+    }
+    one.setPosition(0);
+    for(auto& i : out) {
+        i = one.readFloat();
+    }
+    uint64_t one_us = frb::GetCurrentUS() - start;
+
+    frb::ByteArray bulk;
+    start = frb::GetCurrentUS();
+    bulk.writeFloatArray(&vec[0], count);
+    bulk.setPosition(0);
+    bulk.readFloatArray(&out[0], count);
+    uint64_t bulk_us = frb::GetCurrentUS() - start;
+    ASSERT(out == vec);
+
+    LOG_INFO_STREAM(g_logger) << "float count=" << count
+                    << " one by one=" << one_us << "us"
+                    << " array=" << bulk_us << "us";
+}
+
+/**
+ * @brief 序列化/反序列化1000万个大小混合的整数
+ */
+void bench_varint() {
+    const size_t count = 10000000;
+    std::vector<int64_t> vec(count);
+    for(size_t i = 0; i < count; ++i) {
+        //按1/2/3/5/9字节左右的编码长度混合
+        int shift = (i % 5) * 14;
+        vec[i] = ((int64_t)rand() << 31 ^ rand()) >> (62 - shift);
+        if(i & 1) {
+            vec[i] = -vec[i];
+        }
+    }
+
+    frb::ByteArray ba;
+    uint64_t start = frb::GetCurrentMS();
+    for(auto& i : vec) {
+        ba.writeInt64(i);
+    }
+    uint64_t write_ms = frb::GetCurrentMS() - start;
+
+    ba.setPosition(0);
+    int64_t sum = 0;
+    start = frb::GetCurrentMS();
+    for(size_t i = 0; i < count; ++i) {
+        sum += ba.readInt64();
+    }
+    uint64_t read_ms = frb::GetCurrentMS() - start;
+
+    int64_t expect = 0;
+    for(auto& i : vec) {
+        expect += i;
+    }
+    ASSERT(sum == expect);
+    LOG_INFO_STREAM(g_logger) << "varint count=" << count
+                    << " bytes=" << ba.getSize()
+                    << " write=" << write_ms << "ms"
+                    << " read=" << read_ms << "ms";
+}
+
+/**
+ * @brief 按位置读/回填长度前缀
+ */
+void test_seek() {
+    frb::ByteArray::ptr ba(new frb::ByteArray(7));
+    for(uint32_t i = 0; i < 1000; ++i) {
+        ba->writeFuint32(i);
+    }
+    //当前位置在末尾, 按位置读不能受m_cur影响
+    for(uint32_t i = 0; i < 1000; i += 37) {
+        uint32_t v;
+        ba->read(&v, sizeof(v), i * 4);
+        ASSERT(be32toh(v) == i);
+    }
+
+    //先占位, 写完消息体再跳回去填长度
+    frb::ByteArray msg(16);
+    std::vector<size_t> offs;
+    for(int i = 0; i < 100; ++i) {
+        offs.push_back(msg.getPosition());
+        msg.writeFuint32(0);
+        for(int n = 0; n < i; ++n) {
+            msg.writeFuint8(n);
+        }
+        size_t end = msg.getPosition();
+        msg.setPosition(offs.back());
+        msg.writeFuint32(i);
+        msg.setPosition(end);
+    }
+    msg.setPosition(0);
+    for(int i = 0; i < 100; ++i) {
+        ASSERT(msg.getPosition() == offs[i]);
+        ASSERT(msg.readFuint32() == (uint32_t)i);
+        for(int n = 0; n < i; ++n) {
+            ASSERT(msg.readFuint8() == n);
+        }
+    }
+    ASSERT(msg.getReadSize() == 0);
+    LOG_INFO_STREAM(g_logger) << "test_seek ok";
+}
+
+static std::string IovecToString(const std::vector<iovec>& iovs) {
+    std::string str;
+    for(auto& i : iovs) {
+        str.append((const char*)i.iov_base, i.iov_len);
+    }
+    return str;
+}
+
+/**
+ * @brief Slice共享节点, 源ByteArray改写/清空后Slice内容不变
+ */
+void test_slice() {
+    std::string data;
+    for(int i = 0; i < 1000; ++i) {
+        data.push_back('a' + i % 26);
+    }
+    frb::ByteArray::ptr ba(new frb::ByteArray(64));
+    ba->writeStringWithoutLength(data);
+
+    frb::ByteArray::Slice::ptr s1 = ba->slice(10, 500);
+    ASSERT(s1->toString() == data.substr(10, 500));
+    std::vector<iovec> iovs;
+    ASSERT(s1->getReadBuffers(iovs) == 500);
+    ASSERT(IovecToString(iovs) == data.substr(10, 500));
+
+    frb::ByteArray::Slice::ptr s2 = s1->slice(100, 300);
+    ASSERT(s2->toString() == data.substr(110, 300));
+    iovs.clear();
+    s2->getReadBuffers(iovs, 50, 20);
+    ASSERT(IovecToString(iovs) == data.substr(130, 50));
+
+    //回写被共享的数据, 触发写时复制
+    ba->setPosition(0);
+    ba->writeStringWithoutLength(std::string(1000, '#'));
+    ASSERT(s1->toString() == data.substr(10, 500));
+    ASSERT(s2->toString() == data.substr(110, 300));
+    ba->clear();
+    ba->writeStringWithoutLength(std::string(1000, '$'));
+    ASSERT(s1->toString() == data.substr(10, 500));
+
+    frb::ByteArray::Slice::ptr s3 = s1->slice(0, 0);
+    s3->append(*s2);
+    s3->append(*s1);
+    s3->append(*s3);
+    std::string expect = data.substr(110, 300) + data.substr(10, 500);
+    ASSERT(s3->toString() == expect + expect);
+
+    //节点对齐的部分直接共享
+    ba->clear();
+    ba->writeStringWithoutLength(data);
+    frb::ByteArray::Slice::ptr whole = ba->slice(0, ba->getSize());
+    frb::ByteArray::ptr out(new frb::ByteArray(64));
+    out->writeSlice(*whole);
+    out->writeSlice(*s2);
+    out->setPosition(0);
+    ASSERT(out->toString() == data + data.substr(110, 300));
+    out->setPosition(64);
+    out->writeFuint8('!');
+    out->setPosition(0);
+    ba->setPosition(0);
+    ASSERT(ba->toString() == data);
+    ASSERT(whole->toString() == data);
+    ASSERT(out->toString().substr(0, 100) == data.substr(0, 64) + "!" + data.substr(65, 35));
+    LOG_INFO_STREAM(g_logger) << "test_slice ok";
+}
+
+/**
+ * @brief 文件读写和只读mmap
+ */
+void test_file() {
+    std::string data;
+    for(int i = 0; i < 100000; ++i) {
+        data.push_back(rand());
+    }
+    frb::ByteArray::ptr ba(new frb::ByteArray(1000));
+    ba->writeStringWithoutLength(data);
+    ba->setPosition(0);
+    ASSERT(ba->writeToFile("./bytearray.dat"));
+
+    frb::ByteArray::ptr rd(new frb::ByteArray(333));
+    ASSERT(rd->readFromFile("./bytearray.dat"));
+    rd->setPosition(0);
+    ASSERT(rd->toString() == data);
+
+    //节点数超过IOV_MAX, 要分几次readv
+    frb::ByteArray::ptr small(new frb::ByteArray(64));
+    ASSERT(small->readFromFile("./bytearray.dat"));
+    small->setPosition(0);
+    ASSERT(small->getSize() == data.size());
+    ASSERT(small->toString() == data);
+
+    frb::ByteArray::ptr mp(new frb::ByteArray(4096));
+    ASSERT(mp->mmapFile("./bytearray.dat"));
+    ASSERT(mp->isReadOnly());
+    ASSERT(mp->getSize() == data.size());
+    ASSERT(mp->toString() == data);
+    mp->setPosition(50000);
+    ASSERT(mp->readFuint8() == (uint8_t)data[50000]);
+
+    bool thrown = false;
+    try {
+        mp->writeFuint8(0);
+    } catch(std::logic_error&) {
+        thrown = true;
+    }
+    ASSERT(thrown);
+
+    //映射的节点在ByteArray清空后仍可以通过Slice访问
+    frb::ByteArray::Slice::ptr s = mp->slice(10, 90000);
+    mp->setPosition(0);
+    ASSERT(mp->writeToFile("./bytearray_copy.dat"));
+    mp->clear();
+    ASSERT(!mp->isReadOnly());
+    mp->writeStringWithoutLength("abc");
+    ASSERT(s->toString() == data.substr(10, 90000));
+    s.reset();
+
+    ASSERT(rd->mmapFile("./bytearray_copy.dat"));
+    ASSERT(rd->toString() == data);
+    LOG_INFO_STREAM(g_logger) << "test_file ok";
+}
+
+/**
+ * @brief readSome按到达的数据读, readUntil跨节点找分隔符
+ */
+void test_read_some() {
+    int fds[2];
+    ASSERT(pipe(fds) == 0);
+    std::string data;
+    for(int i = 0; i < 200; ++i) {
+        data += "line " + std::to_string(i) + "\r\n";
+    }
+    ASSERT(write(fds[1], data.c_str(), data.size()) == (ssize_t)data.size());
+    close(fds[1]);
+
+    frb::ByteArray::ptr ba(new frb::ByteArray(16));
+    ssize_t rt;
+    int calls = 0;
+    while((rt = ba->readSome(fds[0])) > 0) {
+        ++calls;
+    }
+    close(fds[0]);
+    ASSERT(rt == 0);
+    ASSERT(ba->getSize() == data.size());
+
+    ba->setPosition(0);
+    ASSERT(ba->indexOf('\n') == 7);
+    ASSERT(ba->indexOf("\r\n") == 6);
+    ASSERT(ba->indexOf("line 199\r\n") == (int64_t)data.find("line 199\r\n"));
+    ASSERT(ba->indexOf("line 200") == -1);
+    std::string line;
+    for(int i = 0; i < 200; ++i) {
+        ASSERT(ba->readUntil(line, "\r\n"));
+        ASSERT(line == "line " + std::to_string(i));
+    }
+    ASSERT(!ba->readUntil(line, "\r\n"));
+    ASSERT(ba->getReadSize() == 0);
+    LOG_INFO_STREAM(g_logger) << "test_read_some ok calls=" << calls;
+}
+
+/**
+ * @brief find/findByte和std::string::find的结果一致, 包括跨节点的匹配
+ */
+void test_find() {
+    for(size_t base_len : {1, 3, 7, 16, 33, 4096}) {
+        std::string data;
+        for(int i = 0; i < 5000; ++i) {
+            data.push_back("ab\r\n"[rand() % 4]);
+        }
+        frb::ByteArray::ptr ba(new frb::ByteArray(base_len));
+        ba->writeStringWithoutLength(data);
+        for(int n = 0; n < 300; ++n) {
+            size_t from = rand() % data.size();
+            size_t k = 1 + rand() % 12;
+            std::string pattern = data.substr(rand() % data.size(), k);
+            if(n % 5 == 0) {
+                pattern += "x";
+            }
+            size_t expect = data.find(pattern, from);
+            int64_t rt = ba->find(pattern, from);
+            ASSERT(rt == (expect == std::string::npos ? -1 : (int64_t)expect));
+            expect = data.find(pattern[0], from);
+            rt = ba->findByte(pattern[0], from);
+            ASSERT(rt == (expect == std::string::npos ? -1 : (int64_t)expect));
+        }
+        ASSERT(ba->find("\r\n", data.size()) == -1);
+        ASSERT(ba->find("", 10) == 10);
+    }
+    LOG_INFO_STREAM(g_logger) << "test_find ok";
+}
+
+/**
+ * @brief 64MB数据末尾的\r\n\r\n: find和toString + std::string::find对比
+ */
+void bench_find() {
+    frb::ByteArray ba;
+    std::string data(1024 * 1024, 'x');
+    for(int i = 0; i < 64; ++i) {
+        ba.writeStringWithoutLength(data);
+    }
+    ba.writeStringWithoutLength("\r\n\r\n");
+    ba.setPosition(0);
+
+    uint64_t start = frb::GetCurrentUS();
+    int64_t rt = ba.find("\r\n\r\n");
+    uint64_t find_us = frb::GetCurrentUS() - start;
+
+    start = frb::GetCurrentUS();
+    size_t expect = ba.toString().find("\r\n\r\n");
+    uint64_t copy_us = frb::GetCurrentUS() - start;
+    ASSERT(rt == (int64_t)expect);
+
+    LOG_INFO_STREAM(g_logger) << "find size=" << ba.getSize()
+                    << " find=" << find_us << "us"
+                    << " toString+find=" << copy_us << "us";
+}
+
+/**
+ * @brief 64MB数据上随机setPosition + read
+ */
+void bench_seek() {
+    const size_t size = 64 * 1024 * 1024;
+    const size_t count = 1000000;
+    frb::ByteArray ba;
+    std::string data(1024 * 1024, 'x');
+    for(size_t i = 0; i < size / data.size(); ++i) {
+        ba.writeStringWithoutLength(data);
+    }
+    uint64_t start = frb::GetCurrentUS();
+    for(size_t i = 0; i < count; ++i) {
+        ba.setPosition(rand() % (size - 8));
+        ba.readFuint64();
+    }
+    LOG_INFO_STREAM(g_logger) << "seek size=" << size << " count=" << count
+                    << " cost=" << (frb::GetCurrentUS() - start) << "us";
+}
+
+/**
+ * @brief 模拟每个请求一个ByteArray: 创建, 写64KB, 清空后再写, 析构
+ */
+void bench_request() {
+    const size_t count = 100000;
+    std::string data(64 * 1024, 'x');
+    uint64_t start = frb::GetCurrentUS();
+    for(size_t i = 0; i < count; ++i) {
+        frb::ByteArray ba;
+        ba.writeStringWithoutLength(data);
+        ba.clear();
+        ba.writeStringWithoutLength(data);
+    }
+    LOG_INFO_STREAM(g_logger) << "request count=" << count
+                    << " cost=" << (frb::GetCurrentUS() - start) << "us";
+}
+
+int main(int argc, char** argv) {
+    //FRB_NATIVE=ON编译时才有SSSE3/BMI2/AVX2路径
+    LOG_INFO_STREAM(g_logger) << "simd:"
+#ifdef __SSE2__
+        << " sse2"
+#endif
+#ifdef __SSSE3__
+        << " ssse3"
+#endif
+#ifdef __BMI2__
+        << " bmi2"
+#endif
+#ifdef __AVX2__
+        << " avx2"
+#endif
+        ;
+    test();
+    test_array();
+    test_seek();
+    test_slice();
+    test_file();
+    test_read_some();
+    test_find();
+    bench_varint();
+    bench_array();
+    bench_request();
+    bench_seek();
+    bench_find();
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include "../include/streams/zlib_stream.h"
+#include "../include/streams/lz4_stream.h"
+#include "../include/log.h"
+#include "../include/macro.h"
+#include "../include/utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+frb::Logger::ptr g_logger = GET_LOG_ROOT;
+
+/**
+ * @brief 内存里的Stream, 写追加到ByteArray末尾, 读从头依次读; 每次最多读max_read字节, 用来模拟socket分段到达
+ */
+class MemoryStream : public frb::Stream {
+public:
+    typedef std::shared_ptr<MemoryStream> ptr;
+    MemoryStream(size_t max_read = ~0ull)
+        :m_data(new frb::ByteArray)
+        ,m_maxRead(max_read) {
+    }
+
+    int read(void* buffer, size_t length) override {
+        length = std::min(std::min(length, m_maxRead), m_data->getSize() - m_readPos);
+        m_data->read(buffer, length, m_readPos);
+        m_readPos += length;
+        return length;
+    }
+
+    int read(frb::ByteArray::ptr ba, size_t length) override {
+        length = std::min(std::min(length, m_maxRead), m_data->getSize() - m_readPos);
+        //像socket一样直接读进ba的节点
+        for(auto& i : ba->getWriteIovecs(length)) {
+            m_data->read(i.iov_base, i.iov_len, m_readPos);
+            m_readPos += i.iov_len;
+        }
+        ba->setPosition(ba->getPosition() + length);
+        return length;
+    }
+
+    int write(const void* buffer, size_t length) override {
+        m_data->write(buffer, length);
+        return length;
+    }
+
+    int write(frb::ByteArray::ptr ba, size_t length) override {
+        length = std::min(length, ba->getReadSize());
+        for(auto& i : ba->getReadIovecs(length)) {
+            m_data->write(i.iov_base, i.iov_len);
+        }
+        ba->setPosition(ba->getPosition() + length);
+        return length;
+    }
+
+    void close() override {}
+
+    size_t getSize() const { return m_data->getSize();}
+    void rewind() { m_readPos = 0;}
+private:
+    frb::ByteArray::ptr m_data;
+    size_t m_maxRead;
+    size_t m_readPos = 0;
+};
+
+/**
+ * @brief 类似接口返回的JSON文本
+ */
+std::string make_json(size_t size) {
+    std::string rt;
+    rt.reserve(size + 256);
+    for(size_t i = 0; rt.size() < size; ++i) {
+        rt += "{\"id\":" + std::to_string(i * 7919 % 100000)
+            + ",\"name\":\"user_" + std::to_string(i % 1000)
+            + "\",\"score\":" + std::to_string(rand() % 10000)
+            + ",\"tags\":[\"a\",\"b\"],\"active\":" + (i % 3 ? "true" : "false") + "}\n";
+    }
+    rt.resize(size);
+    return rt;
+}
+
+std::string make_random(size_t size) {
+    std::string rt(size, 0);
+    for(auto& c : rt) {
+        c = rand();
+    }
+    return rt;
+}
+
+/**
+ * @brief 压缩后再解压, 检查结果一致; 分别用void*和ByteArray两套接口
+ */
+void test_zlib() {
+    std::string data = make_json(300 * 1024);
+    for(auto type : {frb::ZlibStream::ZLIB, frb::ZlibStream::DEFLATE, frb::ZlibStream::GZIP}) {
+        MemoryStream::ptr mem(new MemoryStream(1000));
+        frb::ZlibStream::ptr enc = frb::ZlibStream::CreateCompress(mem, type, 6, 16 * 1024);
+        ASSERT(enc);
+        //一半用void*, 一半用跨节点的ByteArray
+        size_t half = data.size() / 2;
+        ASSERT(enc->write(data.data(), half) == (int)half);
+        frb::ByteArray::ptr ba(new frb::ByteArray(1000));
+        ba->write(data.data() + half, data.size() - half);
+        ba->setPosition(0);
+        ASSERT(enc->write(ba, ba->getSize()) == (int)(data.size() - half));
+        enc->close();
+        ASSERT(enc->getTotalIn() == data.size());
+        ASSERT(enc->getTotalOut() == mem->getSize());
+
+        frb::ZlibStream::ptr dec = frb::ZlibStream::CreateDecompress(mem, type, 4096);
+        ASSERT(dec);
+        std::string out(half, 0);
+        ASSERT(dec->readFixSize(&out[0], half) == (int)half);
+        frb::ByteArray::ptr oba(new frb::ByteArray(1000));
+        ASSERT(dec->readFixSize(oba, data.size() - half) == (int)(data.size() - half));
+        char c;
+        ASSERT(dec->read(&c, 1) == 0);
+        oba->setPosition(0);
+        out += oba->toString();
+        ASSERT(out == data);
+        LOG_INFO_STREAM(g_logger) << "zlib type=" << type << " " << data.size()
+            << " -> " << mem->getSize();
+    }
+
+    //flush后对端可以立即解出已写的数据
+    MemoryStream::ptr mem(new MemoryStream);
+    frb::ZlibStream::ptr enc = frb::ZlibStream::CreateCompress(mem);
+    frb::ZlibStream::ptr dec = frb::ZlibStream::CreateDecompress(mem);
+    enc->write("hello ", 6);
+    ASSERT(mem->getSize() == 0);
+    ASSERT(enc->flush() == 0);
+    char buf[16];
+    ASSERT(dec->read(buf, sizeof(buf)) == 6 && memcmp(buf, "hello ", 6) == 0);
+    enc->write("world", 5);
+    enc->close();
+    ASSERT(dec->read(buf, sizeof(buf)) == 5 && memcmp(buf, "world", 5) == 0);
+    ASSERT(dec->read(buf, sizeof(buf)) == 0);
+
+    //损坏的数据
+    MemoryStream::ptr bad(new MemoryStream);
+    bad->write("not a zlib stream", 17);
+    dec = frb::ZlibStream::CreateDecompress(bad);
+    ASSERT(dec->read(buf, sizeof(buf)) < 0);
+    LOG_INFO_STREAM(g_logger) << "test_zlib ok";
+}
+
+#ifdef FRB_HAVE_LZ4
+void test_lz4() {
+    for(auto& data : {make_json(300 * 1024), make_random(100 * 1024)}) {
+        MemoryStream::ptr mem(new MemoryStream(1000));
+        frb::Lz4Stream::ptr enc = frb::Lz4Stream::CreateCompress(mem, 1, 16 * 1024);
+        frb::ByteArray::ptr ba(new frb::ByteArray(1000));
+        ba->write(data.data(), data.size());
+        ba->setPosition(0);
+        ASSERT(enc->write(ba, ba->getSize()) == (int)data.size());
+        enc->close();
+
+        frb::Lz4Stream::ptr dec = frb::Lz4Stream::CreateDecompress(mem);
+        frb::ByteArray::ptr oba(new frb::ByteArray(1000));
+        ASSERT(dec->readFixSize(oba, data.size()) == (int)data.size());
+        char c;
+        ASSERT(dec->read(&c, 1) == 0);
+        oba->setPosition(0);
+        ASSERT(oba->toString() == data);
+        LOG_INFO_STREAM(g_logger) << "lz4 " << data.size() << " -> " << mem->getSize();
+    }
+    LOG_INFO_STREAM(g_logger) << "test_lz4 ok";
+}
+#endif
+
+/**
+ * @brief 压缩/解压吞吐(MB/s)和压缩率
+ */
+template<class Enc, class Dec>
+void bench(const std::string& name, const std::string& data, Enc enc_fn, Dec dec_fn) {
+    const int loop = 20;
+    MemoryStream::ptr mem;
+    uint64_t start = frb::GetCurrentUS();
+    for(int i = 0; i < loop; ++i) {
+        mem.reset(new MemoryStream);
+        auto enc = enc_fn(mem);
+        enc->write(data.data(), data.size());
+        enc->close();
+    }
+    uint64_t enc_us = frb::GetCurrentUS() - start;
+
+    std::string out(data.size(), 0);
+    start = frb::GetCurrentUS();
+    for(int i = 0; i < loop; ++i) {
+        mem->rewind();
+        auto dec = dec_fn(mem);
+        ASSERT(dec->readFixSize(&out[0], out.size()) == (int)out.size());
+    }
+    uint64_t dec_us = frb::GetCurrentUS() - start;
+    ASSERT(out == data);
+
+    double mb = data.size() * loop / 1024.0 / 1024.0;
+    LOG_INFO_STREAM(g_logger) << name << " ratio=" << (double)mem->getSize() / data.size()
+        << " compress=" << mb / (enc_us / 1e6) << "MB/s"
+        << " decompress=" << mb / (dec_us / 1e6) << "MB/s";
+}
+
+void bench_compress() {
+    std::string json = make_json(4 * 1024 * 1024);
+    std::string random = make_random(4 * 1024 * 1024);
+    for(auto& i : {std::make_pair(std::string("json"), &json), std::make_pair(std::string("random"), &random)}) {
+        for(int level : {1, 6, 9}) {
+            bench("zlib " + i.first + " level=" + std::to_string(level), *i.second
+                ,[level](frb::Stream::ptr s) { return frb::ZlibStream::CreateCompress(s, frb::ZlibStream::ZLIB, level);}
+                ,[](frb::Stream::ptr s) { return frb::ZlibStream::CreateDecompress(s);});
+        }
+#ifdef FRB_HAVE_LZ4
+        for(int acc : {1, 8}) {
+            bench("lz4 " + i.first + " acceleration=" + std::to_string(acc), *i.second
+                ,[acc](frb::Stream::ptr s) { return frb::Lz4Stream::CreateCompress(s, acc);}
+                ,[](frb::Stream::ptr s) { return frb::Lz4Stream::CreateDecompress(s);});
+        }
+#endif
+    }
+}
+
+int main(int argc, char** argv) {
+    test_zlib();
+#ifdef FRB_HAVE_LZ4
+    test_lz4();
+#endif
+    bench_compress();
+    return 0;
+}
@@ -1,7 +1,12 @@
 
 #include "../include/config.h"
 #include "../include/log.h"
+#include "../include/macro.h"
+#include "../include/scheduler.h"
+#include "../include/utils.h"
 #include <yaml-cpp/yaml.h>
+#include <unistd.h>
+#include <fstream>
 
 frb::ConfigVar<int>::ptr g_int_value_config = frb::Config::Lookup("system.port", (int)8080, "system port");
 
@@ -91,7 +96,351 @@ void test_log(){
 }
 
 
-int main(){
+/**
+ * @brief getSnapshot拿到的快照在setValue之后仍然有效, 没有持有者的旧值被回收
+ */
+void test_value_snapshot(){
+    auto var = frb::Config::Lookup("test.snapshot", std::vector<int>{1, 2, 3}, "test snapshot");
+    auto snap = var->getSnapshot();
+    std::weak_ptr<const std::vector<int> > weak = snap;
+
+    var->setValue(std::vector<int>{4, 5});
+    ASSERT(*snap == std::vector<int>({1, 2, 3}));
+    ASSERT(var->getValue() == std::vector<int>({4, 5}));
+    snap.reset();
+    ASSERT(weak.expired());
+
+    //频繁修改不会积累旧值
+    for(int i = 0; i < 1000; ++i) {
+        weak = var->getSnapshot();
+        var->setValue(std::vector<int>{i});
+        ASSERT(weak.expired());
+    }
+    std::cout << "test_value_snapshot ok" << std::endl;
+}
+
+/**
+ * @brief 有一项转换失败时整次加载放弃: 所有配置项保持原值, 不通知监听函数, 版本号不变
+ */
+void test_reload_abort(){
+    auto port = frb::Config::Lookup("test.abort.port", (int)80, "test abort port");
+    auto hosts = frb::Config::Lookup("test.abort.hosts", std::vector<std::string>{"a"}, "test abort hosts");
+    auto timeout = frb::Config::Lookup("test.abort.timeout", (int)1000, "test abort timeout");
+    int notified = 0;
+    port->addListener([&notified](const int&, const int&) { ++notified; });
+    hosts->addListener([&notified](const std::vector<std::string>&, const std::vector<std::string>&) { ++notified; });
+    timeout->addListener([&notified](const int&, const int&) { ++notified; });
+
+    uint64_t version = frb::Config::GetVersion();
+    YAML::Node root = YAML::Load("test:\n  abort:\n    port: 8080\n    hosts: [b, c]\n    timeout: abc\n");
+    ASSERT(!frb::Config::LoadFromYaml(root));
+    ASSERT(port->getValue() == 80);
+    ASSERT(hosts->getValue() == std::vector<std::string>{"a"});
+    ASSERT(timeout->getValue() == 1000);
+    ASSERT(notified == 0);
+    ASSERT(frb::Config::GetVersion() == version);
+
+    port->clearListener();
+    hosts->clearListener();
+    timeout->clearListener();
+    std::cout << "test_reload_abort ok" << std::endl;
+}
+
+/**
+ * @brief 转换失败后已转换的待提交值被丢弃, 不会在下一次加载时被顺带提交
+ */
+void test_reload_rollback(){
+    auto port = frb::Config::Lookup("test.rollback.port", (int)80, "test rollback port");
+    auto timeout = frb::Config::Lookup("test.rollback.timeout", (int)1000, "test rollback timeout");
+
+    YAML::Node bad = YAML::Load("test:\n  rollback:\n    port: 8080\n    timeout: abc\n");
+    ASSERT(!frb::Config::LoadFromYaml(bad));
+    ASSERT(port->getValue() == 80);
+
+    //只改timeout, port的8080已经回滚
+    uint64_t version = frb::Config::GetVersion();
+    YAML::Node good = YAML::Load("test:\n  rollback:\n    timeout: 2000\n");
+    ASSERT(frb::Config::LoadFromYaml(good));
+    ASSERT(port->getValue() == 80);
+    ASSERT(timeout->getValue() == 2000);
+    ASSERT(frb::Config::GetVersion() == version + 2);
+    std::cout << "test_reload_rollback ok" << std::endl;
+}
+
+/**
+ * @brief 设置监听调度器后通知延后到调度器上执行; 执行前的多次提交合并成一次通知,
+ *        旧值是第一次提交前的值, 新值是最后提交的值
+ */
+void test_reload_notify(){
+    auto port = frb::Config::Lookup("test.notify.port", (int)80, "test notify port");
+    std::vector<std::pair<int, int> > changes;
+    port->addListener([&changes](const int& old_value, const int& new_value) {
+        changes.push_back(std::make_pair(old_value, new_value));
+    });
+
+    //没有调度器时同步通知
+    YAML::Node root = YAML::Load("test:\n  notify:\n    port: 81\n");
+    ASSERT(frb::Config::LoadFromYaml(root));
+    ASSERT(changes.size() == 1 && changes[0] == std::make_pair(80, 81));
+    changes.clear();
+
+    //use_caller且只有一个线程, 任务在stop()里才执行
+    {
+        frb::Scheduler sc(1, true, "config_notify");
+        sc.start();
+        frb::Config::SetListenerScheduler(&sc);
+        for(int i = 82; i <= 85; ++i) {
+            root = YAML::Load("test:\n  notify:\n    port: " + std::to_string(i) + "\n");
+            ASSERT(frb::Config::LoadFromYaml(root));
+            ASSERT(port->getValue() == i);
+        }
+        ASSERT(changes.empty());
+        sc.stop();
+        frb::Config::SetListenerScheduler(nullptr);
+        ASSERT(changes.size() == 1 && changes[0] == std::make_pair(81, 85));
+    }
+
+    //改回原值的多次提交合并后没有变化, 不通知
+    {
+        frb::Scheduler sc(1, true, "config_notify");
+        sc.start();
+        frb::Config::SetListenerScheduler(&sc);
+        root = YAML::Load("test:\n  notify:\n    port: 86\n");
+        ASSERT(frb::Config::LoadFromYaml(root));
+        root = YAML::Load("test:\n  notify:\n    port: 85\n");
+        ASSERT(frb::Config::LoadFromYaml(root));
+        bool ran = false;
+        sc.schedule([&ran]() { ran = true; });
+        sc.stop();
+        frb::Config::SetListenerScheduler(nullptr);
+        ASSERT(ran);
+        ASSERT(changes.size() == 1);
+    }
+
+    port->clearListener();
+    std::cout << "test_reload_notify ok" << std::endl;
+}
+
+static void write_file(const std::string& name, const std::string& content) {
+    std::ofstream ofs(name, std::ios::binary | std::ios::trunc);
+    ofs << content;
+}
+
+static std::string read_file(const std::string& name) {
+    std::ifstream ifs(name, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief 快照编译(config_snapshot工具)和加载
+ * @details 改写快照里的标量来区分值来自快照还是YAML:
+ *          hash一致时用快照; YAML变了、快照截断或损坏时退回YAML
+ */
+void test_snapshot(const std::string& tool){
+    auto port = frb::Config::Lookup("test.snapshot_load.port", (int)0, "test snapshot port");
+    auto name = frb::Config::Lookup("test.snapshot_load.name", std::string(), "test snapshot name");
+    const std::string base = "/tmp/test_config_snapshot";
+    const std::string snap = base + ".bin";
+    std::vector<std::string> files = {base + "_a.yml", base + "_b.yml"};
+    write_file(files[0], "test:\n  snapshot_load:\n    port: 1111\n    name: aaaa\n");
+    write_file(files[1], "test:\n  snapshot_load:\n    name: bbbb\n");
+
+    std::string cmd = tool + " " + snap + " " + files[0] + " " + files[1];
+    ASSERT(system(cmd.c_str()) == 0);
+    ASSERT(system((tool + " " + snap + " /tmp/test_config_snapshot_none.yml").c_str()) != 0);
+
+    //往返: 按文件顺序生效, 后面的文件覆盖前面的
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 1111);
+    ASSERT(name->getValue() == "bbbb");
+
+    //YAML没变时用快照的内容
+    std::string data = read_file(snap);
+    size_t pos = data.find("1111");
+    ASSERT(pos != std::string::npos);
+    data.replace(pos, 4, "2222");
+    write_file(snap, data);
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 2222);
+
+    //YAML变了, hash不一致, 退回YAML
+    write_file(files[0], "test:\n  snapshot_load:\n    port: 3333\n    name: aaaa\n");
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+
+    //截断的快照
+    ASSERT(frb::Config::CompileSnapshot(files, snap));
+    data = read_file(snap);
+    pos = data.find("3333");
+    ASSERT(pos != std::string::npos);
+    data.replace(pos, 4, "4444");
+    write_file(snap, data);
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 4444);
+    write_file(snap, data.substr(0, data.size() - 8));
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+
+    //损坏的快照: 文件头不对, 节点类型不对
+    write_file(snap, "FRBC garbage");
+    port->setValue(0);
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+    data[pos - 2] = 0x7f;
+    write_file(snap, data);
+    port->setValue(0);
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+
+    //快照不存在
+    unlink(snap.c_str());
+    port->setValue(0);
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+
+    //所有文件是一个事务: 后面的文件有一项转换失败, 前面文件的值也不生效
+    auto count = frb::Config::Lookup("test.snapshot_load.count", (int)7, "test snapshot count");
+    write_file(files[0], "test:\n  snapshot_load:\n    port: 5555\n    name: aaaa\n");
+    write_file(files[1], "test:\n  snapshot_load:\n    name: cccc\n    count: abc\n");
+    ASSERT(frb::Config::CompileSnapshot(files, snap));
+    ASSERT(!frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+    ASSERT(name->getValue() == "bbbb");
+    ASSERT(count->getValue() == 7);
+    unlink(snap.c_str());
+    ASSERT(!frb::Config::LoadFromSnapshot(snap, files));
+    ASSERT(port->getValue() == 3333);
+    ASSERT(count->getValue() == 7);
+    unlink(snap.c_str());
+
+    for(auto& i : files) {
+        unlink(i.c_str());
+    }
+    std::cout << "test_snapshot ok" << std::endl;
+}
+
+/**
+ * @brief 环境变量覆盖: 配置名转大写、'.'换成'_'加前缀; 同名冲突时忽略;
+ *        之后注册的配置项也能被覆盖
+ */
+void test_env(){
+    auto timeout = frb::Config::Lookup("test.env.read_timeout", (int)100, "test env timeout");
+    auto hosts = frb::Config::Lookup("test.env.hosts", std::vector<std::string>(), "test env hosts");
+    auto x_y = frb::Config::Lookup("test.env.x_y", (int)1, "test env x_y");
+    auto x_dot_y = frb::Config::Lookup("test.env.x.y", (int)2, "test env x.y");
+
+    //环境变量在YAML之后加载, 覆盖YAML的值
+    YAML::Node root = YAML::Load("test:\n  env:\n    read_timeout: 200\n");
+    ASSERT(frb::Config::LoadFromYaml(root));
+    ASSERT(timeout->getValue() == 200);
+
+    setenv("FRB_TEST_ENV_READ_TIMEOUT", "300", 1);
+    setenv("FRB_TEST_ENV_HOSTS", "[a, b]", 1);
+    setenv("FRB_TEST_ENV_X_Y", "3", 1);
+    setenv("FRB_test_env_read_timeout", "400", 1);
+    ASSERT(frb::Config::LoadFromEnv());
+    ASSERT(timeout->getValue() == 300);
+    ASSERT(hosts->getValue() == std::vector<std::string>({"a", "b"}));
+    ASSERT(x_y->getValue() == 1);
+    ASSERT(x_dot_y->getValue() == 2);
+
+    //其它前缀
+    setenv("MYAPP_TEST_ENV_READ_TIMEOUT", "500", 1);
+    ASSERT(frb::Config::LoadFromEnv("MYAPP_"));
+    ASSERT(timeout->getValue() == 500);
+
+    //变量名表建好之后注册的配置项
+    auto late = frb::Config::Lookup("test.env.late", (int)0, "test env late");
+    setenv("FRB_TEST_ENV_LATE", "600", 1);
+    ASSERT(frb::Config::LoadFromEnv());
+    ASSERT(late->getValue() == 600);
+    ASSERT(timeout->getValue() == 300);
+
+    //转换失败整体放弃
+    setenv("FRB_TEST_ENV_LATE", "abc", 1);
+    setenv("FRB_TEST_ENV_READ_TIMEOUT", "700", 1);
+    ASSERT(!frb::Config::LoadFromEnv());
+    ASSERT(late->getValue() == 600);
+    ASSERT(timeout->getValue() == 300);
+
+    for(auto i : {"FRB_TEST_ENV_READ_TIMEOUT", "FRB_TEST_ENV_HOSTS", "FRB_TEST_ENV_X_Y"
+                ,"FRB_test_env_read_timeout", "MYAPP_TEST_ENV_READ_TIMEOUT", "FRB_TEST_ENV_LATE"}) {
+        unsetenv(i);
+    }
+    std::cout << "test_env ok" << std::endl;
+}
+
+/**
+ * @brief 命令行覆盖: 只认--key=value, key不区分大小写, value可以为空或包含'='
+ */
+void test_args(){
+    auto port = frb::Config::Lookup("test.args.port", (int)80, "test args port");
+    auto name = frb::Config::Lookup("test.args.name", std::string("x"), "test args name");
+
+    //命令行在环境变量之后加载, 覆盖环境变量的值
+    setenv("FRB_TEST_ARGS_PORT", "81", 1);
+    ASSERT(frb::Config::LoadFromEnv());
+    ASSERT(port->getValue() == 81);
+    unsetenv("FRB_TEST_ARGS_PORT");
+
+    const char* args1[] = {"prog", "--TEST.ARGS.PORT=82", "--test.args.name=a=b", "test.args.port=1"
+                           ,"--test.args.port", "-test.args.port=2", "--test.args.unknown=3"};
+    ASSERT(frb::Config::LoadFromArgs(7, (char**)args1));
+    ASSERT(port->getValue() == 82);
+    ASSERT(name->getValue() == "a=b");
+
+    const char* args2[] = {"prog", "--test.args.name="};
+    ASSERT(frb::Config::LoadFromArgs(2, (char**)args2));
+    ASSERT(name->getValue() == "");
+
+    //值转换失败整体放弃
+    const char* args3[] = {"prog", "--test.args.name=y", "--test.args.port=abc"};
+    ASSERT(!frb::Config::LoadFromArgs(3, (char**)args3));
+    ASSERT(port->getValue() == 82);
+    ASSERT(name->getValue() == "");
+
+    //argv[0]不当作参数
+    const char* args4[] = {"--test.args.port=83"};
+    ASSERT(frb::Config::LoadFromArgs(1, (char**)args4));
+    ASSERT(port->getValue() == 82);
+    std::cout << "test_args ok" << std::endl;
+}
+
+/**
+ * @brief 大的map: 快照解码是线性的, 加载耗时和解析YAML同一量级
+ */
+void test_snapshot_big_map(){
+    const int n = 20000;
+    auto items = frb::Config::Lookup("test.snapshot_big.items", std::map<std::string, int>(), "test snapshot big map");
+    const std::string snap = "/tmp/test_config_snapshot_big.bin";
+    std::vector<std::string> files = {"/tmp/test_config_snapshot_big.yml"};
+    std::string yaml = "test:\n  snapshot_big:\n    items:\n";
+    std::map<std::string, int> expect;
+    for(int i = 0; i < n; ++i) {
+        yaml += "      key" + std::to_string(i) + ": " + std::to_string(i) + "\n";
+        expect["key" + std::to_string(i)] = i;
+    }
+    write_file(files[0], yaml);
+    ASSERT(frb::Config::CompileSnapshot(files, snap));
+
+    uint64_t start = frb::GetCurrentUS();
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    uint64_t snap_us = frb::GetCurrentUS() - start;
+    ASSERT(items->getValue() == expect);
+
+    items->setValue(std::map<std::string, int>());
+    unlink(snap.c_str());
+    start = frb::GetCurrentUS();
+    ASSERT(frb::Config::LoadFromSnapshot(snap, files));
+    uint64_t yaml_us = frb::GetCurrentUS() - start;
+    ASSERT(items->getValue() == expect);
+    std::cout << "test_snapshot_big_map snapshot=" << snap_us << "us yaml=" << yaml_us << "us" << std::endl;
+    //两条路都要逐项应用, 只在解码退化成平方级时才会明显变慢
+    ASSERT(snap_us < yaml_us * 2);
+    unlink(files[0].c_str());
+}
+
+int main(int argc, char** argv){
 
 
     //test_config();
@@ -99,7 +448,22 @@ int main(){
     //test_complex_config();
 
     //std::cout<<"main"<<std::endl;
-    test_log();
+    test_value_snapshot();
+    test_reload_abort();
+    test_reload_rollback();
+    test_reload_notify();
+    //config_snapshot和test_config在同一个输出目录
+    std::string dir(argv[0]);
+    dir = dir.find('/') == std::string::npos ? "." : dir.substr(0, dir.rfind('/'));
+    test_snapshot(dir + "/config_snapshot");
+    test_snapshot_big_map();
+    test_env();
+    test_args();
+
+    //依赖本机的配置文件
+    if(access("/home/bing/mycode2022/server-framework/conf/log.yaml", R_OK) == 0) {
+        test_log();
+    }
 
 
 }
\ No newline at end of file
@@ -1,11 +1,22 @@
 #include "../include/hook.h"
 #include "../include/log.h"
 #include "../include/iomanager.h"
+#include "../include/macro.h"
+#include "../include/fd_manager.h"
+#include "../include/utils.h"
+#include "../include/socket.h"
+#include "../include/streams/socket_stream.h"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <linux/filter.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <thread>
+#include <atomic>
 
 
 frb::Logger::ptr g_logger = GET_LOG_ROOT;
@@ -52,8 +63,426 @@ void test_sock() {
     LOG_INFO_STREAM(g_logger) << buff;
 
 }
-int main() {
+/**
+ * @brief 在127.0.0.1的随机端口上监听
+ */
+static int listen_local(sockaddr_in& addr) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(bind(sock, (const sockaddr*)&addr, sizeof(addr)) || listen(sock, SOMAXCONN)
+            || getsockname(sock, (sockaddr*)&addr, &len)) {
+        LOG_ERROR_STREAM(g_logger) << "listen_local errno=" << errno;
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int connect_local(const sockaddr_in& addr) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(connect(sock, (const sockaddr*)&addr, sizeof(addr))) {
+        LOG_ERROR_STREAM(g_logger) << "connect_local errno=" << errno;
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * @brief 收完对端发的数据, 返回字节数, 内容是i % 251
+ */
+static size_t recv_all(int sock) {
+    std::string buff(64 * 1024, 0);
+    size_t total = 0;
+    bool ok = true;
+    while(true) {
+        int rt = recv(sock, &buff[0], buff.size(), 0);
+        if(rt <= 0) {
+            break;
+        }
+        for(int i = 0; i < rt; ++i) {
+            ok = ok && (uint8_t)buff[i] == (total + i) % 251;
+        }
+        total += rt;
+    }
+    return ok ? total : 0;
+}
+
+static const size_t s_file_size = 16 * 1024 * 1024;
+
+/**
+ * @brief 在127.0.0.1的随机端口上建监听Socket
+ */
+static frb::Socket::ptr listen_socket() {
+    frb::Address::ptr addr = frb::IPv4Address::Create("127.0.0.1", 0);
+    frb::Socket::ptr sock = frb::Socket::CreateTCP(addr);
+    ASSERT(sock->bind(addr) && sock->listen());
+    return sock;
+}
+
+static frb::Socket::ptr connect_socket(frb::Address::ptr addr) {
+    frb::Socket::ptr sock = frb::Socket::CreateTCP(addr);
+    ASSERT(sock->connect(addr));
+    return sock;
+}
+
+/**
+ * @brief SocketStream::sendFile发送大文件, socket发送缓冲满时协程挂起, 同线程上的接收协程继续运行
+ */
+void test_sendfile() {
+    const char* path = "/tmp/test_hook_sendfile.dat";
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    std::string data(s_file_size, 0);
+    for(size_t i = 0; i < data.size(); ++i) {
+        data[i] = i % 251;
+    }
+    ASSERT(write(fd, data.c_str(), data.size()) == (ssize_t)data.size());
+
+    frb::Socket::ptr lsock = listen_socket();
+    frb::IOManager::GetThis()->schedule([lsock, fd]() {
+        frb::SocketStream ss(lsock->accept());
+        int64_t rt = ss.sendFile(fd, 0, s_file_size);
+        LOG_INFO_STREAM(g_logger) << "sendFile rt=" << rt;
+        ASSERT(rt == (int64_t)s_file_size);
+        ss.close();
+        lsock->close();
+        close(fd);
+    });
+
+    frb::Socket::ptr sock = connect_socket(lsock->getLocalAddress());
+    size_t total = recv_all(sock->getSocket());
+    sock->close();
+    unlink(path);
+    LOG_INFO_STREAM(g_logger) << "test_sendfile recv=" << total;
+    ASSERT(total == s_file_size);
+}
+
+/**
+ * @brief 源站发送s_file_size字节的i % 251
+ * @param[in] check 是否要求全部发送成功, 下游提前断开时源站会写失败
+ */
+static frb::Socket::ptr start_origin(bool check = true) {
+    frb::Socket::ptr origin = listen_socket();
+    frb::IOManager::GetThis()->schedule([origin, check]() {
+        frb::Socket::ptr sock = origin->accept();
+        std::string data(s_file_size, 0);
+        for(size_t i = 0; i < data.size(); ++i) {
+            data[i] = i % 251;
+        }
+        frb::SocketStream ss(sock);
+        int rt = ss.writeFixSize(data.c_str(), data.size());
+        ASSERT(!check || rt > 0);
+        ss.close();
+        origin->close();
+    });
+    return origin;
+}
+
+/**
+ * @brief 源站 -> 代理(SocketStream::pump, splice经过pipe) -> 客户端, 代理不把数据读进用户态
+ */
+void test_splice() {
+    frb::Socket::ptr origin = start_origin();
+    frb::Address::ptr origin_addr = origin->getLocalAddress();
+
+    frb::Socket::ptr proxy = listen_socket();
+    frb::IOManager::GetThis()->schedule([proxy, origin_addr]() {
+        frb::SocketStream::ptr client(new frb::SocketStream(proxy->accept()));
+        frb::SocketStream::ptr upstream(new frb::SocketStream(connect_socket(origin_addr)));
+        int64_t rt = upstream->pump(client);
+        LOG_INFO_STREAM(g_logger) << "pump rt=" << rt;
+        ASSERT(rt == (int64_t)s_file_size);
+        upstream->close();
+        client->close();
+        proxy->close();
+    });
+
+    frb::Socket::ptr sock = connect_socket(proxy->getLocalAddress());
+    size_t total = recv_all(sock->getSocket());
+    sock->close();
+    LOG_INFO_STREAM(g_logger) << "test_splice recv=" << total;
+    ASSERT(total == s_file_size);
+}
+
+/**
+ * @brief 客户端中途断开, pump返回已经转发的长度而不是-1
+ */
+void test_splice_peer_close() {
+    //写已经断开的socket不能让进程退出
+    signal(SIGPIPE, SIG_IGN);
+    frb::Socket::ptr origin = start_origin(false);
+    frb::Address::ptr origin_addr = origin->getLocalAddress();
+
+    const size_t recv_size = 1024 * 1024;
+    frb::Socket::ptr proxy = listen_socket();
+    frb::IOManager::GetThis()->schedule([proxy, origin_addr, recv_size]() {
+        frb::SocketStream::ptr client(new frb::SocketStream(proxy->accept()));
+        frb::SocketStream::ptr upstream(new frb::SocketStream(connect_socket(origin_addr)));
+        int64_t rt = upstream->pump(client);
+        LOG_INFO_STREAM(g_logger) << "test_splice_peer_close pump rt=" << rt;
+        ASSERT(rt >= (int64_t)recv_size && rt < (int64_t)s_file_size);
+        upstream->close();
+        client->close();
+        proxy->close();
+    });
+
+    frb::Socket::ptr sock = connect_socket(proxy->getLocalAddress());
+    std::string buff(recv_size, 0);
+    size_t total = 0;
+    while(total < recv_size) {
+        int rt = sock->recv(&buff[total], recv_size - total);
+        ASSERT(rt > 0);
+        total += rt;
+    }
+    //RST关闭, 代理下一次写出就失败
+    linger lg = {1, 0};
+    setsockopt(sock->getSocket(), SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    sock->close();
+}
+
+/**
+ * @brief 只校验写入内容的Stream, pump的目标不是socket时走ByteArray拷贝
+ */
+class CheckStream : public frb::Stream {
+public:
+    typedef std::shared_ptr<CheckStream> ptr;
+    int read(void* buffer, size_t length) override { return -1; }
+    int read(frb::ByteArray::ptr ba, size_t length) override { return -1; }
+    int write(const void* buffer, size_t length) override {
+        for(size_t i = 0; i < length; ++i) {
+            ok = ok && ((const uint8_t*)buffer)[i] == (total + i) % 251;
+        }
+        total += length;
+        return length;
+    }
+    int write(frb::ByteArray::ptr ba, size_t length) override {
+        std::string buff(length, 0);
+        ba->read(&buff[0], length);
+        return write(buff.c_str(), length);
+    }
+    void close() override {}
+
+    size_t total = 0;
+    bool ok = true;
+};
+
+void test_pump_copy() {
+    frb::Socket::ptr origin = start_origin();
+    frb::SocketStream upstream(connect_socket(origin->getLocalAddress()));
+    CheckStream::ptr out(new CheckStream);
+    int64_t rt = upstream.pump(out);
+    upstream.close();
+    LOG_INFO_STREAM(g_logger) << "test_pump_copy rt=" << rt;
+    ASSERT(rt == (int64_t)s_file_size);
+    ASSERT(out->total == s_file_size && out->ok);
+}
+
+
+/**
+ * @brief 单线程accept吞吐: 旧流程(accept + fstat/fcntl登记 + setsockopt*2 + getsockname + getpeername)
+ *        对比accept4(SOCK_NONBLOCK)带回对端地址
+ */
+void bench_accept(bool lean) {
+    //连接先在监听队列里排好, 计时只包含accept一侧
+    const int n = 4000;
+    sockaddr_in addr;
+    int lsock = listen_local(addr);
+    int one = 1;
+    setsockopt(lsock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    std::vector<int> clients;
+    frb::set_hook_enable(false);
+    for(int i = 0; i < n; ++i) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        //RST关闭, 不留TIME_WAIT占端口
+        linger lg = {1, 0};
+        setsockopt(sock, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        if(connect(sock, (const sockaddr*)&addr, sizeof(addr))) {
+            close(sock);
+            break;
+        }
+        clients.push_back(sock);
+    }
+    frb::set_hook_enable(true);
+
+    uint64_t start = frb::GetCurrentUS();
+    for(size_t i = 0; i < clients.size(); ++i) {
+        int sock = -1;
+        if(lean) {
+            sockaddr_in peer;
+            socklen_t len = sizeof(peer);
+            sock = accept4(lsock, (sockaddr*)&peer, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        } else {
+            sock = accept(lsock, nullptr, nullptr);
+            //旧的FdCtx登记方式
+            frb::FdMgr::GetInstance()->del(sock);
+            frb::FdMgr::GetInstance()->get(sock, true);
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::shared_ptr<sockaddr_in> local(new sockaddr_in), remote(new sockaddr_in);
+            socklen_t len = sizeof(sockaddr_in);
+            getsockname(sock, (sockaddr*)local.get(), &len);
+            len = sizeof(sockaddr_in);
+            getpeername(sock, (sockaddr*)remote.get(), &len);
+        }
+        if(sock < 0) {
+            LOG_ERROR_STREAM(g_logger) << "accept errno=" << errno;
+            break;
+        }
+        frb::FdMgr::GetInstance()->del(sock);
+        close_f(sock);
+    }
+    uint64_t used = frb::GetCurrentUS() - start;
+    for(auto i : clients) {
+        close(i);
+    }
+    close(lsock);
+    LOG_INFO_STREAM(g_logger) << (lean ? "accept4" : "accept+init") << " conns=" << clients.size()
+        << " used=" << used / 1000.0 << "ms accepts/s=" << clients.size() * 1e6 / used;
+}
+
+/**
+ * @brief 分片监听: 每个io线程一个SO_REUSEPORT监听socket, accept协程和连接处理都绑定在该线程
+ *        校验连接始终在accept它的线程上处理(包括recv等待和usleep之后), 并打印内核在各socket间的分流
+ * @details use_caller的IOManager, caller线程不建监听socket
+ */
+void test_reuseport(bool cbpf) {
+    frb::IOManager iom(3, true, "reuseport");
+    const std::vector<int> threads = iom.getWorkerThreadIds();
+    ASSERT(threads.size() == 2);
+    const int n = 600;
+
+    //第一个socket取随机端口, 其余绑同一端口
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::vector<int> lsocks;
+    int one = 1;
+    for(size_t i = 0; i < threads.size(); ++i) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        socklen_t len = sizeof(addr);
+        if(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))
+                || bind(sock, (const sockaddr*)&addr, sizeof(addr))
+                || listen(sock, SOMAXCONN)
+                || getsockname(sock, (sockaddr*)&addr, &len)) {
+            LOG_ERROR_STREAM(g_logger) << "reuseport listen errno=" << errno;
+            close(sock);
+            return;
+        }
+        lsocks.push_back(sock);
+    }
+    if(cbpf) {
+        //按处理软中断的CPU选socket, io线程没有绑核时分流取决于调度
+        sock_filter code[] = {
+            { BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+            { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)lsocks.size() },
+            { BPF_RET | BPF_A, 0, 0, 0 }
+        };
+        sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+        if(setsockopt(lsocks[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+            LOG_ERROR_STREAM(g_logger) << "attach cbpf errno=" << errno;
+        }
+    }
+
+    std::vector<std::atomic<int> > accepted(lsocks.size());
+    std::atomic<int> handled(0), migrated(0);
+    for(size_t i = 0; i < lsocks.size(); ++i) {
+        accepted[i] = 0;
+        int lsock = lsocks[i];
+        iom.schedule([&, i, lsock]() {
+            //在所属线程上登记FdCtx, 之后accept走hook等待
+            frb::FdMgr::GetInstance()->get(lsock, true);
+            int owner = frb::GetThreadId();
+            while(true) {
+                int sock = accept4(lsock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if(sock < 0) {
+                    break;
+                }
+                ++accepted[i];
+                frb::IOManager::GetThis()->schedule([&, sock, owner]() {
+                    char c = 0;
+                    //对端延迟发送, 这里会挂起等READ, 唤醒后仍应在owner线程
+                    int rt = recv(sock, &c, 1, 0);
+                    if(frb::GetThreadId() != owner) {
+                        ++migrated;
+                    }
+                    //定时器唤醒后也应在owner线程
+                    usleep(1000);
+                    if(frb::GetThreadId() != owner) {
+                        ++migrated;
+                    }
+                    if(rt == 1) {
+                        send(sock, &c, 1, 0);
+                    }
+                    close(sock);
+                    ++handled;
+                }, frb::Scheduler::GetTaskThread());
+            }
+        }, threads[i]);
+    }
+
+    uint64_t start = frb::GetCurrentUS();
+    std::thread client([&]() {
+        for(int i = 0; i < n; ++i) {
+            int sock = connect_local(addr);
+            if(sock < 0) {
+                break;
+            }
+            usleep(50);
+            char c = 'x';
+            if(send(sock, &c, 1, 0) != 1 || recv(sock, &c, 1, 0) != 1) {
+                LOG_ERROR_STREAM(g_logger) << "reuseport echo errno=" << errno;
+            }
+            close(sock);
+        }
+    });
+    client.join();
+    while(handled < n && frb::GetCurrentUS() - start < 5 * 1000 * 1000) {
+        usleep(1000);
+    }
+    uint64_t used = frb::GetCurrentUS() - start;
+    //在所属线程上关闭监听socket, 取消accept的等待
+    for(size_t i = 0; i < lsocks.size(); ++i) {
+        int lsock = lsocks[i];
+        iom.schedule([lsock]() { close(lsock);}, threads[i]);
+    }
+
+    std::stringstream ss;
+    for(size_t i = 0; i < lsocks.size(); ++i) {
+        ss << " [" << threads[i] << "]=" << accepted[i];
+    }
+    LOG_INFO_STREAM(g_logger) << "reuseport" << (cbpf ? "+cbpf" : "") << " conns=" << n
+        << " handled=" << handled << " migrated=" << migrated
+        << " used=" << used / 1000.0 << "ms accepted:" << ss.str();
+    ASSERT(handled == n);
+    ASSERT(migrated == 0);
+    for(size_t i = 0; !cbpf && i < lsocks.size(); ++i) {
+        ASSERT(accepted[i] > 0);
+    }
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1 && std::string(argv[1]) == "reuseport") {
+        test_reuseport(argc > 2 && std::string(argv[2]) == "cbpf");
+        return 0;
+    }
     frb::IOManager iom;
-    iom.schedule(test_sock);
+    if(argc > 1 && std::string(argv[1]) == "zerocopy") {
+        iom.schedule(test_sendfile);
+        iom.schedule(test_splice);
+        iom.schedule(test_splice_peer_close);
+        iom.schedule(test_pump_copy);
+    } else if(argc > 1 && std::string(argv[1]) == "accept") {
+        iom.schedule([]() {
+            bench_accept(false);
+            bench_accept(true);
+        });
+    } else {
+        iom.schedule(test_sock);
+    }
     return 0;
 }
\ No newline at end of file
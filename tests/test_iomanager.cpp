@@ -1,12 +1,14 @@
 
 #include "../include/iomanager.h"
 #include "../include/timer.h"
+#include "../include/macro.h"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <iostream>
+#include <atomic>
 #include <sys/epoll.h>
 
 
@@ -66,8 +68,52 @@ void test_timer(){
 
 }
 
+/**
+ * @brief 事件触发一次后从fd上清掉: 同一fd可以再次addEvent, cancelAll不会再触发已触发过的事件
+ */
+void test_event_rearm() {
+    int fds[2];
+    ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    std::atomic<int> fired{0};
+    {
+        frb::IOManager iom(1, false, "rearm");
+        const int rounds = 3;
+        for(int i = 0; i < rounds; ++i) {
+            //回调在addEvent所在的调度器上执行, 要在iom里注册
+            std::atomic<bool> armed{false};
+            iom.schedule([&iom, &fired, &fds, &armed]() {
+                ASSERT(iom.addEvent(fds[0], frb::IOManager::READ, [&fired, &fds]() {
+                    char c;
+                    ASSERT(read(fds[0], &c, 1) == 1);
+                    ++fired;
+                }) == 0);
+                armed = true;
+            });
+            for(int n = 0; n < 100 && !armed; ++n) {
+                usleep(10 * 1000);
+            }
+            ASSERT(armed);
+            ASSERT(write(fds[1], "x", 1) == 1);
+            for(int n = 0; n < 100 && fired <= i; ++n) {
+                usleep(10 * 1000);
+            }
+            ASSERT(fired == i + 1);
+        }
+        //READ已经触发过, fd上没有剩下的事件
+        ASSERT(!iom.cancelAll(fds[0]));
+        ASSERT(fired == rounds);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    std::cout << "test_event_rearm ok" << std::endl;
+}
 
 int main(int argc, char** argv) {
+    if(argc > 1 && std::string(argv[1]) == "event") {
+        test_event_rearm();
+        return 0;
+    }
 
     //test1();
     test_timer();
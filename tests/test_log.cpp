@@ -1,8 +1,267 @@
 #include <iostream>
 #include <string>
 #include "../include/log.h"
+#include "../include/iomanager.h"
 #include "../include/utils.h"
+#include "../include/macro.h"
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 
+static std::string read_file(const std::string& name) {
+    std::ifstream ifs(name);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static uint64_t file_size(const std::string& name) {
+    struct stat st;
+    return stat(name.c_str(), &st) ? 0 : st.st_size;
+}
+
+/**
+ * @brief 用MmapFileLogAppender写n条"prefix i"
+ */
+static void mmap_write(frb::Logger::ptr logger, frb::MmapFileLogAppender::ptr appender
+                       ,const std::string& prefix, int n, std::string& expect) {
+    for(int i = 0; i < n; ++i) {
+        frb::LogEvent::ptr event(new frb::LogEvent(logger, frb::LogLevel::INFO, __FILE__, __LINE__
+                    ,0, 1, 2, time(0), "mmap"));
+        event->getSS() << prefix << " " << i;
+        appender->log(logger, frb::LogLevel::INFO, event);
+        expect += prefix + " " + std::to_string(i) + "\n";
+    }
+}
+
+/**
+ * @brief 析构后文件只剩写入的内容(没有预分配的0字节); 重新打开后接着写;
+ *        重新加载配置时新旧appender同时打开同一文件, 交替写入不能互相覆盖, 旧的先析构不能截掉新的写入
+ */
+void test_mmap_appender() {
+    const std::string name = "./mmap_log_test.txt";
+    unlink(name.c_str());
+    frb::Logger::ptr logger(new frb::Logger("mmap"));
+    frb::LogFormatter::ptr fmt(new frb::LogFormatter("%m%n"));
+    std::string expect;
+
+    //块大小取一页, 写入会跨越多个块
+    frb::MmapFileLogAppender::ptr a(new frb::MmapFileLogAppender(name, 4096));
+    a->setFormatter(fmt);
+    a->setLevel(frb::LogLevel::FATAL);
+    mmap_write(logger, a, "first", 1000, expect);
+    a.reset();
+    ASSERT(file_size(name) == expect.size());
+    ASSERT(read_file(name) == expect);
+
+    //重新打开, 追加在已有内容之后
+    a.reset(new frb::MmapFileLogAppender(name, 4096));
+    a->setFormatter(fmt);
+    a->setLevel(frb::LogLevel::FATAL);
+    mmap_write(logger, a, "second", 10, expect);
+
+    //重新加载: 新appender打开时旧的还在
+    frb::MmapFileLogAppender::ptr b(new frb::MmapFileLogAppender(name, 4096));
+    b->setFormatter(fmt);
+    b->setLevel(frb::LogLevel::FATAL);
+    mmap_write(logger, b, "reload", 1000, expect);
+    //旧appender析构前还会继续写, 和新的交替写入不能互相覆盖
+    for(int i = 0; i < 200; ++i) {
+        mmap_write(logger, a, "old" + std::to_string(i), 1, expect);
+        mmap_write(logger, b, "new" + std::to_string(i), 1, expect);
+    }
+    ASSERT(read_file(name).substr(0, expect.size()) == expect);
+    a.reset();
+    ASSERT(read_file(name).substr(0, expect.size()) == expect);
+    mmap_write(logger, b, "after", 10, expect);
+    b.reset();
+    ASSERT(file_size(name) == expect.size());
+    ASSERT(read_file(name) == expect);
+    unlink(name.c_str());
+    std::cout << "test_mmap_appender ok size=" << expect.size() << std::endl;
+}
+/**
+ * @brief 把日志内容记到内存里, 用来检查限流/采样的结果
+ */
+class CaptureLogAppender : public frb::LogAppender {
+public:
+    typedef std::shared_ptr<CaptureLogAppender> ptr;
+    void log(frb::Logger::ptr logger, frb::LogLevel::Level level, frb::LogEvent::ptr event) override {
+        frb::Mutex::Lock lock(m_mutex);
+        records.push_back(event->getContent());
+    }
+    std::string toYamlString() override { return ""; }
+
+    //汇总之外的条数
+    size_t normal() {
+        frb::Mutex::Lock lock(m_mutex);
+        size_t n = 0;
+        for(auto& i : records) {
+            n += i.find("suppressed ") != 0;
+        }
+        return n;
+    }
+
+    //汇总里的丢弃条数之和
+    uint64_t suppressed() {
+        frb::Mutex::Lock lock(m_mutex);
+        uint64_t n = 0;
+        for(auto& i : records) {
+            if(i.find("suppressed ") == 0) {
+                n += std::stoull(i.substr(11));
+            }
+        }
+        return n;
+    }
+
+    std::vector<std::string> records;
+private:
+    frb::Mutex m_mutex;
+};
+
+/**
+ * @brief 令牌桶: 突发burst条之后丢弃, 按rate补充; 下一次放行时先输出丢弃条数的汇总
+ */
+void test_limiter_rate() {
+    frb::Logger::ptr logger(new frb::Logger("limit"));
+    CaptureLogAppender::ptr capture(new CaptureLogAppender);
+    logger->addAppender(capture);
+
+    frb::LogLimiter limiter(logger, frb::LogLevel::ERROR, __FILE__, __LINE__, 10, 5);
+    int passed = 0;
+    for(int i = 0; i < 100; ++i) {
+        passed += limiter.allow(logger, frb::LogLevel::ERROR);
+    }
+    ASSERT(passed == 5);
+    ASSERT(capture->records.empty());
+
+    //1.1秒补充11个令牌, 桶容量5
+    usleep(1100 * 1000);
+    passed = 0;
+    for(int i = 0; i < 100; ++i) {
+        passed += limiter.allow(logger, frb::LogLevel::ERROR);
+    }
+    ASSERT(passed == 5);
+    ASSERT(capture->records.size() == 1);
+    ASSERT(capture->records[0].find("suppressed 95 log records at ") == 0);
+
+    //一秒内不再汇总, 后面丢弃的95条由flush输出
+    limiter.flush();
+    ASSERT(capture->records.size() == 2);
+    ASSERT(capture->suppressed() == 190);
+    limiter.flush();
+    ASSERT(capture->records.size() == 2);
+    std::cout << "test_limiter_rate ok" << std::endl;
+}
+
+/**
+ * @brief 采样: 每n条输出第1条; 宏展开的调用点按logger的配置采样,
+ *        突发之后没有日志的调用点由FlushAll汇总
+ */
+void test_limiter_sample() {
+    frb::Logger::ptr logger(new frb::Logger("sample"));
+    logger->setLevel(frb::LogLevel::INFO);
+    CaptureLogAppender::ptr capture(new CaptureLogAppender);
+    logger->addAppender(capture);
+
+    for(int i = 0; i < 100; ++i) {
+        LOG_LEVEL_STREAM_SAMPLE(logger, frb::LogLevel::INFO, 4) << "sample " << i;
+    }
+    //第二次放行前先汇总了前3条丢弃
+    ASSERT(capture->normal() == 25);
+    ASSERT(capture->records[1].find("suppressed 3 log records at ") == 0);
+    ASSERT(capture->records[2] == "sample 4");
+
+    //logger上配置采样后普通的宏也生效
+    logger->setSample(10);
+    for(int i = 0; i < 100; ++i) {
+        LOG_INFO_STREAM(logger) << "logger sample " << i;
+    }
+    logger->setSample(0);
+    ASSERT(capture->normal() == 35);
+    //两个调用点各在第二次放行时汇总过一次, 之后一秒内丢弃的没有输出
+    ASSERT(capture->suppressed() == 3 + 9);
+
+    frb::LogLimiter::FlushAll();
+    ASSERT(capture->suppressed() == 75 + 90);
+    size_t records = capture->records.size();
+    frb::LogLimiter::FlushAll();
+    ASSERT(capture->records.size() == records);
+    ASSERT(capture->suppressed() == 75 + 90);
+
+    //没有配置限流时不经过LogLimiter
+    for(int i = 0; i < 10; ++i) {
+        LOG_INFO_STREAM(logger) << "no limit " << i;
+    }
+    ASSERT(capture->normal() == 45);
+    std::cout << "test_limiter_sample ok" << std::endl;
+}
+
+/**
+ * @brief 析构时输出还没汇总的丢弃条数
+ */
+void test_limiter_shutdown() {
+    frb::Logger::ptr logger(new frb::Logger("shutdown"));
+    CaptureLogAppender::ptr capture(new CaptureLogAppender);
+    logger->addAppender(capture);
+    {
+        frb::LogLimiter limiter(logger, frb::LogLevel::ERROR, __FILE__, __LINE__, 0, 0, 3);
+        //放行第1条, 丢弃后面2条, 之后没有放行的机会
+        for(int i = 0; i < 3; ++i) {
+            limiter.allow(logger, frb::LogLevel::ERROR);
+        }
+        ASSERT(capture->records.empty());
+    }
+    ASSERT(capture->records.size() == 1);
+    ASSERT(capture->suppressed() == 2);
+    std::cout << "test_limiter_shutdown ok" << std::endl;
+}
+
+/**
+ * @brief 第一个启动的IOManager每秒汇总一次, 突发之后没有日志的调用点不用等到析构;
+ *        周期定时器不影响IOManager停止, 停止后交给下一个IOManager
+ */
+void test_limiter_timer() {
+    frb::Logger::ptr logger(new frb::Logger("timer"));
+    CaptureLogAppender::ptr capture(new CaptureLogAppender);
+    logger->addAppender(capture);
+    frb::LogLimiter limiter(logger, frb::LogLevel::ERROR, __FILE__, __LINE__, 0, 0, 3);
+
+    for(int n = 1; n <= 2; ++n) {
+        uint64_t start = frb::GetCurrentMS();
+        {
+            frb::IOManager iom(1, false, "log_flush");
+            for(int i = 0; i < 3; ++i) {
+                limiter.allow(logger, frb::LogLevel::ERROR);
+            }
+            for(int i = 0; i < 20 && capture->suppressed() < 2u * n; ++i) {
+                usleep(100 * 1000);
+            }
+            ASSERT(capture->suppressed() == 2u * n);
+        }
+        ASSERT(frb::GetCurrentMS() - start < 3000);
+    }
+    std::cout << "test_limiter_timer ok" << std::endl;
+}
+/**
+ * @brief Create()复用的事件带着创建时的线程名称, 线程改名或退出后不变
+ */
+void test_event_thread_name() {
+    frb::Logger::ptr logger(new frb::Logger("name"));
+    frb::LogEvent::ptr renamed;
+    frb::LogEvent::ptr exited;
+    frb::Thread::ptr thr(new frb::Thread([logger, &renamed, &exited]() {
+        renamed = frb::LogEvent::Create(logger, frb::LogLevel::INFO, __FILE__, __LINE__);
+        frb::Thread::SetName("name_after");
+        ASSERT(renamed->getThreadName() == "name_before");
+        exited = frb::LogEvent::Create(logger, frb::LogLevel::INFO, __FILE__, __LINE__);
+    }, "name_before"));
+    thr->join();
+    ASSERT(renamed->getThreadName() == "name_before");
+    ASSERT(exited->getThreadName() == "name_after");
+    std::cout << "test_event_thread_name ok" << std::endl;
+}
 
 int main(int argc, char** argv) {
     frb::Logger::ptr logger(new frb::Logger);
@@ -19,6 +278,11 @@ int main(int argc, char** argv) {
 
     logger->addAppender(file_appender);
 
+    frb::MmapFileLogAppender::ptr mmap_appender(new frb::MmapFileLogAppender("./mmap_log.txt"));
+    mmap_appender->setFormatter(fmt);
+    mmap_appender->setLevel(frb::LogLevel::ERROR);
+    logger->addAppender(mmap_appender);
+
     const std::string treadname("tread");
 
     frb::LogEvent::ptr event(new  frb::LogEvent(logger, logger->getLevel(), __FILE__, __LINE__, 0,  1,  2, time(0), treadname));
@@ -27,5 +291,12 @@ int main(int argc, char** argv) {
 
     auto l = frb::LoggerMgr::GetInstance()->getLogger("xx");
     LOG_ERROR(l, "this is error");
+
+    test_mmap_appender();
+    test_limiter_rate();
+    test_limiter_sample();
+    test_limiter_shutdown();
+    test_limiter_timer();
+    test_event_thread_name();
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "../include/scheduler.h"
+#include "../include/macro.h"
 
 static frb::Logger::ptr g_logger = GET_LOG_ROOT;
 
@@ -11,9 +12,43 @@ void test_fiber(){
         frb::Scheduler::GetThis()->schedule(&test_fiber);
     }
 }
+/**
+ * @brief 批量轮转分配, 每个工作线程应分到相同数量的任务
+ * @param[in] use_caller 为true时caller线程只在stop()里调度, 不应分到任务
+ */
+void test_round_robin(bool use_caller) {
+    frb::Scheduler sc(3, use_caller, "rr");
+    sc.start();
+    frb::Mutex mutex;
+    std::map<int, int> counts;
+    std::vector<std::function<void()> > tasks;
+    for(int i = 0; i < 30; ++i) {
+        tasks.push_back([&mutex, &counts]() {
+            frb::Mutex::Lock lock(mutex);
+            ++counts[frb::GetThreadId()];
+        });
+    }
+    sc.scheduleRoundRobin(tasks.begin(), tasks.end());
+    sc.stop();
+
+    const std::vector<int>& workers = sc.getWorkerThreadIds();
+    ASSERT(workers.size() == (use_caller ? 2u : 3u));
+    ASSERT(counts.size() == workers.size());
+    for(auto id : workers) {
+        ASSERT(counts[id] == 30 / (int)workers.size());
+    }
+    ASSERT(!use_caller || counts.find(frb::GetThreadId()) == counts.end());
+    for(auto& i : counts) {
+        LOG_INFO_STREAM(g_logger) << "use_caller=" << use_caller
+            << " thread=" << i.first << " tasks=" << i.second;
+    }
+}
+
 int main(){
 
     LOG_INFO_STREAM(g_logger) << "main";
+    test_round_robin(false);
+    test_round_robin(true);
 
     YAML::Node root = YAML::LoadFile("/home/bing/mycode2022/server-framework/bin/conf/log.yaml");
     frb::Config::LoadFromYaml(root);
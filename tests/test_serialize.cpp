@@ -0,0 +1,209 @@
+#include "../include/serialize.h"
+#include "../include/log.h"
+#include "../include/macro.h"
+#include "../include/utils.h"
+
+frb::Logger::ptr g_logger = GET_LOG_ROOT;
+
+namespace test {
+
+struct Point {
+    int32_t x;
+    int32_t y;
+    float z;
+};
+FRB_SERIALIZE(Point, x, y, z)
+
+struct Message {
+    uint32_t id;
+    uint64_t time;
+    int16_t type;
+    bool flag;
+    double score;
+    Point pos;
+    std::string name;
+    std::vector<int32_t> values;
+    std::map<std::string, int32_t> tags;
+    std::vector<Point> path;
+    uint8_t end;
+};
+FRB_SERIALIZE(Message, id, time, type, flag, score, pos, name, values, tags, path, end)
+
+/**
+ * @brief 手写的等价编解码, 用来对照结果和性能
+ */
+void ManualWrite(frb::ByteArray& ba, const Message& m) {
+    ba.writeFuint32(m.id);
+    ba.writeFuint64(m.time);
+    ba.writeFint16(m.type);
+    ba.writeFuint8(m.flag);
+    ba.writeDouble(m.score);
+    ba.writeFint32(m.pos.x);
+    ba.writeFint32(m.pos.y);
+    ba.writeFloat(m.pos.z);
+    ba.writeStringVint(m.name);
+    ba.writeUint64(m.values.size());
+    for(auto& i : m.values) {
+        ba.writeFint32(i);
+    }
+    ba.writeUint64(m.tags.size());
+    for(auto& i : m.tags) {
+        ba.writeStringVint(i.first);
+        ba.writeFint32(i.second);
+    }
+    ba.writeUint64(m.path.size());
+    for(auto& i : m.path) {
+        ba.writeFint32(i.x);
+        ba.writeFint32(i.y);
+        ba.writeFloat(i.z);
+    }
+    ba.writeFuint8(m.end);
+}
+
+void ManualRead(frb::ByteArray& ba, Message& m) {
+    m.id = ba.readFuint32();
+    m.time = ba.readFuint64();
+    m.type = ba.readFint16();
+    m.flag = ba.readFuint8();
+    m.score = ba.readDouble();
+    m.pos.x = ba.readFint32();
+    m.pos.y = ba.readFint32();
+    m.pos.z = ba.readFloat();
+    m.name = ba.readStringVint();
+    m.values.resize(ba.readUint64());
+    for(auto& i : m.values) {
+        i = ba.readFint32();
+    }
+    m.tags.clear();
+    size_t n = ba.readUint64();
+    for(size_t i = 0; i < n; ++i) {
+        std::string key = ba.readStringVint();
+        m.tags[key] = ba.readFint32();
+    }
+    m.path.resize(ba.readUint64());
+    for(auto& i : m.path) {
+        i.x = ba.readFint32();
+        i.y = ba.readFint32();
+        i.z = ba.readFloat();
+    }
+    m.end = ba.readFuint8();
+}
+
+bool operator==(const Point& a, const Point& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+bool operator==(const Message& a, const Message& b) {
+    return a.id == b.id && a.time == b.time && a.type == b.type
+        && a.flag == b.flag && a.score == b.score && a.pos == b.pos
+        && a.name == b.name && a.values == b.values && a.tags == b.tags
+        && a.path == b.path && a.end == b.end;
+}
+
+}
+
+static_assert(frb::Serializer<test::Point>::fixed, "Point should be fixed");
+static_assert(frb::Serializer<test::Point>::size == 12, "Point size");
+static_assert(!frb::Serializer<test::Message>::fixed, "Message has variable fields");
+//id, time, type, flag, score, pos 合成一块
+static_assert(frb::SerializeFixedRun<decltype(FrbSerializeFields((const test::Message*)nullptr))>::size == 4 + 8 + 2 + 1 + 8 + 12
+              , "leading fixed run");
+
+test::Message make_message(int n) {
+    test::Message m;
+    m.id = n;
+    m.time = frb::GetCurrentMS();
+    m.type = -n;
+    m.flag = n & 1;
+    m.score = n / 3.0;
+    m.pos = {n, -n, n / 7.0f};
+    m.name = "message_" + std::to_string(n);
+    for(int i = 0; i < n % 16; ++i) {
+        m.values.push_back(i * n);
+        m.tags["tag" + std::to_string(i)] = i;
+        m.path.push_back({i, i * 2, i / 3.0f});
+    }
+    m.end = 0xff;
+    return m;
+}
+
+void test_serialize() {
+    for(bool little : {false, true}) {
+        for(int n = 0; n < 100; ++n) {
+            test::Message m = make_message(n);
+            frb::ByteArray manual(17);
+            frb::ByteArray reflect(17);
+            manual.setIsLittleEndian(little);
+            reflect.setIsLittleEndian(little);
+            test::ManualWrite(manual, m);
+            frb::Serialize(reflect, m);
+            manual.setPosition(0);
+            reflect.setPosition(0);
+            ASSERT(manual.toString() == reflect.toString());
+
+            test::Message out;
+            frb::Deserialize(reflect, out);
+            ASSERT(out == m);
+            ASSERT(reflect.getReadSize() == 0);
+        }
+    }
+
+    //截断的数据要抛异常
+    frb::ByteArray ba;
+    frb::Serialize(ba, make_message(15));
+    size_t size = ba.getSize();
+    ba.setPosition(0);
+    std::string data = ba.toString();
+    for(size_t len = 0; len < size; len += 7) {
+        frb::ByteArray part;
+        part.write(data.c_str(), len);
+        part.setPosition(0);
+        test::Message out;
+        bool thrown = false;
+        try {
+            frb::Deserialize(part, out);
+        } catch(std::out_of_range&) {
+            thrown = true;
+        }
+        ASSERT(thrown);
+    }
+    LOG_INFO_STREAM(g_logger) << "test_serialize ok";
+}
+
+void bench_serialize() {
+    const int count = 1000000;
+    std::vector<test::Message> msgs;
+    for(int i = 0; i < 1000; ++i) {
+        msgs.push_back(make_message(i));
+    }
+
+    frb::ByteArray ba;
+    test::Message out;
+    uint64_t start = frb::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        ba.clear();
+        test::ManualWrite(ba, msgs[i % msgs.size()]);
+        ba.setPosition(0);
+        test::ManualRead(ba, out);
+    }
+    uint64_t manual_us = frb::GetCurrentUS() - start;
+
+    start = frb::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        ba.clear();
+        frb::Serialize(ba, msgs[i % msgs.size()]);
+        ba.setPosition(0);
+        frb::Deserialize(ba, out);
+    }
+    uint64_t reflect_us = frb::GetCurrentUS() - start;
+
+    LOG_INFO_STREAM(g_logger) << "serialize count=" << count
+                    << " manual=" << manual_us << "us"
+                    << " FRB_SERIALIZE=" << reflect_us << "us";
+}
+
+int main(int argc, char** argv) {
+    test_serialize();
+    bench_serialize();
+    return 0;
+}
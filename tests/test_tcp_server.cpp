@@ -1,25 +1,107 @@
 #include "../include/iomanager.h"
 #include "../include/log.h"
+#include "../include/macro.h"
 #include "../include/tcp_server.h"
-frb::Logger::ptr g_logger = GET_LOG_ROOT();
-
-void run() {
-    auto addr = frb::Address::LookupAny("0.0.0.0:8033");
-    
-    std::vector<frb::Address::ptr> addrs;
-    addrs.push_back(addr);
-    
-
-    frb::TcpServer::ptr tcp_server(new frb::TcpServer);
-    std::vector<frb::Address::ptr> fails;
-    while(!tcp_server->bind(addrs, fails)) {
-        sleep(2);
-    }
-    tcp_server->start();
-    
+#include <sys/socket.h>
+#include <unistd.h>
+#include <map>
+#include <atomic>
+
+frb::Logger::ptr g_logger = GET_LOG_ROOT;
+
+/**
+ * @brief 记录每个连接在哪个线程上处理
+ */
+class CountServer : public frb::TcpServer {
+public:
+    typedef std::shared_ptr<CountServer> ptr;
+
+    CountServer(frb::IOManager* iom)
+        :frb::TcpServer(iom, iom, iom) {
+    }
+
+    size_t total() {
+        frb::Mutex::Lock lock(m_mutex);
+        return m_total;
+    }
+
+    std::map<int, size_t> threads() {
+        frb::Mutex::Lock lock(m_mutex);
+        return m_threads;
+    }
+protected:
+    void handleClient(frb::Socket::ptr client) override {
+        {
+            frb::Mutex::Lock lock(m_mutex);
+            ++m_threads[frb::GetThreadId()];
+            ++m_total;
+        }
+        client->close();
+    }
+private:
+    frb::Mutex m_mutex;
+    size_t m_total = 0;
+    std::map<int, size_t> m_threads;
+};
+
+/**
+ * @brief 一批连接同时到达, 按批accept后分到所有io线程上处理
+ * @param[in] reuseport 每个io线程一个SO_REUSEPORT监听socket, 由内核分流
+ */
+void test_burst(bool reuseport) {
+    const int threads = 4;
+    const int n = 400;
+    frb::IOManager iom(threads, false, "tcp_server");
+    CountServer::ptr server(new CountServer(&iom));
+    server->setAccessLog(nullptr);
+    server->setReusePort(reuseport);
+    //监听socket要在iom里创建, hook才会把它设成非阻塞, accept等待时让出线程
+    std::atomic<bool> started{false};
+    iom.schedule([server, &started]() {
+        ASSERT(server->bind(frb::IPv4Address::Create("127.0.0.1", 0)));
+        ASSERT(server->start());
+        started = true;
+    });
+    for(int i = 0; i < 500 && !started; ++i) {
+        usleep(10 * 1000);
+    }
+    ASSERT(started);
+    ASSERT(server->getSocks().size() == (reuseport ? (size_t)threads : 1u));
+    frb::Address::ptr addr = server->getSocks()[0]->getLocalAddress();
+
+    //主线程不在iom里, 这里的connect不经过hook
+    std::vector<int> clients;
+    for(int i = 0; i < n; ++i) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT(connect(sock, addr->getAddr(), addr->getAddrLen()) == 0);
+        clients.push_back(sock);
+    }
+    for(int i = 0; i < 500 && server->total() < (size_t)n; ++i) {
+        usleep(10 * 1000);
+    }
+    for(auto i : clients) {
+        close(i);
+    }
+    ASSERT(server->total() == (size_t)n);
+
+    std::map<int, size_t> counts = server->threads();
+    size_t min = n;
+    size_t max = 0;
+    for(auto& i : counts) {
+        LOG_INFO_STREAM(g_logger) << "test_burst reuseport=" << reuseport
+            << " thread=" << i.first << " clients=" << i.second;
+        min = std::min(min, i.second);
+        max = std::max(max, i.second);
+    }
+    ASSERT(counts.size() == (size_t)threads);
+    //单个监听socket时轮转分配, 各线程最多差1个; 分片监听时按内核的哈希分流
+    ASSERT(reuseport || max - min <= 1);
+    server->stop();
+    std::cout << "test_burst reuseport=" << reuseport << " ok" << std::endl;
 }
+
 int main(int argc, char** argv) {
-    frb::IOManager iom(2);
-    iom.schedule(run);
+    test_burst(false);
+    test_burst(true);
     return 0;
 }
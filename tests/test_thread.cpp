@@ -3,6 +3,8 @@
 #include "../include/log.h"
 #include "../include/thread.h"
 #include "../include/config.h"
+#include "../include/macro.h"
+#include "../include/utils.h"
 
 frb::Logger::ptr g_logger = GET_LOG_ROOT;
 frb::Logger::ptr sys_logger = GET_LOG_NAME("system");
@@ -36,7 +38,82 @@ void fun3() {
     }
 }
 
+/**
+ * @brief 统计存活对象数, 检查旧快照都被回收
+ */
+struct RcuItem {
+    RcuItem(uint64_t v = 0) :a(v), b(~v) { ++s_alive; }
+    RcuItem(const RcuItem& o) :a(o.a), b(o.b) { ++s_alive; }
+    ~RcuItem() { --s_alive; }
+    uint64_t a;
+    uint64_t b;
+    static std::atomic<int64_t> s_alive;
+};
+std::atomic<int64_t> RcuItem::s_alive{0};
+
+/**
+ * @brief 读者和写者并发: 读到的快照总是完整的, 结束后只剩当前快照;
+ *        并对比RCUValue::get和std::atomic_load<shared_ptr>的读吞吐
+ */
+void test_rcu() {
+    const int readers = 4;
+    const int reads = 2000000;
+    {
+        frb::RCUValue<RcuItem> value(RcuItem(0));
+        std::atomic<bool> stop{false};
+        std::vector<frb::Thread::ptr> thrs;
+        for(int i = 0; i < readers; ++i) {
+            thrs.push_back(frb::Thread::ptr(new frb::Thread([&value, &stop]() {
+                uint64_t last = 0;
+                while(!stop) {
+                    auto v = value.get();
+                    ASSERT(v->b == ~v->a);
+                    ASSERT(v->a >= last);
+                    last = v->a;
+                }
+            }, "rcu_r" + std::to_string(i))));
+        }
+        for(uint64_t i = 1; i <= 200000; ++i) {
+            auto old = value.set(RcuItem(i));
+            ASSERT(old->a == i - 1);
+        }
+        stop = true;
+        for(auto& i : thrs) {
+            i->join();
+        }
+        ASSERT(RcuItem::s_alive == 1);
+    }
+    ASSERT(RcuItem::s_alive == 0);
+
+    frb::RCUValue<RcuItem> value(RcuItem(1));
+    std::shared_ptr<const RcuItem> shared = std::make_shared<RcuItem>(1);
+    for(int mode = 0; mode < 2; ++mode) {
+        std::vector<frb::Thread::ptr> thrs;
+        uint64_t start = frb::GetCurrentUS();
+        for(int i = 0; i < readers; ++i) {
+            thrs.push_back(frb::Thread::ptr(new frb::Thread([&value, &shared, mode, reads]() {
+                uint64_t sum = 0;
+                for(int n = 0; n < reads; ++n) {
+                    sum += mode ? value.get()->a : std::atomic_load(&shared)->a;
+                }
+                ASSERT(sum == (uint64_t)reads);
+            }, "rcu_b" + std::to_string(i))));
+        }
+        for(auto& i : thrs) {
+            i->join();
+        }
+        uint64_t used = frb::GetCurrentUS() - start;
+        LOG_INFO_STREAM(g_logger) << (mode ? "RCUValue::get" : "std::atomic_load")
+            << " threads=" << readers << " reads/s=" << readers * (double)reads * 1e6 / used;
+    }
+    LOG_INFO_STREAM(g_logger) << "test_rcu ok";
+}
+
 int main(int argc, char** argv) {
+    if(argc > 1 && std::string(argv[1]) == "rcu") {
+        test_rcu();
+        return 0;
+    }
     LOG_INFO_STREAM(g_logger) << "thread test begin";
     YAML::Node root = YAML::LoadFile("/home/bing/mycode2022/server-framework/bin/conf/log.yaml");
     frb::Config::LoadFromYaml(root);
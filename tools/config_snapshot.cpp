@@ -0,0 +1,22 @@
+#include "../include/config.h"
+#include <iostream>
+
+/**
+ * @brief 把YAML配置编译成二进制快照, 启动时用Config::LoadFromSnapshot加载
+ *        用法: config_snapshot <snapshot_file> <yaml_file>...
+ */
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        std::cout << "usage: " << argv[0] << " <snapshot_file> <yaml_file>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files(argv + 2, argv + argc);
+    if(!frb::Config::CompileSnapshot(files, argv[1])) {
+        std::cout << "compile snapshot " << argv[1] << " fail" << std::endl;
+        return 1;
+    }
+    std::cout << "compile snapshot " << argv[1] << " from "
+              << files.size() << " files" << std::endl;
+    return 0;
+}